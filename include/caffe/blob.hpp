@@ -1,6 +1,7 @@
 #ifndef CAFFE_BLOB_HPP_
 #define CAFFE_BLOB_HPP_
 
+#include <stdint.h>
 #include <algorithm>
 #include <string>
 #include <vector>
@@ -24,7 +25,8 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), forward_only_(false),
+         shape_version_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -51,6 +53,13 @@ class Blob {
   void Reshape(const vector<int>& shape);
   void Reshape(const BlobShape& shape);
   void ReshapeLike(const Blob& other);
+  /**
+   * @brief Returns a number that changes whenever the shape of the blob
+   *        changes, or its data_ or diff_ is replaced, and that no other blob
+   *        has had -- so a Layer can tell whether its blobs are still as it
+   *        last saw them.
+   */
+  inline uint64_t shape_version() const { return shape_version_; }
   inline string shape_string() const {
     ostringstream stream;
     for (int i = 0; i < shape_.size(); ++i) {
@@ -212,7 +221,7 @@ class Blob {
   }
 
   inline const shared_ptr<SyncedMemory>& diff() const {
-    CHECK(diff_);
+    EnsureDiff();
     return diff_;
   }
 
@@ -264,19 +273,44 @@ class Blob {
    *        in their Forward pass.
    *
    * This deallocates the SyncedMemory holding this Blob's diff_, as
-   * shared_ptr calls its destructor when reset with the "=" operator.
+   * shared_ptr calls its destructor when reset with the "=" operator. A
+   * forward-only Blob takes no diff_, and if other is forward-only, this
+   * Blob keeps its own.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to the given SyncedMemory, which
+   *        must be large enough for the current capacity -- used by Net to
+   *        let blobs with disjoint lifetimes share storage.
+   */
+  void set_data(const shared_ptr<SyncedMemory>& data);
+
+  /**
+   * @brief Drop the diff_ and stop Reshape from allocating a new one, for
+   *        blobs that no backward pass will use.
+   *
+   * A forward-only Blob that is asked for its diff after all allocates one
+   * then, of its capacity, which it drops again when it grows.
+   */
+  void set_forward_only(bool forward_only);
+  inline bool forward_only() const { return forward_only_; }
 
   bool ShapeEquals(const BlobProto& other);
 
  protected:
   shared_ptr<SyncedMemory> data_;
-  shared_ptr<SyncedMemory> diff_;
+  mutable shared_ptr<SyncedMemory> diff_;
   shared_ptr<SyncedMemory> shape_data_;
   vector<int> shape_;
   int count_;
   int capacity_;
+  bool forward_only_;
+  uint64_t shape_version_;
+
+  /// @brief Give the blob a new shape_version_.
+  void UpdateShapeVersion();
+  /// @brief Allocate the diff_ of a forward-only blob on first use.
+  void EnsureDiff() const;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
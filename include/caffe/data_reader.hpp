@@ -9,6 +9,7 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
 
 namespace caffe {
 
@@ -19,16 +20,26 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * Databases that keep their values in place while read, like LMDB, are not
+ * copied from: the data bytes of the queued records point into them.
+ *
+ * A dataset can be sharded over several databases (DataParameter.shard), and
+ * each database split into key ranges read by their own threads
+ * (DataParameter.reader_threads). The records of these streams are
+ * interleaved as DataParameter.interleave says before being distributed.
+ * With DataParameter.shuffle, each stream reads its records by key, from an
+ * index of the keys kept next to the database, in a new order every epoch.
  */
 class DataReader {
  public:
   explicit DataReader(const LayerParameter& param);
   ~DataReader();
 
-  inline BlockingQueue<Datum*>& free() const {
+  inline BlockingQueue<DatumRecord*>& free() const {
     return queue_pair_->free_;
   }
-  inline BlockingQueue<Datum*>& full() const {
+  inline BlockingQueue<DatumRecord*>& full() const {
     return queue_pair_->full_;
   }
 
@@ -39,12 +50,59 @@ class DataReader {
     explicit QueuePair(int size);
     ~QueuePair();
 
-    BlockingQueue<Datum*> free_;
-    BlockingQueue<Datum*> full_;
+    BlockingQueue<DatumRecord*> free_;
+    BlockingQueue<DatumRecord*> full_;
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
 
+  // Reads the records of a database with keys in [begin_key, end_key), the
+  // end being unbounded if empty, over and over on its own thread. If keys
+  // are given, reads those instead, shuffled every time. The database is
+  // opened once by the body for all the streams reading it, as LMDB allows
+  // only one environment per database and process; each stream reads it
+  // through its own cursor.
+  class Stream : public InternalThread {
+   public:
+    Stream(const DataParameter& param, const string& source,
+        const shared_ptr<db::DB>& db, const string& begin_key,
+        const string& end_key, int queue_size,
+        const vector<string>& keys = vector<string>());
+    virtual ~Stream();
+
+    // A value read, copied unless the cursor keeps it in place.
+    struct Value {
+      string key;
+      const char* data;
+      size_t size;
+      bool stable;
+      string copy;
+    };
+    BlockingQueue<Value*> free_;
+    BlockingQueue<Value*> full_;
+
+   protected:
+    void InternalThreadEntry();
+    // Moves cursor to the start of the range.
+    void seek(db::Cursor* cursor);
+    // Points value at the current value of cursor, and sets its key.
+    void read(db::Cursor* cursor, Value* value);
+    void read_shuffled(db::Cursor* cursor);
+
+    const DataParameter param_;
+    const string source_;
+    shared_ptr<db::DB> db_;
+    // Made on the body's thread, as LMDB cursors cannot be made on several
+    // threads at once, and then only used on the stream's.
+    shared_ptr<db::Cursor> cursor_;
+    const string begin_key_;
+    const string end_key_;
+    const vector<string> keys_;
+    vector<shared_ptr<Value> > values_;
+
+  DISABLE_COPY_AND_ASSIGN(Stream);
+  };
+
   // A single body is created per source
   class Body : public InternalThread {
    public:
@@ -53,10 +111,26 @@ class DataReader {
 
    protected:
     void InternalThreadEntry();
-    void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Opens the databases, and starts the streams if there are several.
+    void open();
+    void read_one(QueuePair* qp);
+    // The stream to take the next record from with ROUND_ROBIN, each as often
+    // as it has records, so that every record comes once per epoch.
+    int next_weighted_stream();
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
+    // A single database read by a single thread is read directly, on the
+    // body's thread; others by streams.
+    shared_ptr<db::DB> db_;
+    shared_ptr<db::Cursor> cursor_;
+    vector<shared_ptr<Stream> > streams_;
+    // The first stream FIRST_READY tries.
+    int next_stream_;
+    // The number of records of each stream, and what next_weighted_stream
+    // owes it.
+    vector<int64_t> stream_weights_;
+    vector<int64_t> stream_credits_;
 
     friend class DataReader;
 
@@ -66,7 +140,11 @@ class DataReader {
   // A source is uniquely identified by its layer name + path, in case
   // the same database is read from two different locations in the net.
   static inline string source_key(const LayerParameter& param) {
-    return param.name() + ":" + param.data_param().source();
+    string key = param.name() + ":" + param.data_param().source();
+    for (int i = 0; i < param.data_param().shard_size(); ++i) {
+      key += ":" + param.data_param().shard(i);
+    }
+    return key;
   }
 
   const shared_ptr<QueuePair> queue_pair_;
@@ -9,6 +9,8 @@
 
 namespace caffe {
 
+struct DatumRecord;
+
 /**
  * @brief Applies common transformations to the input data, such as
  * scaling, mirroring, substracting the image mean...
@@ -37,6 +39,12 @@ class DataTransformer {
    */
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation to a Datum read by DataReader, taking
+   * its data bytes from where the record points.
+   */
+  void Transform(const DatumRecord& record, Blob<Dtype>* transformed_blob);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -74,6 +82,12 @@ class DataTransformer {
    *    set_cpu_data() is used. See image_data_layer.cpp for an example.
    */
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
+  /**
+   * @brief Decodes the image of an encoded Datum read by DataReader, in color
+   * or gray as transform_param forces, as Transform does before transforming
+   * it.
+   */
+  cv::Mat DecodeImage(const DatumRecord& record);
 #endif  // USE_OPENCV
 
   /**
@@ -97,6 +111,8 @@ class DataTransformer {
    *    Datum containing the data to be transformed.
    */
   vector<int> InferBlobShape(const Datum& datum);
+  /// @brief Infers the shape of a transformed Datum read by DataReader.
+  vector<int> InferBlobShape(const DatumRecord& record);
   /**
    * @brief Infers the shape of transformed_blob will have when
    *    the transformation is applied to the data.
@@ -137,7 +153,15 @@ class DataTransformer {
    */
   virtual int Rand(int n);
 
-  void Transform(const Datum& datum, Dtype* transformed_data);
+  void Transform(const Datum& datum, const char* data, size_t size,
+      Blob<Dtype>* transformed_blob);
+  void Transform(const Datum& datum, const char* data, size_t size,
+      Dtype* transformed_data);
+  vector<int> InferBlobShape(const Datum& datum, const char* data,
+      size_t size);
+#ifdef USE_OPENCV
+  cv::Mat DecodeImage(const char* data, size_t size);
+#endif  // USE_OPENCV
   // Tranformation parameters
   TransformationParameter param_;
 
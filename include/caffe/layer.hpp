@@ -288,6 +288,16 @@ class Layer {
    */
   virtual inline bool AutoTopBlobs() const { return false; }
 
+  /**
+   * @brief Return whether Reshape must run before every Forward.
+   *
+   * Forward skips Reshape when none of the bottom and top blobs has changed
+   * shape (see Blob::shape_version) since the last time it ran. Layers whose
+   * top shapes or internal state depend on more than that, e.g. on the bottom
+   * data, should override this method to return true.
+   */
+  virtual inline bool ReshapeEveryForward() const { return false; }
+
   /**
    * @brief Return whether to allow force_backward for a given bottom blob
    *        index.
@@ -491,9 +501,35 @@ class Layer {
   /** Unlock forward_mutex_ if this layer is shared */
   void Unlock();
 
+  /** The shape versions of the bottom and top blobs at the last Reshape run
+   *  by Forward */
+  vector<uint64_t> reshaped_versions_;
+  /** Whether Forward needs to run Reshape first */
+  bool NeedsReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   DISABLE_COPY_AND_ASSIGN(Layer);
 };  // class Layer
 
+template <typename Dtype>
+bool Layer<Dtype>::NeedsReshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  // Layers without bottoms, like data layers, decide their shapes themselves.
+  if (bottom.empty() || ReshapeEveryForward() ||
+      reshaped_versions_.size() != bottom.size() + top.size()) {
+    return true;
+  }
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (bottom[i]->shape_version() != reshaped_versions_[i]) { return true; }
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    if (top[i]->shape_version() != reshaped_versions_[bottom.size() + i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Forward and backward wrappers. You should implement the cpu and
 // gpu specific implementations instead, and should not change these
 // functions.
@@ -503,7 +539,16 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   // Lock during forward to ensure sequential forward
   Lock();
   Dtype loss = 0;
-  Reshape(bottom, top);
+  if (NeedsReshape(bottom, top)) {
+    Reshape(bottom, top);
+    reshaped_versions_.clear();
+    for (int i = 0; i < bottom.size(); ++i) {
+      reshaped_versions_.push_back(bottom[i]->shape_version());
+    }
+    for (int i = 0; i < top.size(); ++i) {
+      reshaped_versions_.push_back(top[i]->shape_version());
+    }
+  }
   switch (Caffe::mode()) {
   case Caffe::OCL:
     Forward_ocl(bottom, top);
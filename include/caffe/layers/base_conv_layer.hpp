@@ -1,12 +1,14 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/weight_cache.hpp"
 
 namespace caffe {
 
@@ -18,7 +20,7 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), packed_weight_spatial_dim_(-1) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -28,6 +30,13 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
 
+  /// Folds the per-channel affine transforms of these BatchNorm and Scale
+  /// layers, which run in place on this layer's output, into the weights and
+  /// bias of the forward pass. Called by Net::Init; see FuseLayers.
+  void set_folded_layers(const vector<Layer<Dtype>*>& folded_layers) {
+    folded_layers_ = folded_layers;
+  }
+
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
@@ -35,6 +44,18 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  // Adds the bias (if not NULL) and applies a ReLU in one pass over output.
+  void forward_cpu_bias_relu(Dtype* output, const Dtype* bias);
+  // The weights and bias (NULL if none) the forward pass should use: blobs_,
+  // or copies with the folded layers applied, refolded whenever any of
+  // their sources changes.
+  Blob<Dtype>* forward_weight();
+  Blob<Dtype>* forward_bias();
+  // Returns blobs_[0] packed per group for caffe_cpu_packed_gemm, repacking
+  // only if the weights or output size changed since the last call.
+  const Dtype* packed_weights();
+  // Packs the forward weights into packed_weight for the WeightCache.
+  void BuildPackedWeights(Blob<Dtype>* packed_weight);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
@@ -167,6 +188,29 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+  // Weights packed for inference, keyed by the weight memory, its version
+  // and the output spatial size they were packed for, and shared through
+  // the WeightCache with the nets sharing the weights.
+  shared_ptr<Blob<Dtype> > packed_weight_;
+  WeightCache::Sources packed_weight_sources_;
+  int packed_weight_spatial_dim_;
+
+  // The forward weights and bias with the folded layers applied.
+  struct FoldedWeights {
+    Blob<Dtype> weight;
+    Blob<Dtype> bias;
+  };
+  // Points folded_ to the folded weights of the current sources, refolding
+  // them if no net sharing the weights already has.
+  void FoldLayers();
+  // Folds the layers into the weights and bias for the WeightCache.
+  void BuildFoldedWeights(FoldedWeights* folded);
+
+  // Layers folded into the forward weights, the folded copies, and the
+  // memory and version of each parameter they were computed from.
+  vector<Layer<Dtype>*> folded_layers_;
+  shared_ptr<FoldedWeights> folded_;
+  WeightCache::Sources folded_sources_;
 };
 
 }  // namespace caffe
@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <boost/function.hpp>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -9,6 +10,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/task_graph.hpp"
 
 namespace caffe {
 
@@ -67,18 +69,37 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  /// @brief The number of batches prefetched (asynchronously if to GPU
+  ///        memory), set by DataParameter.prefetch.
+  inline int prefetch_count() const { return prefetch_.size(); }
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  /**
+   * @brief Call item(item_id, worker_id) for each item_id in [0, num_items)
+   *        on the DataParameter.decode_threads workers, and return once all
+   *        are done.
+   *
+   * Worker worker_id gets items worker_id, worker_id + the number of workers,
+   * and so on, of every batch, and should transform them with
+   * item_transformers_[worker_id]: as each of those has its own random
+   * generator, the output for a given seed does not depend on scheduling.
+   */
+  void ForEachItem(int num_items,
+      const boost::function<void(int, int)>& item);
+
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
 
   Blob<Dtype> transformed_data_;
+
+  // A transformer per decode worker, the first being data_transformer_.
+  vector<shared_ptr<DataTransformer<Dtype> > > item_transformers_;
+  // The decode workers, if there is more than one.
+  shared_ptr<TaskGraph> decode_workers_;
 };
 
 }  // namespace caffe
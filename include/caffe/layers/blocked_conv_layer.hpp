@@ -0,0 +1,84 @@
+#ifndef CAFFE_BLOCKED_CONV_LAYER_HPP_
+#define CAFFE_BLOCKED_CONV_LAYER_HPP_
+
+#include <utility>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Inference-only 2D convolution producing the channel-blocked
+ *        @f$ N \times \lceil C/c \rceil \times H \times W \times c @f$ layout.
+ *
+ * Instead of im2col + GEMM, each output pixel of a block of c output
+ * channels is accumulated directly from the input, so the innermost loop is
+ * a multiply-add over c contiguous outputs with c contiguous weights. For
+ * c = 8 and 16 a row of four output pixels is accumulated at a time, reusing
+ * each weight load for all four; other block sizes take a plain loop. The
+ * input may be NCHW (the first convolution of a blocked region) or blocked.
+ * Weights keep the usual NCHW shape, so trained models load unchanged, and
+ * are repacked into [c_out blocks][c_in blocks][kh][kw][c_in][c_out] order
+ * when the layer runs.
+ *
+ * Experimental: Net::Init selects this layer for Convolution layers only
+ * when NetParameter.channel_block is set, which it is not by default; see
+ * InsertReorders.
+ */
+template <typename Dtype>
+class BlockedConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit BlockedConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    Forward_cpu(bottom, top);
+  }
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    Backward_cpu(top, propagate_down, bottom);
+  }
+
+  /// The forward weights and bias, packed and padded to whole blocks.
+  struct PackedWeights {
+    Blob<Dtype> weight;
+    Blob<Dtype> bias;
+  };
+  /// Points packed_ to the packed forward weights and bias, repacking them
+  /// if they changed and no net sharing the weights already has.
+  void PackWeights();
+  /// Packs the forward weights and bias for the WeightCache.
+  void BuildPackedWeights(PackedWeights* packed_weights);
+
+  int block_;
+  /// whether the input is blocked (true) or NCHW (false).
+  bool bottom_blocked_;
+  /// channel blocks of the input and output; the input "block" is 1 for NCHW.
+  int bottom_block_, bottom_channel_blocks_, top_channel_blocks_;
+  shared_ptr<PackedWeights> packed_;
+  /// The memory and version of the weights and bias packed.
+  WeightCache::Sources packed_sources_;
+  /// NCHW-shaped views used to reuse the ConvolutionLayer setup; never
+  /// allocated.
+  Blob<Dtype> logical_bottom_, logical_top_;
+  vector<Blob<Dtype>*> logical_bottom_vec_, logical_top_vec_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BLOCKED_CONV_LAYER_HPP_
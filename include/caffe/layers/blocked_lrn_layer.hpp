@@ -0,0 +1,54 @@
+#ifndef CAFFE_BLOCKED_LRN_LAYER_HPP_
+#define CAFFE_BLOCKED_LRN_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/lrn_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Inference-only across-channel LRN over the channel-blocked
+ *        @f$ N \times \lceil C/c \rceil \times H \times W \times c @f$ layout.
+ *
+ * The zero padding channels of the last block act exactly like the implicit
+ * zero padding of LRNLayer at the channel boundary, and stay zero.
+ *
+ * Net::Init selects this layer for LRN layers when
+ * NetParameter.channel_block is set; see InsertReorders.
+ */
+template <typename Dtype>
+class BlockedLRNLayer : public LRNLayer<Dtype> {
+ public:
+  explicit BlockedLRNLayer(const LayerParameter& param)
+      : LRNLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    this->Forward_cpu(bottom, top);
+  }
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    Backward_cpu(top, propagate_down, bottom);
+  }
+
+  virtual void CrossChannelForward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  int block_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BLOCKED_LRN_LAYER_HPP_
@@ -0,0 +1,56 @@
+#ifndef CAFFE_BLOCKED_POOLING_LAYER_HPP_
+#define CAFFE_BLOCKED_POOLING_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/pooling_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Inference-only MAX and AVE pooling over the channel-blocked
+ *        @f$ N \times \lceil C/c \rceil \times H \times W \times c @f$ layout,
+ *        pooling the c channels of a block together.
+ *
+ * Net::Init selects this layer for Pooling layers when
+ * NetParameter.channel_block is set; see InsertReorders.
+ */
+template <typename Dtype>
+class BlockedPoolingLayer : public PoolingLayer<Dtype> {
+ public:
+  explicit BlockedPoolingLayer(const LayerParameter& param)
+      : PoolingLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline int MaxTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    Forward_cpu(bottom, top);
+  }
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    Backward_cpu(top, propagate_down, bottom);
+  }
+
+  int block_;
+  /// NCHW-shaped views used to reuse the PoolingLayer setup; never allocated.
+  Blob<Dtype> logical_bottom_, logical_top_;
+  vector<Blob<Dtype>*> logical_bottom_vec_, logical_top_vec_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BLOCKED_POOLING_LAYER_HPP_
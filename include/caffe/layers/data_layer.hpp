@@ -11,6 +11,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/image_cache.hpp"
 
 namespace caffe {
 
@@ -30,8 +31,21 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  // Decodes and transforms item item_id of the batch on worker worker_id.
+  void load_item(Dtype* top_data, Dtype* top_label, int item_id,
+      int worker_id);
+#ifdef USE_OPENCV
+  // Decodes the image of an encoded record, unless cached.
+  cv::Mat DecodeImage(const DatumRecord& record, int worker_id);
+#endif  // USE_OPENCV
 
   DataReader reader_;
+  // The records of the batch being loaded.
+  vector<DatumRecord*> batch_records_;
+  // Views of the items of the batch being loaded, one per decode worker.
+  vector<shared_ptr<Blob<Dtype> > > item_data_;
+  // Decoded images, if data_param.image_cache_bytes is set.
+  shared_ptr<ImageCache> image_cache_;
 };
 
 }  // namespace caffe
@@ -7,20 +7,33 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 #include "caffe/layers/base_data_layer.hpp"
 
 namespace caffe {
 
+/// @brief A batch of rows of each top of an HDF5DataLayer.
+template <typename Dtype>
+class HDF5Batch {
+ public:
+  vector<shared_ptr<Blob<Dtype> > > blobs_;
+};
+
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
+ * By default each file is loaded whole, in the forward pass. With
+ * hdf5_data_param.prefetch, rows are read a chunk at a time on a background
+ * thread instead, for files too large to fit in memory.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
       : Layer<Dtype>(param) {}
@@ -47,6 +60,10 @@ class HDF5DataLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
   virtual void LoadHDF5FileData(const char* filename);
+  // Reads the batches ahead, if prefetching.
+  virtual void InternalThreadEntry();
+  // Copies the next batch read ahead to top, in CPU or GPU memory.
+  void ForwardPrefetched(const vector<Blob<Dtype>*>& top, bool gpu);
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
@@ -55,6 +72,12 @@ class HDF5DataLayer : public Layer<Dtype> {
   std::vector<shared_ptr<Blob<Dtype> > > hdf_blobs_;
   std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
+
+  vector<shared_ptr<HDF5Batch<Dtype> > > prefetch_;
+  BlockingQueue<HDF5Batch<Dtype>*> prefetch_free_;
+  BlockingQueue<HDF5Batch<Dtype>*> prefetch_full_;
+  // The rows of each top read from the current chunk, on the prefetch thread.
+  vector<shared_ptr<Blob<Dtype> > > prefetch_chunk_;
 };
 
 }  // namespace caffe
@@ -11,6 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
 
 namespace caffe {
 
@@ -36,9 +37,13 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Reads, and resizes, image file line_id, unless cached.
+  cv::Mat ReadImage(int line_id);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // Decoded images, if image_data_param.image_cache_bytes is set.
+  shared_ptr<ImageCache> image_cache_;
 };
 
 
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/weight_cache.hpp"
 
 namespace caffe {
 
@@ -19,7 +20,7 @@ template <typename Dtype>
 class InnerProductLayer : public Layer<Dtype> {
  public:
   explicit InnerProductLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), packed_weight_batch_(-1) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -39,12 +40,27 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// Returns blobs_[0] packed for caffe_cpu_packed_gemm, repacking only if
+  /// the weights or the batch size changed since the last call.
+  const Dtype* packed_weights();
+  /// Packs blobs_[0] into packed_weight for the WeightCache.
+  void BuildPackedWeights(Blob<Dtype>* packed_weight);
+
   int M_;
   int K_;
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// With MKL, in the TEST phase the weights are packed once and reused by
+  /// every forward pass; the packed copy is keyed by the weight memory, its
+  /// version and the batch size it was packed for, and shared through the
+  /// WeightCache with the nets sharing the weights.
+  shared_ptr<Blob<Dtype> > packed_weight_;
+  WeightCache::Sources packed_weight_sources_;
+  int packed_weight_batch_;
+  /// N_ x M_ output of the packed gemm, transposed into the top if M_ > 1.
+  Blob<Dtype> packed_top_;
 };
 
 }  // namespace caffe
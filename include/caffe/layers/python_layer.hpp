@@ -38,6 +38,9 @@ class PythonLayer : public Layer<Dtype> {
     return this->layer_param_.python_param().share_in_parallel();
   }
 
+  /// The Python reshape may depend on anything.
+  virtual inline bool ReshapeEveryForward() const { return true; }
+
   virtual inline const char* type() const { return "Python"; }
 
  protected:
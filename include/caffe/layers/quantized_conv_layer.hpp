@@ -0,0 +1,82 @@
+#ifndef CAFFE_QUANTIZED_CONV_LAYER_HPP_
+#define CAFFE_QUANTIZED_CONV_LAYER_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Inference-only convolution computed in int8 with int32
+ *        accumulation.
+ *
+ * The input is quantized symmetrically with the single scale
+ * 127 / QuantizationParameter.bottom_range, and each output channel of the
+ * weights with its own scale. im2col and the GEMM then run on int8 data, and
+ * one pass over the int32 result dequantizes it, adds the bias and, if
+ * QuantizationParameter.relu is set, applies the ReLU.
+ *
+ * The weights keep their float blobs, so trained models load unchanged; the
+ * int8 copy is made on the first forward pass and redone only when the
+ * weights change. By default the float weights stay in memory next to the
+ * int8 copy, about 1.25x the float size in all: they are what the copy is
+ * redone from, what ToProto and snapshots write without loss, what BatchNorm
+ * and Scale layers are folded into, and they may be shared with another
+ * net. The gain is then in the bandwidth of the forward pass, not in
+ * resident memory. With QuantizationParameter.drop_float_weights set, the
+ * float weights are freed once quantized, leaving the int8 copy alone at a
+ * quarter of the float size, and the net can no longer be saved.
+ *
+ * Selected for Convolution layers with a quantization_param; see
+ * tools/quantize_net.cpp.
+ */
+template <typename Dtype>
+class QuantizedConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit QuantizedConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    Forward_cpu(bottom, top);
+  }
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    Backward_cpu(top, propagate_down, bottom);
+  }
+
+  /// num_output x (channels / group * kernel size) int8 weights and the
+  /// scale of each output channel.
+  struct QuantizedWeights {
+    vector<int8_t> weight;
+    vector<Dtype> scale;
+  };
+  /// Points quantized_ to the quantized forward weights, quantizing them
+  /// unless a net sharing the weights already has.
+  void QuantizeWeights();
+  /// Quantizes the forward weights for the WeightCache.
+  void BuildQuantizedWeights(QuantizedWeights* quantized);
+
+  shared_ptr<QuantizedWeights> quantized_;
+  WeightCache::Sources quantized_sources_;
+  vector<int8_t> quantized_bottom_;
+  vector<int8_t> quantized_col_;
+  vector<int32_t> accumulator_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_QUANTIZED_CONV_LAYER_HPP_
@@ -0,0 +1,69 @@
+#ifndef CAFFE_QUANTIZED_INNER_PRODUCT_LAYER_HPP_
+#define CAFFE_QUANTIZED_INNER_PRODUCT_LAYER_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/inner_product_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Inference-only inner product computed in int8 with int32
+ *        accumulation.
+ *
+ * Quantizes like QuantizedConvolutionLayer: one scale for the input, taken
+ * from QuantizationParameter.bottom_range, and one per output for the
+ * weights. The int32 products are dequantized together with the bias and
+ * the optional fused ReLU. As there, the float weights stay in memory next
+ * to their int8 copy unless QuantizationParameter.drop_float_weights is set.
+ *
+ * Selected for InnerProduct layers with a quantization_param; see
+ * tools/quantize_net.cpp.
+ */
+template <typename Dtype>
+class QuantizedInnerProductLayer : public InnerProductLayer<Dtype> {
+ public:
+  explicit QuantizedInnerProductLayer(const LayerParameter& param)
+      : InnerProductLayer<Dtype>(param) {}
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    Forward_cpu(bottom, top);
+  }
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    Backward_cpu(top, propagate_down, bottom);
+  }
+
+  /// N_ x K_ int8 weights (transposed if needed) and the scale of each
+  /// output.
+  struct QuantizedWeights {
+    vector<int8_t> weight;
+    vector<Dtype> scale;
+  };
+  /// Points quantized_ to the quantized blobs_[0], quantizing it unless a
+  /// net sharing the weights already has.
+  void QuantizeWeights();
+  /// Quantizes blobs_[0] for the WeightCache.
+  void BuildQuantizedWeights(QuantizedWeights* quantized);
+
+  shared_ptr<QuantizedWeights> quantized_;
+  WeightCache::Sources quantized_sources_;
+  vector<int8_t> quantized_bottom_;
+  /// N_ x M_ int32 result.
+  vector<int32_t> accumulator_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_QUANTIZED_INNER_PRODUCT_LAYER_HPP_
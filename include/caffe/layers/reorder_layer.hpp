@@ -0,0 +1,53 @@
+#ifndef CAFFE_REORDER_LAYER_HPP_
+#define CAFFE_REORDER_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Converts between the NCHW layout and the channel-blocked
+ *        @f$ N \times \lceil C/c \rceil \times H \times W \times c @f$
+ *        layout used by the blocked CPU layers.
+ *
+ * The direction is given by the input: a 4-axis bottom is blocked with the
+ * block size c of blocked_layout_param, zero filling the padding channels;
+ * a 5-axis bottom is unblocked back to its logical channel count, taken from
+ * blocked_layout_param.bottom_channels(0). Net::Init inserts these layers
+ * when NetParameter.channel_block is set (see InsertReorders).
+ */
+template <typename Dtype>
+class ReorderLayer : public Layer<Dtype> {
+ public:
+  explicit ReorderLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Reorder"; }
+  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  int block_;
+  /// true when converting NCHW to blocked, false for the reverse.
+  bool to_blocked_;
+  int num_;
+  int channels_;
+  int spatial_dim_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_REORDER_LAYER_HPP_
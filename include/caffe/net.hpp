@@ -14,6 +14,8 @@
 
 namespace caffe {
 
+class TaskGraph;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -83,6 +85,21 @@ class Net {
    */
   void Reshape();
 
+  /// @brief The number of input shapes the net was prepared for at Init (see
+  ///        NetParameter.shape_bucket).
+  inline int num_shape_buckets() const { return shape_buckets_.size(); }
+  /**
+   * @brief Return the smallest shape bucket whose input shapes are at least
+   *        as large as input_shapes in every dimension, or -1 if none is.
+   *
+   * The inputs can be reshaped to input_shapes, or padded to the bucket's
+   * shapes and reshaped with ReshapeToBucket, without any blob reallocating.
+   */
+  int FindShapeBucket(const vector<vector<int> >& input_shapes) const;
+  /// @brief Reshape the inputs to the shapes of a shape bucket, and then all
+  ///        layers.
+  void ReshapeToBucket(const int bucket);
+
   Dtype ForwardBackward() {
     Dtype loss;
     Forward(&loss);
@@ -105,6 +122,23 @@ class Net {
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief Create another instance of this TEST-phase net that shares its
+   *        parameter blobs and owns only its activations.
+   *
+   * The executor is built from the same NetParameter, and its layers take
+   * this net's parameter blobs themselves instead of filling their own, so
+   * N executors hold one copy of the weights. Weights loaded into this net
+   * later are seen by all of them. Each executor may run Forward on its own
+   * thread, concurrently with the others, in CPU mode. Copies derived from
+   * the weights, such as packed, folded or quantized weights, are shared
+   * too, through the WeightCache: the first net to need one builds it and
+   * the others reuse it. With drop_float_weights set, run a forward pass on
+   * this net before creating executors, so that the float weights are
+   * dropped before they can be read concurrently. OCL layers share static
+   * kernels, so OCL forward passes must still be serialized by the caller.
+   */
+  shared_ptr<Net<Dtype> > CreateExecutor() const;
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -130,6 +164,12 @@ class Net {
   inline const vector<shared_ptr<Blob<Dtype> > >& blobs() const {
     return blobs_;
   }
+  /**
+   * @brief returns the bytes of memory currently allocated for the data and
+   *        for the diffs of the blobs (not counting the parameters)
+   */
+  size_t blob_data_bytes() const;
+  size_t blob_diff_bytes() const;
   /// @brief returns the layers
   inline const vector<shared_ptr<Layer<Dtype> > >& layers() const {
     return layers_;
@@ -224,11 +264,20 @@ class Net {
    */
   static void FilterNet(const NetParameter& param,
       NetParameter* param_filtered);
+  /**
+   * @brief Remove the layers that none of the blobs in
+   *        NetParameter.output_blob depends on.
+   */
+  static void PruneNet(const NetParameter& param,
+      NetParameter* param_pruned);
   /// @brief return whether NetState state meets NetStateRule rule
   static bool StateMeetsRule(const NetState& state, const NetStateRule& rule,
       const string& layer_name);
 
  protected:
+  /// @brief Construct an executor of param_source (see CreateExecutor).
+  explicit Net(const Net* param_source);
+
   // Helpers for Init.
   /// @brief Append a new top blob to the net.
   void AppendTop(const NetParameter& param, const int layer_id,
@@ -241,6 +290,21 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /// @brief Let intermediate blobs with disjoint lifetimes share data
+  ///        storage (see NetParameter.share_activations).
+  void ShareActivations();
+  /// @brief Choose the layers whose tops are recomputed in Backward (see
+  ///        NetParameter.recompute_activations).
+  void PlanRecompute();
+  /// @brief Free the data of a recomputed layer's tops.
+  void ReleaseTops(const int layer_id);
+  /// @brief Grow every blob to the largest size it takes over the shape
+  ///        buckets.
+  void PlanShapeBuckets();
+  /// @brief Build forward_graph_ from the blobs each layer reads and writes.
+  void BuildForwardGraph(const int num_threads);
+  /// @brief Run the forward pass of one layer, storing its loss.
+  void ForwardLayer(const int layer_id);
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -258,6 +322,24 @@ class Net {
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
   vector<bool> layer_need_backward_;
+  /// Whether each layer has been fused into a preceding convolution (see
+  /// NetParameter.fuse_layers), in which case it is not run.
+  vector<bool> layer_fused_;
+  /// Whether intermediate blobs share data storage, which rules out Backward.
+  bool activations_shared_;
+  /// Whether each layer's tops are released after the forward pass and
+  /// recomputed in Backward.
+  vector<bool> layer_recompute_;
+  /// For each layer, the recomputed layers whose tops it is the last to read
+  /// in the forward pass, and so the first to need again in Backward.
+  vector<vector<int> > recompute_after_;
+  /// The dependencies between the layers' forward passes, and the threads
+  /// running them, if NetParameter.forward_threads is set.
+  shared_ptr<TaskGraph> forward_graph_;
+  /// The loss of each layer in the last forward pass run on forward_graph_.
+  vector<Dtype> layer_losses_;
+  /// The input shapes of each shape bucket.
+  vector<vector<vector<int> > > shape_buckets_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   vector<string> blob_names_;
@@ -308,6 +390,12 @@ class Net {
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+  /// The net whose parameter blobs this net's layers take at Init, if this
+  /// is an executor created by CreateExecutor.
+  const Net* const param_source_;
+  /// The parameter the net was initialized from, without any weights, to
+  /// create executors from.
+  NetParameter net_param_;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
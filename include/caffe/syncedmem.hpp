@@ -1,6 +1,7 @@
 #ifndef CAFFE_SYNCEDMEM_HPP_
 #define CAFFE_SYNCEDMEM_HPP_
 
+#include <stdint.h>
 #include <cstdlib>
 
 #include "caffe/common.hpp"
@@ -47,15 +48,20 @@ class SyncedMemory {
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), ocl_ptr_(NULL), size_(0),  
         head_(UNINITIALIZED), own_cpu_data_(false), cpu_malloc_use_cuda_(false), 
-        own_gpu_data_(false), gpu_device_(-1) {}
+        own_gpu_data_(false), gpu_device_(-1) { UpdateVersion(); }
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), ocl_ptr_(NULL), size_(size), 
         head_(UNINITIALIZED), own_cpu_data_(false), 
-        cpu_malloc_use_cuda_(false), own_gpu_data_(false), gpu_device_(-1) {}
+        cpu_malloc_use_cuda_(false), own_gpu_data_(false), gpu_device_(-1) {
+    UpdateVersion();
+  }
 
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
+  /// Like set_cpu_data(data), and keeps owner, such as the mapping of a file
+  /// data points into, alive for as long as data is used.
+  void set_cpu_data(void* data, const shared_ptr<void>& owner);
   const void* gpu_data();
   const void* ocl_data();
   void set_gpu_data(void* data);
@@ -66,6 +72,11 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, HEAD_AT_OCL, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  /// Changed whenever the data may have been written through a mutable_*
+  /// or set_* accessor; lets callers cache values derived from the data.
+  /// Versions are unique across all SyncedMemory objects, so memory created
+  /// at the address of a deleted one is never mistaken for it.
+  uint64_t version() const { return version_; }
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
 #endif
@@ -74,6 +85,8 @@ class SyncedMemory {
   void to_cpu();
   void to_gpu();
   void to_ocl(int RW);
+  /// Gives the memory a new version_.
+  void UpdateVersion();
   void* cpu_ptr_;
   void* gpu_ptr_;
   void* ocl_ptr_;
@@ -83,6 +96,8 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int gpu_device_;
+  uint64_t version_;
+  shared_ptr<void> cpu_data_owner_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
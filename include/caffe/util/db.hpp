@@ -2,6 +2,7 @@
 #define CAFFE_UTIL_DB_HPP
 
 #include <string>
+#include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -15,9 +16,16 @@ class Cursor {
   Cursor() { }
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
+  // Moves to the first key not less than key.
+  virtual void Seek(const string& key) = 0;
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  // Points data at the current value instead of copying it. The value stays
+  // there until the cursor moves, or, if stable_values(), for as long as
+  // the cursor exists.
+  virtual void value(const char** data, size_t* size) = 0;
+  virtual bool stable_values() const { return false; }
   virtual bool valid() = 0;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
@@ -41,6 +49,9 @@ class DB {
   virtual void Close() = 0;
   virtual Cursor* NewCursor() = 0;
   virtual Transaction* NewTransaction() = 0;
+  // A line of text that changes whenever the contents of the database do,
+  // as far as the backend can tell without reading them; empty if unknown.
+  virtual string Fingerprint() { return ""; }
 
   DISABLE_COPY_AND_ASSIGN(DB);
 };
@@ -48,6 +59,19 @@ class DB {
 DB* GetDB(DataParameter::DB backend);
 DB* GetDB(const string& backend);
 
+// Gets the keys of db, opened at source, in order, from the index file
+// source + ".keys", scanning db and writing that file if it is missing, or
+// was written for other contents of db, as its Fingerprint tells.
+void GetKeyIndex(const string& source, DB* db, vector<string>* keys);
+
+// Returns the keys starting num_ranges ranges of the keys of cursor's
+// database of about equal size, the first range starting at the first key
+// (given as ""), and sets range_sizes, if given, to the number of keys in
+// each. There are fewer ranges if there are fewer keys, so that none is
+// empty.
+vector<string> SplitKeys(Cursor* cursor, int num_ranges,
+    vector<int>* range_sizes = NULL);
+
 }  // namespace db
 }  // namespace caffe
 
@@ -17,9 +17,14 @@ class LevelDBCursor : public Cursor {
     : iter_(iter) { SeekToFirst(); }
   ~LevelDBCursor() { delete iter_; }
   virtual void SeekToFirst() { iter_->SeekToFirst(); }
+  virtual void Seek(const string& key) { iter_->Seek(key); }
   virtual void Next() { iter_->Next(); }
   virtual string key() { return iter_->key().ToString(); }
   virtual string value() { return iter_->value().ToString(); }
+  virtual void value(const char** data, size_t* size) {
+    *data = iter_->value().data();
+    *size = iter_->value().size();
+  }
   virtual bool valid() { return iter_->Valid(); }
 
  private:
@@ -62,6 +67,9 @@ class LevelDB : public DB {
   virtual LevelDBTransaction* NewTransaction() {
     return new LevelDBTransaction(db_);
   }
+  // A hash of the list of table files, their sizes and key ranges, which
+  // writes change. Compactions change it too.
+  virtual string Fingerprint();
 
  private:
   leveldb::DB* db_;
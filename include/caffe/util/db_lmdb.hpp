@@ -26,6 +26,11 @@ class LMDBCursor : public Cursor {
     mdb_txn_abort(mdb_txn_);
   }
   virtual void SeekToFirst() { Seek(MDB_FIRST); }
+  virtual void Seek(const string& key) {
+    mdb_key_.mv_size = key.size();
+    mdb_key_.mv_data = const_cast<char*>(key.data());
+    Seek(MDB_SET_RANGE);
+  }
   virtual void Next() { Seek(MDB_NEXT); }
   virtual string key() {
     return string(static_cast<const char*>(mdb_key_.mv_data), mdb_key_.mv_size);
@@ -34,6 +39,13 @@ class LMDBCursor : public Cursor {
     return string(static_cast<const char*>(mdb_value_.mv_data),
         mdb_value_.mv_size);
   }
+  virtual void value(const char** data, size_t* size) {
+    *data = static_cast<const char*>(mdb_value_.mv_data);
+    *size = mdb_value_.mv_size;
+  }
+  // Values point into the memory map, which the cursor's read-only
+  // transaction keeps unchanged until it ends.
+  virtual bool stable_values() const { return true; }
   virtual bool valid() { return valid_; }
 
  private:
@@ -83,6 +95,9 @@ class LMDB : public DB {
   }
   virtual LMDBCursor* NewCursor();
   virtual LMDBTransaction* NewTransaction();
+  // The number of entries, and the last transaction, which every commit
+  // advances.
+  virtual string Fingerprint();
 
  private:
   MDB_env* mdb_env_;
@@ -0,0 +1,18 @@
+#ifndef _CAFFE_UTIL_FUSE_LAYERS_HPP_
+#define _CAFFE_UTIL_FUSE_LAYERS_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters marking, for every Convolution computed by the CAFFE
+// engine, the run of in-place BatchNorm and Scale layers and the in-place
+// ReLU that directly follow it as fused into the convolution; see
+// FusionParameter. Only layers that are pure per-channel affine transforms
+// at inference (BatchNorm with global stats, single-bottom Scale over the
+// channel axis) and ReLUs without a negative slope are fused.
+void FuseLayers(const NetParameter& param, NetParameter* param_fused);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FUSE_LAYERS_HPP_
@@ -2,6 +2,7 @@
 #define CAFFE_UTIL_HDF5_H_
 
 #include <string>
+#include <vector>
 
 #include "hdf5.h"
 #include "hdf5_hl.h"
@@ -10,6 +11,11 @@
 
 namespace caffe {
 
+// Verifies the format of a dataset of an HDF5 file and returns its shape,
+// without reading it.
+vector<int> hdf5_get_nd_dataset_shape(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim);
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -20,6 +26,13 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob);
 
+// Reads rows [first_row, first_row + num_rows) of a dataset, along its first
+// axis, into data, which must hold them.
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, hsize_t first_row,
+    hsize_t num_rows, Dtype* data);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
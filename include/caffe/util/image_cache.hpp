@@ -0,0 +1,51 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A cache of decoded images, by key, holding up to a number of bytes
+ *        of pixels and evicting the least recently used images first.
+ *
+ * Data layers keep their images there, decoded and resized, so that only the
+ * first epoch decodes them if they all fit. It can be used from several
+ * threads at once. Images are shared, not copied: those put or returned
+ * must not be written, and those returned stay valid after eviction.
+ */
+class ImageCache {
+ public:
+  explicit ImageCache(size_t capacity);
+
+  // Returns whether key is cached, and its image if so.
+  bool Get(const string& key, cv::Mat* image);
+  // Caches image for key, unless larger than the whole cache.
+  void Put(const string& key, const cv::Mat& image);
+
+  size_t capacity() const { return capacity_; }
+  // The bytes of pixels cached.
+  size_t bytes() const;
+
+ protected:
+  // Defined with the cv::Mat and mutex, which are not included here.
+  struct Entry;
+  class sync;
+
+  const size_t capacity_;
+  size_t bytes_;
+  // Keys, the most recently used first.
+  std::list<string> recent_;
+  map<string, shared_ptr<Entry> > entries_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
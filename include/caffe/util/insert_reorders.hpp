@@ -0,0 +1,26 @@
+#ifndef _CAFFE_UTIL_INSERT_REORDERS_HPP_
+#define _CAFFE_UTIL_INSERT_REORDERS_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters switching every layer that can run on channel-blocked
+// (N x C/c x H x W x c) blobs to the blocked layout, with ReorderLayers added
+// to convert back to NCHW wherever a blocked blob is consumed by a layer that
+// does not support the layout, or is left as a net output.
+// The block size c is taken from param.channel_block().
+void InsertReorders(const NetParameter& param, NetParameter* param_blocked);
+
+void ConfigureReorderLayer(const string& blob_name, const int channels,
+    const int block, LayerParameter* reorder_layer_param);
+
+string ReorderLayerName(const string& blob_name);
+
+string BlockedBlobName(const string& blob_name);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INSERT_REORDERS_HPP_
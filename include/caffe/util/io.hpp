@@ -129,6 +129,36 @@ inline bool ReadImageToDatum(const string& filename, const int label,
 bool DecodeDatumNative(Datum* datum);
 bool DecodeDatum(Datum* datum, bool is_color);
 
+/**
+ * @brief A Datum together with its data bytes, which may be left where the
+ *        Datum was read from rather than copied into its data field.
+ */
+struct DatumRecord {
+  DatumRecord() : data(NULL), size(0), labels(NULL), num_labels(0) {}
+
+  // Identifies the record in its dataset. Set by DataReader.
+  string key;
+  Datum datum;
+  // The data bytes: either datum.data() or, if aliased, in the source.
+  const char* data;
+  size_t size;
+  // The float labels, not necessarily aligned: either datum.labels() or, if
+  // aliased, in the source.
+  const char* labels;
+  int num_labels;
+};
+
+/**
+ * @brief Parse a serialized Datum, or a tensor record (see tensor_record.hpp),
+ *        into record.
+ *
+ * If alias, the data bytes are not copied: record->data points into value,
+ * which must stay in place for as long as the record is used, and
+ * record->datum is left with an empty data field.
+ */
+bool ParseDatumRecord(const char* value, size_t size, bool alias,
+    DatumRecord* record);
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color);
@@ -144,6 +174,9 @@ cv::Mat ReadImageToCVMat(const string& filename);
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
 
+cv::Mat DecodeBytesToCVMatNative(const char* data, size_t size);
+cv::Mat DecodeBytesToCVMat(const char* data, size_t size, bool is_color);
+
 void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
 #endif  // USE_OPENCV
 
@@ -0,0 +1,77 @@
+#ifndef CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+#define CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A private, copy-on-write memory mapping of a whole file.
+ *
+ * Pages are read on first use and shared, through the page cache, with
+ * every other process mapping the file until they are written.
+ *
+ * Pages not yet written still read the file: if it is truncated or written
+ * over in place meanwhile, they see the change, and reading past its new end
+ * raises SIGBUS. Replace mapped files by writing a new file and renaming it
+ * over the old one, which leaves the mapped one intact until unmapped.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const string& filename);
+  ~MappedFile();
+
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  char* data_;
+  size_t size_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedFile);
+};
+
+/// @brief A parameter blob in a binary NetParameter: its BlobProto without
+///        the float data, and where in the file that data lies.
+struct IndexedBlob {
+  BlobProto header;
+  size_t data_offset;
+  size_t data_bytes;
+};
+
+/// @brief The name and parameter blobs of a layer in a binary NetParameter.
+struct IndexedLayer {
+  string name;
+  vector<IndexedBlob> blobs;
+};
+
+/**
+ * @brief Find the parameter blobs of the layers of a binary NetParameter (a
+ *        .caffemodel) without parsing or copying their float data.
+ *
+ * Returns false if the file needs the full parser: if it is malformed, uses
+ * the deprecated V1 layers, or stores the data of some blob unpacked.
+ */
+bool IndexBinaryNetParams(const char* data, size_t size,
+    vector<IndexedLayer>* layers);
+
+/**
+ * @brief Write a NetParameter in the binary format with the float data of
+ *        every blob starting at a 64-byte aligned offset.
+ *
+ * The result is an ordinary .caffemodel, whose weights
+ * Net::CopyTrainedLayersFrom can use in place from a mapping of the file
+ * rather than copy. The padding is held in a field unknown to BlobProto,
+ * which parsers skip. The file is written under a temporary name and renamed
+ * to filename, so nets that map a previous file of that name are unaffected.
+ */
+void WriteNetParamsToAlignedBinaryFile(const NetParameter& param,
+    const string& filename);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
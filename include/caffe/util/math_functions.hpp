@@ -25,6 +25,53 @@ void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
     Dtype* y);
 
+// Packed gemm for a left operand that is reused across many calls, such as
+// layer weights at inference time. caffe_cpu_gemm_pack stores alpha * op(A)
+// once in the layout the gemm kernel reads, in a buffer of
+// caffe_cpu_gemm_pack_size(M, N, K) elements; caffe_cpu_packed_gemm then
+// computes C = packed_A * op(B) + beta * C without repacking A on every call.
+// A packed buffer is only valid for the M, N and K it was packed with.
+// With MKL this is MKL's packed gemm; otherwise A is stored as panels of rows
+// that a portable kernel streams through once per call.
+template <typename Dtype>
+int caffe_cpu_gemm_pack_size(const int M, const int N, const int K);
+
+template <typename Dtype>
+void caffe_cpu_gemm_pack(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const int K, const Dtype alpha, const Dtype* A,
+    Dtype* packed_A);
+
+template <typename Dtype>
+void caffe_cpu_packed_gemm(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype* packed_A, const Dtype* B,
+    const Dtype beta, Dtype* C);
+
+// Integer gemm for int8 inference: C = A * op(B), where A is M x K, op(B) is
+// K x N and the products are accumulated exactly in int32. Inputs quantized
+// to [-127, 127] keep every partial sum of up to 2^17 products in range.
+// With SSE2 it computes blocks of C in registers with pairwise int16
+// multiply-adds, and large products are split by rows across threads.
+void caffe_cpu_gemm_s8s32(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const int8_t* A, const int8_t* B, int32_t* C);
+
+// Limits the threads caffe_cpu_gemm_s8s32 uses when called from this thread,
+// as mkl_set_num_threads_local does for MKL; 0, the default, means one per
+// core.
+void caffe_set_gemm_s8s32_threads(const int num_threads);
+
+// Symmetric int8 quantization: y = round(scale * x), saturated to
+// [-127, 127].
+template <typename Dtype>
+void caffe_cpu_quantize(const int N, const Dtype scale, const Dtype* x,
+    int8_t* y);
+
+// Quantizes each of the M rows of op(A), an M x K matrix, with its own scale
+// 127 / max|row| (1 for an all-zero row), so that per-output-channel weights
+// keep their full precision. Writes the M x K int8 matrix and the M scales.
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const CBLAS_TRANSPOSE TransA, const int M,
+    const int K, const Dtype* A, int8_t* A_quantized, Dtype* scales);
+
 template <typename Dtype>
 void caffe_axpy(const int N, const Dtype alpha, const Dtype* X,
     Dtype* Y);
@@ -105,6 +152,10 @@ Dtype caffe_cpu_strided_dot(const int n, const Dtype* x, const int incx,
 template <typename Dtype>
 Dtype caffe_cpu_asum(const int n, const Dtype* x);
 
+// Returns the largest absolute value of the elements of vector x
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x);
+
 // the branchless, type-safe version from
 // http://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
 template<typename Dtype>
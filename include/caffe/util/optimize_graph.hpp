@@ -0,0 +1,20 @@
+#ifndef _CAFFE_UTIL_OPTIMIZE_GRAPH_HPP_
+#define _CAFFE_UTIL_OPTIMIZE_GRAPH_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters simplifying them for inference: layers that only copy
+// their bottom (Dropout, Split, Power with unit scale and power and no
+// shift) are removed, their readers reading the bottom instead, and layers
+// that can overwrite their bottom are made in place where nothing else reads
+// it later. Blobs are only renamed where the rest of the net cannot tell:
+// net outputs, blobs in output_blob, and blobs filled outside the forward
+// pass or sharing their data with another blob keep their values and names.
+// Each change is logged.
+void OptimizeGraph(const NetParameter& param, NetParameter* param_optimized);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_OPTIMIZE_GRAPH_HPP_
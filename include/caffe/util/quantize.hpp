@@ -0,0 +1,23 @@
+#ifndef _CAFFE_UTIL_QUANTIZE_HPP_
+#define _CAFFE_UTIL_QUANTIZE_HPP_
+
+#include <map>
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters giving every Convolution and InnerProduct layer listed
+// in bottom_ranges a QuantizationParameter with that calibrated input range,
+// so that it runs in int8. An in-place ReLU (with negative_slope 0) directly
+// following a quantized layer is removed and applied by that layer instead.
+void QuantizeNet(const NetParameter& param,
+    const map<string, float>& bottom_ranges, NetParameter* param_quantized);
+
+// Whether QuantizeNet can quantize a layer of this type and engine.
+bool CanQuantizeLayer(const LayerParameter& layer_param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_HPP_
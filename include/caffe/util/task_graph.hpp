@@ -0,0 +1,73 @@
+#ifndef CAFFE_UTIL_TASK_GRAPH_HPP_
+#define CAFFE_UTIL_TASK_GRAPH_HPP_
+
+#include <boost/function.hpp>
+#include <deque>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief Runs the tasks of a fixed dependency graph on a pool of worker
+ *        threads, starting each task as soon as the tasks it depends on are
+ *        done.
+ *
+ * Tasks are numbered 0 to num_tasks - 1 and may only depend on tasks with
+ * lower numbers, so running them in order is always a valid schedule. The
+ * workers are started once, with Caffe's thread local state copied from the
+ * constructing thread, and are reused by every Run.
+ */
+class TaskGraph {
+ public:
+  TaskGraph(int num_tasks, int num_threads);
+  ~TaskGraph();
+
+  /// @brief Make task to wait for task from, which must be numbered lower.
+  void AddDependency(int from, int to);
+
+  /**
+   * @brief Run the tasks first to last (inclusive) with the given function
+   *        and return once they are all done.
+   *
+   * Dependencies on tasks outside that range are ignored.
+   */
+  void Run(int first, int last, const boost::function<void(int)>& task);
+
+  inline int num_tasks() const { return dependents_.size(); }
+  inline int num_threads() const { return threads_.size(); }
+
+ protected:
+  void WorkerEntry(Caffe::Brew mode, int rand_seed, int solver_count,
+      bool root_solver, int blas_threads);
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  vector<vector<int> > dependents_;
+  vector<shared_ptr<boost::thread> > threads_;
+  shared_ptr<sync> sync_;
+  // The state of the current Run, guarded by sync_.
+  boost::function<void(int)> task_;
+  int last_;
+  vector<int> pending_;
+  std::deque<int> ready_;
+  int remaining_;
+  bool stopping_;
+
+  DISABLE_COPY_AND_ASSIGN(TaskGraph);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TASK_GRAPH_HPP_
@@ -0,0 +1,67 @@
+#ifndef CAFFE_UTIL_TENSOR_RECORD_HPP_
+#define CAFFE_UTIL_TENSOR_RECORD_HPP_
+
+#include <stdint.h>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+struct DatumRecord;
+
+/**
+ * @brief A database value holding a Datum as a fixed header followed by its
+ *        labels and data bytes, read without a protobuf parse.
+ *
+ * The layout, little-endian like the host it is read on:
+ *
+ *   TensorRecordHeader   32 bytes
+ *   int32 labels         num_labels of them: the Datum label, if any
+ *   float labels         num_float_labels of them: the Datum labels
+ *   payload              payload_bytes: uint8 or float32 values in
+ *                        channels x height x width order, or an encoded image
+ *
+ * The magic starts with a byte that no serialized Datum starts with, so both
+ * kinds of values can be told apart, and mixed, in one database.
+ */
+struct TensorRecordHeader {
+  char magic[4];
+  uint8_t version;
+  // A TensorRecordType.
+  uint8_t type;
+  uint16_t num_labels;
+  int32_t channels;
+  int32_t height;
+  int32_t width;
+  uint32_t num_float_labels;
+  uint64_t payload_bytes;
+};
+
+enum TensorRecordType {
+  TENSOR_RECORD_UINT8 = 0,
+  TENSOR_RECORD_FLOAT = 1,
+  TENSOR_RECORD_ENCODED = 2
+};
+
+// Whether value starts like a tensor record rather than a Datum.
+bool IsTensorRecord(const char* value, size_t size);
+
+// Write datum as a tensor record.
+void DatumToTensorRecord(const Datum& datum, string* value);
+
+/**
+ * @brief Parse a tensor record into record, as ParseDatumRecord parses a
+ *        serialized Datum.
+ *
+ * If alias, uint8 and encoded data bytes and float labels are not copied:
+ * record->data and record->labels point into value. Float data is copied
+ * into record->datum.float_data.
+ */
+bool ParseTensorRecord(const char* value, size_t size, bool alias,
+    DatumRecord* record);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TENSOR_RECORD_HPP_
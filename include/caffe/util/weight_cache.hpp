@@ -0,0 +1,74 @@
+#ifndef CAFFE_UTIL_WEIGHT_CACHE_HPP_
+#define CAFFE_UTIL_WEIGHT_CACHE_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Process-wide cache of what layers derive from their weights for
+ *        inference, such as packed, folded or quantized copies.
+ *
+ * Nets sharing their weights, like the executors of Net::CreateExecutor,
+ * then also share one copy of each derived form. An entry is keyed by the
+ * memory and version of every blob it was derived from, which are unique
+ * across all SyncedMemory, and by a description of how it was derived, and
+ * lives for as long as some layer holds it.
+ */
+class WeightCache {
+ public:
+  /// The memory and version of each blob an entry is derived from.
+  typedef vector<std::pair<const SyncedMemory*, uint64_t> > Sources;
+
+  /**
+   * @brief Returns the entry derived as kind from sources, first building it
+   *        with (builder->*build)(entry) if no layer holds one.
+   *
+   * Lookups and builds are serialized, so an entry wanted by several
+   * threads at once is built only once. build may itself call Get.
+   */
+  template <typename T, typename Builder, typename Derived>
+  static shared_ptr<T> Get(const string& kind, const Sources& sources,
+      Derived* builder, void (Builder::*build)(T*)) {
+    Lock lock;
+    shared_ptr<T> entry = boost::static_pointer_cast<T>(Find(kind, sources));
+    if (!entry) {
+      entry.reset(new T());
+      (builder->*build)(entry.get());
+      Add(kind, sources, entry);
+    }
+    return entry;
+  }
+
+  /// @brief Makes entry the one derived as kind from sources as well.
+  static void Alias(const string& kind, const Sources& sources,
+      const shared_ptr<void>& entry);
+
+  /// @brief The number of entries that some layer still holds.
+  static int size();
+
+ private:
+  /// Holds the cache's lock, which a thread may take more than once.
+  class Lock {
+   public:
+    Lock();
+    ~Lock();
+
+   private:
+    DISABLE_COPY_AND_ASSIGN(Lock);
+  };
+
+  static shared_ptr<void> Find(const string& kind, const Sources& sources);
+  static void Add(const string& kind, const Sources& sources,
+      const shared_ptr<void>& entry);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WEIGHT_CACHE_HPP_
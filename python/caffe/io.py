@@ -66,7 +66,8 @@ def blobprotovector_str_to_arraylist(str):
 def array_to_datum(arr, label=None):
     """Converts a 3-dimensional array to datum. If the array has dtype uint8,
     the output data will be encoded as a string. Otherwise, the output data
-    will be stored in float format.
+    will be stored in float format. A sequence of labels is stored as the
+    labels of the datum, for DataLayer with data_param.label_size set.
     """
     if arr.ndim != 3:
         raise ValueError('Incorrect array shape.')
@@ -77,7 +78,10 @@ def array_to_datum(arr, label=None):
     else:
         datum.float_data.extend(arr.flat)
     if label is not None:
-        datum.label = label
+        if np.isscalar(label):
+            datum.label = label
+        else:
+            datum.labels.extend(label)
     return datum
 
 
@@ -54,3 +54,9 @@ class TestArrayToDatum(unittest.TestCase):
         self.assertGreater(
             len(d1.SerializeToString()),
             len(d2.SerializeToString()))
+
+    def test_labels(self):
+        d = caffe.io.array_to_datum(
+            np.ones((10,10,3)), label=[0, 1, 0.5])
+        self.assertFalse(d.HasField('label'))
+        self.assertEqual(list(d.labels), [0, 1, 0.5])
@@ -19,9 +19,22 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
   Reshape(shape);
 }
 
+// The shape versions handed out so far, shared by all blobs so that a blob
+// created at the address of a deleted one cannot be mistaken for it. Taken
+// with an atomic increment, like the versions of SyncedMemory.
+static uint64_t last_shape_version = 0;
+
+template <typename Dtype>
+void Blob<Dtype>::UpdateShapeVersion() {
+  shape_version_ = __sync_add_and_fetch(&last_shape_version, 1);
+}
+
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const vector<int>& shape) {
   CHECK_LE(shape.size(), kMaxBlobAxes);
+  if (shape_version_ == 0 || shape != shape_) {
+    UpdateShapeVersion();
+  }
   count_ = 1;
   shape_.resize(shape.size());
   if (!shape_data_ || shape_data_->size() < shape.size() * sizeof(int)) {
@@ -40,8 +53,20 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
   if (count_ > capacity_) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    if (!forward_only_) {
+      diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    } else {
+      diff_.reset();
+    }
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::EnsureDiff() const {
+  if (!diff_ && forward_only_) {
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
   }
+  CHECK(diff_) << "Blob has no diff; reshape it first.";
 }
 
 template <typename Dtype>
@@ -63,14 +88,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), forward_only_(false), shape_version_(0) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), forward_only_(false), shape_version_(0) {
   Reshape(shape);
 }
 
@@ -106,19 +131,19 @@ const Dtype* Blob<Dtype>::ocl_data() const {
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
-  CHECK(diff_);
+  EnsureDiff();
   return (const Dtype*)diff_->cpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_diff() const {
-  CHECK(diff_);
+  EnsureDiff();
   return (const Dtype*)diff_->gpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::ocl_diff() const {
-  CHECK(diff_);
+  EnsureDiff();
   return (const Dtype*)diff_->ocl_data();
 }
 
@@ -148,32 +173,60 @@ Dtype* Blob<Dtype>::mutable_ocl_data(int RW) {
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff() {
-  CHECK(diff_);
+  EnsureDiff();
   return static_cast<Dtype*>(diff_->mutable_cpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_diff() {
-  CHECK(diff_);
+  EnsureDiff();
   return static_cast<Dtype*>(diff_->mutable_gpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_diff() {
-  CHECK(diff_);
+  EnsureDiff();
   return static_cast<Dtype*>(diff_->mutable_ocl_data());
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
-  data_ = other.data();
+  if (data_ != other.data()) {
+    data_ = other.data();
+    UpdateShapeVersion();
+  }
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
-  diff_ = other.diff();
+  if (!forward_only_ && other.diff_ && diff_ != other.diff_) {
+    diff_ = other.diff_;
+    UpdateShapeVersion();
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_forward_only(bool forward_only) {
+  forward_only_ = forward_only;
+  if (forward_only_ && diff_) {
+    diff_.reset();
+    UpdateShapeVersion();
+  } else if (!forward_only_ && !diff_ && capacity_ > 0) {
+    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    UpdateShapeVersion();
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_data(const shared_ptr<SyncedMemory>& data) {
+  CHECK(data);
+  CHECK_GE(data->size(), capacity_ * sizeof(Dtype));
+  if (data_ != data) {
+    data_ = data;
+    UpdateShapeVersion();
+  }
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -184,6 +237,7 @@ template <> void Blob<int>::Update() { NOT_IMPLEMENTED; }
 
 template <typename Dtype>
 void Blob<Dtype>::Update() {
+  EnsureDiff();
   // We will perform update based on where the data is located.
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
@@ -453,8 +507,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
-      caffe_copy(count_, source.gpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_gpu_data()));
+      caffe_copy(count_, source.gpu_diff(), mutable_gpu_diff());
     } else {
       caffe_copy(count_, source.gpu_data(),
           static_cast<Dtype*>(data_->mutable_gpu_data()));
@@ -463,8 +516,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
   case Caffe::OCL:
   case Caffe::CPU:
     if (copy_diff) {
-      caffe_copy(count_, source.cpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_cpu_data()));
+      caffe_copy(count_, source.cpu_diff(), mutable_cpu_diff());
     } else {
       caffe_copy(count_, source.cpu_data(),
           static_cast<Dtype*>(data_->mutable_cpu_data()));
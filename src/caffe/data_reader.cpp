@@ -1,12 +1,15 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
@@ -44,25 +47,125 @@ DataReader::~DataReader() {
 DataReader::QueuePair::QueuePair(int size) {
   // Initialize the free queue with requested number of datums
   for (int i = 0; i < size; ++i) {
-    free_.push(new Datum());
+    free_.push(new DatumRecord());
   }
 }
 
 DataReader::QueuePair::~QueuePair() {
-  Datum* datum;
-  while (free_.try_pop(&datum)) {
-    delete datum;
+  DatumRecord* record;
+  while (free_.try_pop(&record)) {
+    delete record;
   }
-  while (full_.try_pop(&datum)) {
-    delete datum;
+  while (full_.try_pop(&record)) {
+    delete record;
   }
 }
 
 //
 
+DataReader::Stream::Stream(const DataParameter& param, const string& source,
+    const shared_ptr<db::DB>& db, const string& begin_key,
+    const string& end_key, int queue_size, const vector<string>& keys)
+    : param_(param), source_(source), db_(db), cursor_(db->NewCursor()),
+      begin_key_(begin_key), end_key_(end_key), keys_(keys) {
+  for (int i = 0; i < queue_size; ++i) {
+    values_.push_back(shared_ptr<Value>(new Value()));
+    free_.push(values_.back().get());
+  }
+  StartInternalThread();
+}
+
+DataReader::Stream::~Stream() {
+  StopInternalThread();
+}
+
+void DataReader::Stream::seek(db::Cursor* cursor) {
+  if (begin_key_.empty()) {
+    cursor->SeekToFirst();
+  } else {
+    cursor->Seek(begin_key_);
+  }
+}
+
+void DataReader::Stream::InternalThreadEntry() {
+  db::Cursor* cursor = cursor_.get();
+  try {
+    if (!keys_.empty()) {
+      read_shuffled(cursor);
+      return;
+    }
+    seek(cursor);
+    while (!must_stop()) {
+      if (!cursor->valid() ||
+          (!end_key_.empty() && cursor->key() >= end_key_)) {
+        DLOG(INFO) << "Restarting data prefetching from start of range.";
+        seek(cursor);
+        CHECK(cursor->valid() &&
+            (end_key_.empty() || cursor->key() < end_key_))
+            << "Empty key range of " << source_;
+      }
+      Value* value = free_.pop();
+      read(cursor, value);
+      full_.push(value);
+      cursor->Next();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+void DataReader::Stream::read(db::Cursor* cursor, Value* value) {
+  // Keys of different shards may be the same.
+  value->key = param_.shard_size() > 1 ? source_ + ":" + cursor->key()
+      : cursor->key();
+  cursor->value(&value->data, &value->size);
+  value->stable = cursor->stable_values();
+  if (!value->stable) {
+    value->copy.assign(value->data, value->size);
+    value->data = value->copy.data();
+  }
+}
+
+void DataReader::Stream::read_shuffled(db::Cursor* cursor) {
+  const int num_keys = keys_.size();
+  const int read_ahead = std::min<int>(std::max<int>(param_.read_ahead(), 1),
+      values_.size());
+  vector<int> order(num_keys);
+  for (int i = 0; i < num_keys; ++i) {
+    order[i] = i;
+  }
+  while (!must_stop()) {
+    shuffle(order.begin(), order.end(), caffe_rng());
+    for (int begin = 0; begin < num_keys; begin += read_ahead) {
+      const int end = std::min(begin + read_ahead, num_keys);
+      // Read the records of the window in key order, which keys_ is in,
+      // then queue them in the random order.
+      vector<std::pair<int, int> > by_key;
+      for (int i = begin; i < end; ++i) {
+        by_key.push_back(std::make_pair(order[i], i - begin));
+      }
+      std::sort(by_key.begin(), by_key.end());
+      vector<Value*> window(end - begin);
+      for (int i = 0; i < by_key.size(); ++i) {
+        const string& key = keys_[by_key[i].first];
+        cursor->Seek(key);
+        CHECK(cursor->valid() && cursor->key() == key) << "Key " << key
+            << " not found in " << source_ << "; it was changed while read";
+        Value* value = free_.pop();
+        read(cursor, value);
+        window[by_key[i].second] = value;
+      }
+      for (int i = 0; i < window.size(); ++i) {
+        full_.push(window[i]);
+      }
+    }
+  }
+}
+
 DataReader::Body::Body(const LayerParameter& param)
     : param_(param),
-      new_queue_pairs_() {
+      new_queue_pairs_(),
+      next_stream_(0) {
   StartInternalThread();
 }
 
@@ -70,12 +173,69 @@ DataReader::Body::~Body() {
   StopInternalThread();
 }
 
+void DataReader::Body::open() {
+  const DataParameter& data_param = param_.data_param();
+  vector<string> sources(data_param.shard().begin(),
+      data_param.shard().end());
+  if (sources.empty()) {
+    sources.push_back(data_param.source());
+  }
+  const int reader_threads = data_param.reader_threads();
+  CHECK_GT(reader_threads, 0) << "Read on at least one thread.";
+  if (sources.size() == 1 && reader_threads == 1 && !data_param.shuffle()) {
+    db_.reset(db::GetDB(data_param.backend()));
+    db_->Open(sources[0], db::READ);
+    cursor_.reset(db_->NewCursor());
+    return;
+  }
+  int queue_size = std::max<int>(data_param.batch_size(), 1);
+  if (data_param.shuffle()) {
+    // A stream holds the records it reads ahead until it queues them.
+    queue_size = std::max<int>(queue_size, data_param.read_ahead());
+  }
+  for (int i = 0; i < sources.size(); ++i) {
+    shared_ptr<db::DB> db(db::GetDB(data_param.backend()));
+    db->Open(sources[i], db::READ);
+    if (data_param.shuffle()) {
+      // Each thread shuffles its own range of the keys.
+      vector<string> keys;
+      db::GetKeyIndex(sources[i], db.get(), &keys);
+      CHECK(!keys.empty()) << "Empty database " << sources[i];
+      const int num_keys = keys.size();
+      for (int j = 0; j < reader_threads && j < num_keys; ++j) {
+        vector<string> range(
+            keys.begin() + static_cast<int64_t>(j) * num_keys / reader_threads,
+            keys.begin() +
+            static_cast<int64_t>(j + 1) * num_keys / reader_threads);
+        streams_.push_back(shared_ptr<Stream>(new Stream(data_param,
+            sources[i], db, "", "", queue_size, range)));
+        stream_weights_.push_back(range.size());
+      }
+      continue;
+    }
+    vector<string> begin_keys;
+    vector<int> range_sizes;
+    {
+      shared_ptr<db::Cursor> cursor(db->NewCursor());
+      begin_keys = db::SplitKeys(cursor.get(), reader_threads,
+          &range_sizes);
+    }
+    for (int j = 0; j < begin_keys.size(); ++j) {
+      const string end_key = j + 1 < begin_keys.size() ? begin_keys[j + 1] : "";
+      streams_.push_back(shared_ptr<Stream>(new Stream(data_param,
+          sources[i], db, begin_keys[j], end_key, queue_size)));
+      stream_weights_.push_back(range_sizes[j]);
+    }
+  }
+  stream_credits_.resize(streams_.size(), 0);
+  LOG(INFO) << "Reading " << sources.size() << " database(s) on "
+      << streams_.size() << " threads.";
+}
+
 void DataReader::Body::InternalThreadEntry() {
-  shared_ptr<db::DB> db(db::GetDB(param_.data_param().backend()));
-  db->Open(param_.data_param().source(), db::READ);
-  shared_ptr<db::Cursor> cursor(db->NewCursor());
   vector<shared_ptr<QueuePair> > qps;
   try {
+    open();
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
 
     // To ensure deterministic runs, only start running once all solvers
@@ -83,13 +243,13 @@ void DataReader::Body::InternalThreadEntry() {
     // so read one item, then wait for the next solver.
     for (int i = 0; i < solver_count; ++i) {
       shared_ptr<QueuePair> qp(new_queue_pairs_.pop());
-      read_one(cursor.get(), qp.get());
+      read_one(qp.get());
       qps.push_back(qp);
     }
     // Main loop
     while (!must_stop()) {
       for (int i = 0; i < solver_count; ++i) {
-        read_one(cursor.get(), qps[i].get());
+        read_one(qps[i].get());
       }
       // Check no additional readers have been created. This can happen if
       // more than one net is trained at a time per process, whether single
@@ -102,18 +262,68 @@ void DataReader::Body::InternalThreadEntry() {
   }
 }
 
-void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
-  Datum* datum = qp->free_.pop();
-  // TODO deserialize in-place instead of copy?
-  datum->ParseFromString(cursor->value());
-  qp->full_.push(datum);
+void DataReader::Body::read_one(QueuePair* qp) {
+  DatumRecord* record = qp->free_.pop();
+  if (cursor_) {
+    // Parse the value where the cursor keeps it, and leave the data bytes
+    // there if they stay in place until the cursor is destroyed.
+    const char* value;
+    size_t size;
+    cursor_->value(&value, &size);
+    record->key = cursor_->key();
+    CHECK(ParseDatumRecord(value, size, cursor_->stable_values(), record))
+        << "Cannot parse datum " << record->key;
 
-  // go to the next iter
-  cursor->Next();
-  if (!cursor->valid()) {
-    DLOG(INFO) << "Restarting data prefetching from start.";
-    cursor->SeekToFirst();
+    // go to the next iter
+    cursor_->Next();
+    if (!cursor_->valid()) {
+      DLOG(INFO) << "Restarting data prefetching from start.";
+      cursor_->SeekToFirst();
+    }
+  } else {
+    const int num_streams = streams_.size();
+    Stream::Value* value = NULL;
+    int stream_id;
+    if (param_.data_param().interleave() ==
+        DataParameter_Interleave_FIRST_READY) {
+      for (int i = 0; i < num_streams && !value; ++i) {
+        stream_id = (next_stream_ + i) % num_streams;
+        streams_[stream_id]->full_.try_pop(&value);
+      }
+      if (!value) {
+        stream_id = next_stream_;
+      }
+      next_stream_ = (stream_id + 1) % num_streams;
+    } else {
+      stream_id = next_weighted_stream();
+    }
+    if (!value) {
+      value = streams_[stream_id]->full_.pop();
+    }
+    record->key = value->key;
+    CHECK(ParseDatumRecord(value->data, value->size, value->stable, record))
+        << "Cannot parse datum " << record->key;
+    streams_[stream_id]->free_.push(value);
+  }
+  qp->full_.push(record);
+}
+
+int DataReader::Body::next_weighted_stream() {
+  // Smooth weighted round robin: every stream earns its weight, and the one
+  // with the most, the first of equals, is picked and pays the total back.
+  // Over the total weight of picks, each stream comes as often as its weight
+  // says, spread out rather than in runs.
+  int64_t total_weight = 0;
+  int stream_id = 0;
+  for (int i = 0; i < streams_.size(); ++i) {
+    stream_credits_[i] += stream_weights_[i];
+    total_weight += stream_weights_[i];
+    if (stream_credits_[i] > stream_credits_[stream_id]) {
+      stream_id = i;
+    }
   }
+  stream_credits_[stream_id] -= total_weight;
+  return stream_id;
 }
 
 }  // namespace caffe
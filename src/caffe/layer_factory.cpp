@@ -7,9 +7,15 @@
 
 #include "caffe/layer.hpp"
 #include "caffe/layer_factory.hpp"
+#include "caffe/layers/blocked_conv_layer.hpp"
+#include "caffe/layers/blocked_lrn_layer.hpp"
+#include "caffe/layers/blocked_pooling_layer.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/layers/quantized_conv_layer.hpp"
+#include "caffe/layers/quantized_inner_product_layer.hpp"
 #include "caffe/layers/relu_layer.hpp"
 #include "caffe/layers/sigmoid_layer.hpp"
 #include "caffe/layers/softmax_layer.hpp"
@@ -64,6 +70,14 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
 #endif
   }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
+    if (param.has_blocked_layout_param()) {
+      return shared_ptr<Layer<Dtype> >(
+          new BlockedConvolutionLayer<Dtype>(param));
+    }
+    if (param.has_quantization_param()) {
+      return shared_ptr<Layer<Dtype> >(
+          new QuantizedConvolutionLayer<Dtype>(param));
+    }
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
@@ -82,6 +96,18 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
 
 REGISTER_LAYER_CREATOR(Convolution, GetConvolutionLayer);
 
+// Get inner product layer: int8 if quantized, float otherwise.
+template <typename Dtype>
+shared_ptr<Layer<Dtype> > GetInnerProductLayer(const LayerParameter& param) {
+  if (param.has_quantization_param()) {
+    return shared_ptr<Layer<Dtype> >(
+        new QuantizedInnerProductLayer<Dtype>(param));
+  }
+  return shared_ptr<Layer<Dtype> >(new InnerProductLayer<Dtype>(param));
+}
+
+REGISTER_LAYER_CREATOR(InnerProduct, GetInnerProductLayer);
+
 // Get pooling layer according to engine.
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetPoolingLayer(const LayerParameter& param) {
@@ -93,6 +119,9 @@ shared_ptr<Layer<Dtype> > GetPoolingLayer(const LayerParameter& param) {
 #endif
   }
   if (engine == PoolingParameter_Engine_CAFFE) {
+    if (param.has_blocked_layout_param()) {
+      return shared_ptr<Layer<Dtype> >(new BlockedPoolingLayer<Dtype>(param));
+    }
     return shared_ptr<Layer<Dtype> >(new PoolingLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == PoolingParameter_Engine_CUDNN) {
@@ -142,6 +171,9 @@ shared_ptr<Layer<Dtype> > GetLRNLayer(const LayerParameter& param) {
   }
 
   if (engine == LRNParameter_Engine_CAFFE) {
+    if (param.has_blocked_layout_param()) {
+      return shared_ptr<Layer<Dtype> >(new BlockedLRNLayer<Dtype>(param));
+    }
     return shared_ptr<Layer<Dtype> >(new LRNLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == LRNParameter_Engine_CUDNN) {
@@ -1,4 +1,8 @@
 #include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -263,6 +267,21 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     }
     col_buff = col_buffer_.cpu_data();
   }
+#ifdef USE_MKL
+  // At inference the weights are constant, so pack them once instead of
+  // letting every gemm call repack them.
+  if (this->phase_ == TEST && weights == forward_weight()->cpu_data()) {
+    const Dtype* packed_weight = packed_weights();
+    const int packed_offset = packed_weight_->count() / group_;
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_packed_gemm<Dtype>(CblasNoTrans, conv_out_channels_ / group_,
+          conv_out_spatial_dim_, kernel_dim_,
+          packed_weight + packed_offset * g, col_buff + col_offset_ * g,
+          (Dtype)0., output + output_offset_ * g);
+    }
+    return;
+  }
+#endif
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
         group_, conv_out_spatial_dim_, kernel_dim_,
@@ -271,6 +290,40 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+const Dtype* BaseConvolutionLayer<Dtype>::packed_weights() {
+  const SyncedMemory* source = forward_weight()->data().get();
+  const WeightCache::Sources sources(1,
+      std::make_pair(source, source->version()));
+  if (!packed_weight_ || sources != packed_weight_sources_ ||
+      conv_out_spatial_dim_ != packed_weight_spatial_dim_) {
+    std::ostringstream kind;
+    kind << "Convolution packed " << group_ << "x" << conv_out_channels_
+        << "x" << conv_out_spatial_dim_ << "x" << kernel_dim_;
+    packed_weight_ = WeightCache::Get(kind.str(), sources, this,
+        &BaseConvolutionLayer<Dtype>::BuildPackedWeights);
+    packed_weight_sources_ = sources;
+    packed_weight_spatial_dim_ = conv_out_spatial_dim_;
+  }
+  return packed_weight_->cpu_data();
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::BuildPackedWeights(
+    Blob<Dtype>* packed_weight) {
+  const int M = conv_out_channels_ / group_;
+  const int packed_offset = caffe_cpu_gemm_pack_size<Dtype>(M,
+      conv_out_spatial_dim_, kernel_dim_);
+  packed_weight->Reshape(vector<int>(1, packed_offset * group_));
+  const Dtype* weights = forward_weight()->cpu_data();
+  Dtype* packed = packed_weight->mutable_cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_pack<Dtype>(CblasNoTrans, M, conv_out_spatial_dim_,
+        kernel_dim_, (Dtype)1., weights + weight_offset_ * g,
+        packed + packed_offset * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -279,6 +332,119 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
       (Dtype)1., output);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_bias_relu(Dtype* output,
+    const Dtype* bias) {
+  for (int c = 0; c < num_output_; ++c) {
+    const Dtype shift = bias ? bias[c] : Dtype(0);
+    Dtype* output_c = output + c * out_spatial_dim_;
+    for (int i = 0; i < out_spatial_dim_; ++i) {
+      output_c[i] = std::max(output_c[i] + shift, Dtype(0));
+    }
+  }
+}
+
+template <typename Dtype>
+Blob<Dtype>* BaseConvolutionLayer<Dtype>::forward_weight() {
+  if (folded_layers_.empty()) {
+    return this->blobs_[0].get();
+  }
+  FoldLayers();
+  return &folded_->weight;
+}
+
+template <typename Dtype>
+Blob<Dtype>* BaseConvolutionLayer<Dtype>::forward_bias() {
+  if (folded_layers_.empty()) {
+    return bias_term_ ? this->blobs_[1].get() : NULL;
+  }
+  FoldLayers();
+  return &folded_->bias;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::FoldLayers() {
+  WeightCache::Sources sources;
+  for (int i = 0; i < this->blobs_.size(); ++i) {
+    const SyncedMemory* data = this->blobs_[i]->data().get();
+    sources.push_back(std::make_pair(data, data->version()));
+  }
+  for (int i = 0; i < folded_layers_.size(); ++i) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        folded_layers_[i]->blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      const SyncedMemory* data = blobs[j]->data().get();
+      sources.push_back(std::make_pair(data, data->version()));
+    }
+  }
+  if (folded_ && sources == folded_sources_) {
+    return;
+  }
+  // Name each folded layer, its number of parameters and what else the fold
+  // depends on, as the sources alone are one flat list.
+  std::ostringstream kind;
+  kind << "Convolution folded";
+  for (int i = 0; i < folded_layers_.size(); ++i) {
+    Layer<Dtype>* layer = folded_layers_[i];
+    kind << " " << layer->type() << "/" << layer->blobs().size();
+    if (string(layer->type()) == "BatchNorm") {
+      kind << "/" << layer->layer_param().batch_norm_param().eps();
+    }
+  }
+  folded_ = WeightCache::Get(kind.str(), sources, this,
+      &BaseConvolutionLayer<Dtype>::BuildFoldedWeights);
+  folded_sources_ = sources;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::BuildFoldedWeights(FoldedWeights* folded) {
+  // Compose the folded layers into one transform y = scale * x + shift.
+  vector<Dtype> scale(num_output_, Dtype(1)), shift(num_output_, Dtype(0));
+  for (int i = 0; i < folded_layers_.size(); ++i) {
+    Layer<Dtype>* layer = folded_layers_[i];
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = layer->blobs();
+    CHECK_EQ(blobs[0]->count(), num_output_) << "Layer "
+        << layer->layer_param().name() << " cannot be folded into "
+        << this->layer_param_.name() << "; channel count mismatch.";
+    if (string(layer->type()) == "BatchNorm") {
+      // The global statistics, stored scaled by the moving average factor.
+      const Dtype factor = blobs[2]->cpu_data()[0];
+      const Dtype normalizer = factor == 0 ? Dtype(0) : Dtype(1) / factor;
+      const Dtype eps = layer->layer_param().batch_norm_param().eps();
+      const Dtype* mean = blobs[0]->cpu_data();
+      const Dtype* variance = blobs[1]->cpu_data();
+      for (int c = 0; c < num_output_; ++c) {
+        const Dtype inv_std =
+            Dtype(1) / std::sqrt(variance[c] * normalizer + eps);
+        scale[c] *= inv_std;
+        shift[c] = (shift[c] - mean[c] * normalizer) * inv_std;
+      }
+    } else {
+      CHECK_EQ(string(layer->type()), "Scale");
+      const Dtype* gamma = blobs[0]->cpu_data();
+      const Dtype* beta = blobs.size() > 1 ? blobs[1]->cpu_data() : NULL;
+      for (int c = 0; c < num_output_; ++c) {
+        scale[c] *= gamma[c];
+        shift[c] = shift[c] * gamma[c] + (beta ? beta[c] : Dtype(0));
+      }
+    }
+  }
+  folded->weight.ReshapeLike(*this->blobs_[0]);
+  const int kernel_count = this->blobs_[0]->count(1);
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* folded_weight = folded->weight.mutable_cpu_data();
+  for (int c = 0; c < num_output_; ++c) {
+    caffe_cpu_scale(kernel_count, scale[c], weight + c * kernel_count,
+        folded_weight + c * kernel_count);
+  }
+  folded->bias.Reshape(vector<int>(1, num_output_));
+  Dtype* folded_bias = folded->bias.mutable_cpu_data();
+  for (int c = 0; c < num_output_; ++c) {
+    const Dtype bias = bias_term_ ? this->blobs_[1]->cpu_data()[c] : Dtype(0);
+    folded_bias[c] = bias * scale[c] + shift[c];
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
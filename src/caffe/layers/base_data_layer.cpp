@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <vector>
 
@@ -36,9 +37,12 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
+      prefetch_(param.data_param().prefetch()),
       prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+  CHECK_GT(prefetch_.size(), 0) << "Prefetch at least one batch.";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -50,24 +54,35 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
 #endif
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
+  const int decode_threads = this->layer_param_.data_param().decode_threads();
+  CHECK_GT(decode_threads, 0) << "Decode on at least one thread.";
+  item_transformers_.assign(1, this->data_transformer_);
+  for (int i = 1; i < decode_threads; ++i) {
+    item_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    item_transformers_.back()->InitRand();
+  }
+  if (decode_threads > 1) {
+    decode_workers_.reset(new TaskGraph(decode_threads, decode_threads));
+  }
   StartInternalThread();
   DLOG(INFO) << "Prefetch initialized.";
 }
@@ -103,6 +118,26 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+// Runs the items of worker worker_id, for BasePrefetchingDataLayer::ForEachItem.
+static void RunWorkerItems(int worker_id, int num_workers, int num_items,
+    const boost::function<void(int, int)>& item) {
+  for (int item_id = worker_id; item_id < num_items; item_id += num_workers) {
+    item(item_id, worker_id);
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ForEachItem(int num_items,
+    const boost::function<void(int, int)>& item) {
+  if (!decode_workers_) {
+    RunWorkerItems(0, 1, num_items, item);
+    return;
+  }
+  const int num_workers = decode_workers_->num_tasks();
+  decode_workers_->Run(0, num_workers - 1, boost::bind(&RunWorkerItems, _1,
+      num_workers, num_items, boost::cref(item)));
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "caffe/layers/blocked_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void BlockedConvolutionLayer<Dtype>::LayerSetUp(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const BlockedLayoutParameter& layout_param =
+      this->layer_param_.blocked_layout_param();
+  block_ = layout_param.block();
+  CHECK_GT(block_, 0) << "Channel block size must be positive.";
+  const int bottom_channels = layout_param.bottom_channels_size() > 0 ?
+      layout_param.bottom_channels(0) : 0;
+  bottom_blocked_ = bottom_channels > 0;
+  if (bottom_blocked_) {
+    CHECK_EQ(bottom[0]->num_axes(), 5) << "Blocked input must have 5 axes.";
+    CHECK_EQ(bottom[0]->shape(4), block_) << "Input block size mismatch.";
+  } else {
+    CHECK_EQ(bottom[0]->num_axes(), 4) << "Blocked convolution only supports "
+        << "2D inputs; set channel_block: 0 for this net.";
+  }
+  // Set up kernel, stride, etc. and the weights against the logical input.
+  vector<int> logical_shape(bottom[0]->shape().begin(),
+      bottom[0]->shape().begin() + 4);
+  if (bottom_blocked_) {
+    logical_shape[1] = bottom_channels;
+  }
+  logical_bottom_.Reshape(logical_shape);
+  logical_bottom_vec_.assign(1, &logical_bottom_);
+  logical_top_vec_.assign(1, &logical_top_);
+  ConvolutionLayer<Dtype>::LayerSetUp(logical_bottom_vec_, logical_top_vec_);
+  CHECK_EQ(this->group_, 1) << "Blocked convolution does not support groups.";
+  bottom_block_ = bottom_blocked_ ? block_ : 1;
+  bottom_channel_blocks_ = (this->channels_ + bottom_block_ - 1) /
+      bottom_block_;
+  top_channel_blocks_ = (this->num_output_ + block_ - 1) / block_;
+}
+
+template <typename Dtype>
+void BlockedConvolutionLayer<Dtype>::Reshape(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  vector<int> logical_shape(bottom[0]->shape().begin(),
+      bottom[0]->shape().begin() + 4);
+  if (bottom_blocked_) {
+    CHECK_EQ(bottom[0]->shape(1), bottom_channel_blocks_)
+        << "Input size incompatible with convolution kernel.";
+    logical_shape[1] = this->channels_;
+  }
+  logical_bottom_.Reshape(logical_shape);
+  ConvolutionLayer<Dtype>::Reshape(logical_bottom_vec_, logical_top_vec_);
+  vector<int> top_shape(logical_top_.shape());
+  top_shape[1] = top_channel_blocks_;
+  top_shape.push_back(block_);
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void BlockedConvolutionLayer<Dtype>::PackWeights() {
+  const Blob<Dtype>* weight_blob = this->forward_weight();
+  const Blob<Dtype>* bias_blob = this->forward_bias();
+  WeightCache::Sources sources;
+  sources.push_back(std::make_pair(weight_blob->data().get(),
+      weight_blob->data()->version()));
+  if (bias_blob) {
+    sources.push_back(std::make_pair(bias_blob->data().get(),
+        bias_blob->data()->version()));
+  }
+  if (packed_ && sources == packed_sources_) {
+    return;
+  }
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  std::ostringstream kind;
+  kind << "BlockedConvolution " << block_ << "x" << bottom_block_ << " "
+      << this->num_output_ << "x" << this->channels_ << "x" << kernel_shape[0]
+      << "x" << kernel_shape[1];
+  packed_ = WeightCache::Get(kind.str(), sources, this,
+      &BlockedConvolutionLayer<Dtype>::BuildPackedWeights);
+  packed_sources_ = sources;
+}
+
+template <typename Dtype>
+void BlockedConvolutionLayer<Dtype>::BuildPackedWeights(
+    PackedWeights* packed_weights) {
+  const Blob<Dtype>* weight_blob = this->forward_weight();
+  const Blob<Dtype>* bias_blob = this->forward_bias();
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int kernel_h = kernel_shape[0];
+  const int kernel_w = kernel_shape[1];
+  vector<int> packed_shape(6);
+  packed_shape[0] = top_channel_blocks_;
+  packed_shape[1] = bottom_channel_blocks_;
+  packed_shape[2] = kernel_h;
+  packed_shape[3] = kernel_w;
+  packed_shape[4] = bottom_block_;
+  packed_shape[5] = block_;
+  packed_weights->weight.Reshape(packed_shape);
+  const Dtype* weight = weight_blob->cpu_data();
+  Dtype* packed = packed_weights->weight.mutable_cpu_data();
+  caffe_set(packed_weights->weight.count(), Dtype(0), packed);
+  for (int oc = 0; oc < this->num_output_; ++oc) {
+    for (int ic = 0; ic < this->channels_; ++ic) {
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          const int packed_index = ((((oc / block_ * bottom_channel_blocks_ +
+              ic / bottom_block_) * kernel_h + kh) * kernel_w + kw) *
+              bottom_block_ + ic % bottom_block_) * block_ + oc % block_;
+          packed[packed_index] =
+              weight[((oc * this->channels_ + ic) * kernel_h + kh) * kernel_w
+                     + kw];
+        }
+      }
+    }
+  }
+  // The bias is padded with zeros so that padding channels stay zero.
+  packed_weights->bias.Reshape(vector<int>(1, top_channel_blocks_ * block_));
+  Dtype* bias = packed_weights->bias.mutable_cpu_data();
+  caffe_set(packed_weights->bias.count(), Dtype(0), bias);
+  if (bias_blob) {
+    caffe_copy(this->num_output_, bias_blob->cpu_data(), bias);
+  }
+}
+
+// The geometry of one blocked convolution, shared by its kernels.
+struct BlockedConvGeometry {
+  int height, width, out_height, out_width;
+  int kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w, dilation_h,
+      dilation_w;
+  int bottom_channel_blocks, in_block;
+};
+
+// Computes kTile consecutive output pixels, starting at (oh, ow), of one
+// block of kBlock output channels. The kTile x kBlock outputs stay in local
+// accumulators over the whole reduction, and each kBlock weights loaded are
+// used for all kTile pixels.
+template <typename Dtype, int kBlock, int kTile>
+static void blocked_conv_tile(const BlockedConvGeometry& g,
+    const Dtype* bottom_n, const Dtype* weight_ob, const Dtype* bias_ob,
+    const bool relu, const int oh, const int ow, Dtype* top_ob) {
+  Dtype acc[kTile][kBlock];
+  for (int t = 0; t < kTile; ++t) {
+    for (int o = 0; o < kBlock; ++o) {
+      acc[t][o] = bias_ob[o];
+    }
+  }
+  for (int ib = 0; ib < g.bottom_channel_blocks; ++ib) {
+    const Dtype* in_ib = bottom_n + ib * g.height * g.width * g.in_block;
+    for (int kh = 0; kh < g.kernel_h; ++kh) {
+      const int ih = oh * g.stride_h - g.pad_h + kh * g.dilation_h;
+      if (ih < 0 || ih >= g.height) { continue; }
+      for (int kw = 0; kw < g.kernel_w; ++kw) {
+        const Dtype* in[kTile];
+        for (int t = 0; t < kTile; ++t) {
+          const int iw = (ow + t) * g.stride_w - g.pad_w + kw * g.dilation_w;
+          in[t] = iw >= 0 && iw < g.width ?
+              in_ib + (ih * g.width + iw) * g.in_block : NULL;
+        }
+        const Dtype* w = weight_ob +
+            ((ib * g.kernel_h + kh) * g.kernel_w + kw) * g.in_block * kBlock;
+        for (int i = 0; i < g.in_block; ++i) {
+          const Dtype* w_i = w + i * kBlock;
+          for (int t = 0; t < kTile; ++t) {
+            if (!in[t]) { continue; }
+            const Dtype x = in[t][i];
+            for (int o = 0; o < kBlock; ++o) {
+              acc[t][o] += x * w_i[o];
+            }
+          }
+        }
+      }
+    }
+  }
+  for (int t = 0; t < kTile; ++t) {
+    Dtype* out = top_ob + (oh * g.out_width + ow + t) * kBlock;
+    for (int o = 0; o < kBlock; ++o) {
+      out[o] = relu ? std::max(acc[t][o], Dtype(0)) : acc[t][o];
+    }
+  }
+}
+
+// Computes one image with a block size known at compile time: rows of
+// kTile pixels, and the remainder of each row one pixel at a time.
+template <typename Dtype, int kBlock>
+static void blocked_conv_image(const BlockedConvGeometry& g,
+    const int top_channel_blocks, const Dtype* bottom_n, const Dtype* weight,
+    const Dtype* bias, const bool relu, Dtype* top_n) {
+  const int kTile = 4;
+  const int weight_stride =
+      g.bottom_channel_blocks * g.kernel_h * g.kernel_w * g.in_block * kBlock;
+  for (int ob = 0; ob < top_channel_blocks; ++ob) {
+    const Dtype* weight_ob = weight + ob * weight_stride;
+    const Dtype* bias_ob = bias + ob * kBlock;
+    Dtype* top_ob = top_n + ob * g.out_height * g.out_width * kBlock;
+    for (int oh = 0; oh < g.out_height; ++oh) {
+      int ow = 0;
+      for (; ow + kTile <= g.out_width; ow += kTile) {
+        blocked_conv_tile<Dtype, kBlock, kTile>(g, bottom_n, weight_ob,
+            bias_ob, relu, oh, ow, top_ob);
+      }
+      for (; ow < g.out_width; ++ow) {
+        blocked_conv_tile<Dtype, kBlock, 1>(g, bottom_n, weight_ob, bias_ob,
+            relu, oh, ow, top_ob);
+      }
+    }
+  }
+}
+
+// Computes one image with any block size, one output pixel at a time.
+template <typename Dtype>
+static void blocked_conv_image(const BlockedConvGeometry& g,
+    const int block, const int top_channel_blocks, const Dtype* bottom_n,
+    const Dtype* weight, const Dtype* bias, const bool relu, Dtype* top_n) {
+  const int weight_stride =
+      g.bottom_channel_blocks * g.kernel_h * g.kernel_w * g.in_block * block;
+  for (int ob = 0; ob < top_channel_blocks; ++ob) {
+    const Dtype* weight_ob = weight + ob * weight_stride;
+    for (int oh = 0; oh < g.out_height; ++oh) {
+      for (int ow = 0; ow < g.out_width; ++ow) {
+        Dtype* out = top_n +
+            ((ob * g.out_height + oh) * g.out_width + ow) * block;
+        for (int o = 0; o < block; ++o) {
+          out[o] = bias[ob * block + o];
+        }
+        for (int ib = 0; ib < g.bottom_channel_blocks; ++ib) {
+          const Dtype* in_ib = bottom_n + ib * g.height * g.width * g.in_block;
+          for (int kh = 0; kh < g.kernel_h; ++kh) {
+            const int ih = oh * g.stride_h - g.pad_h + kh * g.dilation_h;
+            if (ih < 0 || ih >= g.height) { continue; }
+            for (int kw = 0; kw < g.kernel_w; ++kw) {
+              const int iw = ow * g.stride_w - g.pad_w + kw * g.dilation_w;
+              if (iw < 0 || iw >= g.width) { continue; }
+              const Dtype* in = in_ib + (ih * g.width + iw) * g.in_block;
+              const Dtype* w = weight_ob +
+                  ((ib * g.kernel_h + kh) * g.kernel_w + kw) * g.in_block *
+                  block;
+              for (int i = 0; i < g.in_block; ++i) {
+                const Dtype x = in[i];
+                const Dtype* w_i = w + i * block;
+                for (int o = 0; o < block; ++o) {
+                  out[o] += x * w_i[o];
+                }
+              }
+            }
+          }
+        }
+        if (relu) {
+          for (int o = 0; o < block; ++o) {
+            out[o] = std::max(out[o], Dtype(0));
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BlockedConvolutionLayer<Dtype>::Forward_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  PackWeights();
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  BlockedConvGeometry g;
+  g.height = logical_bottom_.shape(2);
+  g.width = logical_bottom_.shape(3);
+  g.out_height = top[0]->shape(2);
+  g.out_width = top[0]->shape(3);
+  g.kernel_h = kernel_shape[0];
+  g.kernel_w = kernel_shape[1];
+  g.stride_h = stride[0];
+  g.stride_w = stride[1];
+  g.pad_h = pad[0];
+  g.pad_w = pad[1];
+  g.dilation_h = dilation[0];
+  g.dilation_w = dilation[1];
+  g.bottom_channel_blocks = bottom_channel_blocks_;
+  g.in_block = bottom_block_;
+  const bool relu = this->layer_param_.fusion_param().relu();
+  const Dtype* weight = packed_->weight.cpu_data();
+  const Dtype* bias = packed_->bias.cpu_data();
+  const int bottom_dim = bottom[0]->count(1);
+  const int top_dim = top[0]->count(1);
+  for (int n = 0; n < this->num_; ++n) {
+    const Dtype* bottom_n = bottom[0]->cpu_data() + n * bottom_dim;
+    Dtype* top_n = top[0]->mutable_cpu_data() + n * top_dim;
+    switch (block_) {
+    case 8:
+      blocked_conv_image<Dtype, 8>(g, top_channel_blocks_, bottom_n, weight,
+          bias, relu, top_n);
+      break;
+    case 16:
+      blocked_conv_image<Dtype, 16>(g, top_channel_blocks_, bottom_n, weight,
+          bias, relu, top_n);
+      break;
+    default:
+      blocked_conv_image(g, block_, top_channel_blocks_, bottom_n, weight,
+          bias, relu, top_n);
+    }
+  }
+}
+
+template <typename Dtype>
+void BlockedConvolutionLayer<Dtype>::Backward_cpu(
+      const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+      const vector<Blob<Dtype>*>& bottom) {
+  LOG(FATAL) << "Blocked convolution is inference only; "
+      << "set channel_block: 0 to train layer " << this->layer_param_.name();
+}
+
+INSTANTIATE_CLASS(BlockedConvolutionLayer);
+
+}  // namespace caffe
@@ -0,0 +1,87 @@
+#include <cmath>
+#include <vector>
+
+#include "caffe/layers/blocked_lrn_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void BlockedLRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(this->layer_param_.lrn_param().norm_region(),
+      LRNParameter_NormRegion_ACROSS_CHANNELS)
+      << "Blocked LRN only supports ACROSS_CHANNELS normalization.";
+  block_ = this->layer_param_.blocked_layout_param().block();
+  LRNLayer<Dtype>::LayerSetUp(bottom, top);
+}
+
+template <typename Dtype>
+void BlockedLRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(bottom[0]->num_axes(), 5) << "Blocked input must have 5 axes.";
+  CHECK_EQ(bottom[0]->shape(4), block_) << "Input block size mismatch.";
+  this->num_ = bottom[0]->shape(0);
+  this->channels_ = bottom[0]->shape(1) * block_;
+  this->height_ = bottom[0]->shape(2);
+  this->width_ = bottom[0]->shape(3);
+  top[0]->ReshapeLike(*bottom[0]);
+}
+
+template <typename Dtype>
+void BlockedLRNLayer<Dtype>::CrossChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int block = block_;
+  const int channel_blocks = this->channels_ / block;
+  const int spatial_dim = this->height_ * this->width_;
+  const int size = this->size_;
+  const int pre_pad = this->pre_pad_;
+  const Dtype alpha_over_size = this->alpha_ / size;
+  // Squares of one pixel's channels, with pre_pad zeros on either side, and
+  // the matching scales.
+  vector<Dtype> padded_square(this->channels_ + size - 1, Dtype(0));
+  vector<Dtype> scale(this->channels_);
+  for (int n = 0; n < this->num_; ++n) {
+    const Dtype* bottom_n = bottom_data + n * channel_blocks * spatial_dim *
+        block;
+    Dtype* top_n = top_data + n * channel_blocks * spatial_dim * block;
+    for (int s = 0; s < spatial_dim; ++s) {
+      for (int cb = 0; cb < channel_blocks; ++cb) {
+        const Dtype* in = bottom_n + (cb * spatial_dim + s) * block;
+        Dtype* square = &padded_square[pre_pad + cb * block];
+        for (int c = 0; c < block; ++c) {
+          square[c] = in[c] * in[c];
+        }
+      }
+      Dtype accum = 0;
+      for (int c = 0; c < size - 1; ++c) {
+        accum += padded_square[c];
+      }
+      for (int c = 0; c < this->channels_; ++c) {
+        accum += padded_square[c + size - 1];
+        scale[c] = this->k_ + alpha_over_size * accum;
+        accum -= padded_square[c];
+      }
+      for (int cb = 0; cb < channel_blocks; ++cb) {
+        const Dtype* in = bottom_n + (cb * spatial_dim + s) * block;
+        Dtype* out = top_n + (cb * spatial_dim + s) * block;
+        for (int c = 0; c < block; ++c) {
+          out[c] = in[c] * std::pow(scale[cb * block + c], -this->beta_);
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BlockedLRNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  LOG(FATAL) << "Blocked LRN is inference only; "
+      << "set channel_block: 0 to train layer " << this->layer_param_.name();
+}
+
+INSTANTIATE_CLASS(BlockedLRNLayer);
+
+}  // namespace caffe
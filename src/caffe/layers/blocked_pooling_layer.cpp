@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include "caffe/layers/blocked_pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+using std::min;
+using std::max;
+
+template <typename Dtype>
+void BlockedPoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  block_ = this->layer_param_.blocked_layout_param().block();
+  CHECK_EQ(bottom[0]->num_axes(), 5) << "Blocked input must have 5 axes.";
+  CHECK_EQ(bottom[0]->shape(4), block_) << "Input block size mismatch.";
+  const PoolingParameter_PoolMethod pool =
+      this->layer_param_.pooling_param().pool();
+  CHECK(pool == PoolingParameter_PoolMethod_MAX ||
+        pool == PoolingParameter_PoolMethod_AVE)
+      << "Blocked pooling only supports MAX and AVE pooling.";
+  logical_bottom_.Reshape(vector<int>(bottom[0]->shape().begin(),
+      bottom[0]->shape().begin() + 4));
+  logical_bottom_vec_.assign(1, &logical_bottom_);
+  logical_top_vec_.assign(1, &logical_top_);
+  PoolingLayer<Dtype>::LayerSetUp(logical_bottom_vec_, logical_top_vec_);
+}
+
+template <typename Dtype>
+void BlockedPoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(bottom[0]->num_axes(), 5) << "Blocked input must have 5 axes.";
+  // Pool the channel blocks as if they were channels; the output sizes
+  // follow PoolingLayer exactly.
+  logical_bottom_.Reshape(vector<int>(bottom[0]->shape().begin(),
+      bottom[0]->shape().begin() + 4));
+  PoolingLayer<Dtype>::Reshape(logical_bottom_vec_, logical_top_vec_);
+  vector<int> top_shape(logical_top_.shape());
+  top_shape.push_back(block_);
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void BlockedPoolingLayer<Dtype>::Forward_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int block = block_;
+  const int planes = bottom[0]->shape(0) * this->channels_;
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  for (int p = 0; p < planes; ++p) {
+    for (int ph = 0; ph < this->pooled_height_; ++ph) {
+      for (int pw = 0; pw < this->pooled_width_; ++pw) {
+        int hstart = ph * this->stride_h_ - this->pad_h_;
+        int wstart = pw * this->stride_w_ - this->pad_w_;
+        int hend = min(hstart + this->kernel_h_, this->height_ + this->pad_h_);
+        int wend = min(wstart + this->kernel_w_, this->width_ + this->pad_w_);
+        // Average pooling divides by the padded window size, as PoolingLayer.
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, this->height_);
+        wend = min(wend, this->width_);
+        Dtype* out = top_data + (ph * this->pooled_width_ + pw) * block;
+        caffe_set(block, max_pool ? Dtype(-FLT_MAX) : Dtype(0), out);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const Dtype* in = bottom_data + (h * this->width_ + w) * block;
+            if (max_pool) {
+              for (int c = 0; c < block; ++c) {
+                out[c] = max(out[c], in[c]);
+              }
+            } else {
+              for (int c = 0; c < block; ++c) {
+                out[c] += in[c];
+              }
+            }
+          }
+        }
+        if (!max_pool) {
+          for (int c = 0; c < block; ++c) {
+            out[c] /= pool_size;
+          }
+        }
+      }
+    }
+    bottom_data += this->height_ * this->width_ * block;
+    top_data += this->pooled_height_ * this->pooled_width_ * block;
+  }
+}
+
+template <typename Dtype>
+void BlockedPoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  LOG(FATAL) << "Blocked pooling is inference only; "
+      << "set channel_block: 0 to train layer " << this->layer_param_.name();
+}
+
+INSTANTIATE_CLASS(BlockedPoolingLayer);
+
+}  // namespace caffe
@@ -24,15 +24,19 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* weight = this->forward_weight()->cpu_data();
+  const Blob<Dtype>* bias_blob = this->forward_bias();
+  const bool relu = this->layer_param_.fusion_param().relu();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
     for (int n = 0; n < this->num_; ++n) {
       this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
           top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
+      const Dtype* bias = bias_blob ? bias_blob->cpu_data() : NULL;
+      if (relu) {
+        this->forward_cpu_bias_relu(top_data + n * this->top_dim_, bias);
+      } else if (bias) {
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
@@ -3,6 +3,8 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <cstring>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
@@ -15,6 +17,14 @@ template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
     reader_(param) {
+  for (int i = 0; i < param.data_param().decode_threads(); ++i) {
+    item_data_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+#ifdef USE_OPENCV
+  if (param.data_param().image_cache_bytes() > 0) {
+    image_cache_.reset(new ImageCache(param.data_param().image_cache_bytes()));
+  }
+#endif  // USE_OPENCV
 }
 
 template <typename Dtype>
@@ -27,16 +37,16 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int batch_size = this->layer_param_.data_param().batch_size();
   // Read a data point, and use it to initialize the top blob.
-  Datum& datum = *(reader_.full().peek());
+  DatumRecord& record = *(reader_.full().peek());
 
   // Use data_transformer to infer the expected blob shape from datum.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(record);
   this->transformed_data_.Reshape(top_shape);
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_count(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -44,9 +54,13 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
+    const int label_size = this->layer_param_.data_param().label_size();
+    if (label_size > 0) {
+      label_shape.push_back(label_size);
+    }
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_count(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -65,9 +79,18 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   // Reshape according to the first datum of each batch
   // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.data_param().batch_size();
-  Datum& datum = *(reader_.full().peek());
+  DatumRecord& record = *(reader_.full().peek());
   // Use data_transformer to infer the expected blob shape from datum.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+  vector<int> top_shape;
+#ifdef USE_OPENCV
+  if (image_cache_ && record.datum.encoded()) {
+    top_shape = this->data_transformer_->InferBlobShape(
+        DecodeImage(record, 0));
+  }
+#endif  // USE_OPENCV
+  if (top_shape.empty()) {
+    top_shape = this->data_transformer_->InferBlobShape(record);
+  }
   this->transformed_data_.Reshape(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
@@ -79,23 +102,23 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   if (this->output_labels_) {
     top_label = batch->label_.mutable_cpu_data();
   }
+  // Take the datums of the batch in order, then decode and transform them
+  // (mirror, scale, crop...) on the decode workers.
+  timer.Start();
+  batch_records_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    // get a datum
-    Datum& datum = *(reader_.full().pop("Waiting for data"));
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      top_label[item_id] = datum.label();
-    }
-    trans_time += timer.MicroSeconds();
-
-    reader_.free().push(const_cast<Datum*>(&datum));
+    batch_records_[item_id] = reader_.full().pop("Waiting for data");
+  }
+  read_time += timer.MicroSeconds();
+  timer.Start();
+  for (int i = 0; i < item_data_.size(); ++i) {
+    item_data_[i]->ReshapeLike(this->transformed_data_);
+  }
+  this->ForEachItem(batch_size, boost::bind(&DataLayer<Dtype>::load_item,
+      this, top_data, top_label, _1, _2));
+  trans_time += timer.MicroSeconds();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    reader_.free().push(batch_records_[item_id]);
   }
   timer.Stop();
   batch_timer.Stop();
@@ -104,6 +127,64 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the decode workers
+template<typename Dtype>
+void DataLayer<Dtype>::load_item(Dtype* top_data, Dtype* top_label,
+    int item_id, int worker_id) {
+  const DatumRecord& record = *batch_records_[item_id];
+  Blob<Dtype>* item_data = item_data_[worker_id].get();
+  item_data->set_cpu_data(top_data + item_id * item_data->count());
+#ifdef USE_OPENCV
+  if (image_cache_ && record.datum.encoded()) {
+    this->item_transformers_[worker_id]->Transform(
+        DecodeImage(record, worker_id), item_data);
+  } else {
+    this->item_transformers_[worker_id]->Transform(record, item_data);
+  }
+#else
+  this->item_transformers_[worker_id]->Transform(record, item_data);
+#endif  // USE_OPENCV
+  // Copy label, or the labels straight from the record into their row.
+  if (this->output_labels_) {
+    const DataParameter& data_param = this->layer_param_.data_param();
+    const int label_size = data_param.label_size();
+    if (label_size > 0) {
+      CHECK_LE(record.num_labels, label_size) << "Record " << record.key
+          << " has more than label_size labels.";
+      Dtype* item_label = top_label + item_id * label_size;
+      int num_labels = record.num_labels;
+      for (int i = 0; i < num_labels; ++i) {
+        float label;
+        memcpy(&label, record.labels + i * sizeof(label), sizeof(label));
+        item_label[i] = label;
+      }
+      // Records written before multi-label data hold only the single label.
+      if (num_labels == 0 && record.datum.has_label()) {
+        item_label[0] = record.datum.label();
+        num_labels = 1;
+      }
+      for (int i = num_labels; i < label_size; ++i) {
+        item_label[i] = data_param.label_padding();
+      }
+    } else {
+      top_label[item_id] = record.datum.label();
+    }
+  }
+}
+
+#ifdef USE_OPENCV
+template<typename Dtype>
+cv::Mat DataLayer<Dtype>::DecodeImage(const DatumRecord& record,
+    int worker_id) {
+  cv::Mat cv_img;
+  if (!image_cache_->Get(record.key, &cv_img)) {
+    cv_img = this->item_transformers_[worker_id]->DecodeImage(record);
+    image_cache_->Put(record.key, cv_img);
+  }
+  return cv_img;
+}
+#endif  // USE_OPENCV
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
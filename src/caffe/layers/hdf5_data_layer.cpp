@@ -1,11 +1,12 @@
 /*
 TODO:
-- load file in a separate thread ("prefetch")
 - can be smarter about the memcpy call instead of doing it row-by-row
   :: use util functions caffe_copy, and Blob->offset()
   :: don't forget to update hdf5_daa_layer.cu accordingly
 - add ability to shuffle filenames if flag is set
 */
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -16,11 +17,28 @@ TODO:
 
 #include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+}
+
+// Gets the shapes of the datasets of an HDF5 file named after the tops of
+// layer_param, without reading them, and returns their number of rows.
+static hsize_t GetHDF5FileShapes(hid_t file_id,
+    const LayerParameter& layer_param, vector<vector<int> >* shapes) {
+  const int top_size = layer_param.top_size();
+  shapes->resize(top_size);
+  for (int i = 0; i < top_size; ++i) {
+    (*shapes)[i] = hdf5_get_nd_dataset_shape(file_id,
+        layer_param.top(i).c_str(), 1, INT_MAX);
+    CHECK_EQ((*shapes)[i][0], (*shapes)[0][0]);
+  }
+  return (*shapes)[0][0];
+}
 
 // Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
@@ -106,27 +124,169 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
   }
 
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
+  // Load the first HDF5 file and initialize the line counter; or, if
+  // prefetching, only find the shapes of its datasets.
+  const HDF5DataParameter& hdf5_data_param =
+      this->layer_param_.hdf5_data_param();
+  const char* first_filename =
+      hdf_filenames_[file_permutation_[current_file_]].c_str();
+  const int top_size = this->layer_param_.top_size();
+  vector<vector<int> > shapes(top_size);
+  if (hdf5_data_param.prefetch() > 0) {
+    hid_t file_id = H5Fopen(first_filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    CHECK_GE(file_id, 0) << "Failed opening HDF5 file: " << first_filename;
+    GetHDF5FileShapes(file_id, this->layer_param_, &shapes);
+    H5Fclose(file_id);
+  } else {
+    LoadHDF5FileData(first_filename);
+    for (int i = 0; i < top_size; ++i) {
+      shapes[i] = hdf_blobs_[i]->shape();
+    }
+  }
   current_row_ = 0;
 
   // Reshape blobs.
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
-  const int top_size = this->layer_param_.top_size();
-  vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-    top_shape.resize(hdf_blobs_[i]->num_axes());
+    vector<int> top_shape = shapes[i];
     top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
-    }
     top[i]->Reshape(top_shape);
   }
+
+  if (hdf5_data_param.prefetch() > 0 && !this->is_started()) {
+    CHECK_GT(hdf5_data_param.chunk_rows(), 0) << "Read at least one row.";
+    prefetch_.resize(hdf5_data_param.prefetch());
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i].reset(new HDF5Batch<Dtype>());
+      for (int j = 0; j < top_size; ++j) {
+        prefetch_[i]->blobs_.push_back(
+            shared_ptr<Blob<Dtype> >(new Blob<Dtype>(top[j]->shape())));
+      }
+      prefetch_free_.push(prefetch_[i].get());
+    }
+    DLOG(INFO) << "Initializing prefetch";
+    this->StartInternalThread();
+  }
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::InternalThreadEntry() {
+  const HDF5DataParameter& hdf5_data_param =
+      this->layer_param_.hdf5_data_param();
+  const int batch_size = hdf5_data_param.batch_size();
+  const int top_size = this->layer_param_.top_size();
+  const bool shuffle = hdf5_data_param.shuffle();
+  // The order to output the rows of the current chunk in.
+  vector<int> chunk_order;
+  int chunk_row = 0;
+  // The first rows of the chunks of the current file left to read.
+  vector<hsize_t> chunk_starts;
+  int next_chunk = 0;
+  hsize_t file_rows = 0;
+  vector<vector<int> > file_shapes;
+  hid_t file_id = -1;
+  int file = -1;
+  try {
+    while (!must_stop()) {
+      HDF5Batch<Dtype>* batch = prefetch_free_.pop();
+      for (int i = 0; i < batch_size; ++i, ++chunk_row) {
+        if (chunk_row == chunk_order.size()) {
+          while (next_chunk == chunk_starts.size()) {
+            if (file_id >= 0) {
+              H5Fclose(file_id);
+            }
+            if (++file == num_files_) {
+              file = 0;
+              if (shuffle) {
+                caffe::shuffle(file_permutation_.begin(),
+                    file_permutation_.end(), caffe_rng());
+              }
+              DLOG(INFO) << "Looping around to first file.";
+            }
+            const string& filename = hdf_filenames_[file_permutation_[file]];
+            file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+            CHECK_GE(file_id, 0) << "Failed opening HDF5 file: " << filename;
+            file_rows = GetHDF5FileShapes(file_id, this->layer_param_,
+                &file_shapes);
+            chunk_starts.clear();
+            for (hsize_t row = 0; row < file_rows;
+                 row += hdf5_data_param.chunk_rows()) {
+              chunk_starts.push_back(row);
+            }
+            if (shuffle) {
+              caffe::shuffle(chunk_starts.begin(), chunk_starts.end(),
+                  caffe_rng());
+            }
+            next_chunk = 0;
+          }
+          const hsize_t first_row = chunk_starts[next_chunk++];
+          const hsize_t num_rows = std::min<hsize_t>(
+              hdf5_data_param.chunk_rows(), file_rows - first_row);
+          prefetch_chunk_.resize(top_size);
+          for (int j = 0; j < top_size; ++j) {
+            if (!prefetch_chunk_[j]) {
+              prefetch_chunk_[j].reset(new Blob<Dtype>());
+            }
+            // Only the rows of the chunk are held, not the whole file.
+            vector<int> shape = file_shapes[j];
+            shape[0] = num_rows;
+            prefetch_chunk_[j]->Reshape(shape);
+            CHECK_EQ(batch->blobs_[j]->count(1), prefetch_chunk_[j]->count(1))
+                << "Rows of " << this->layer_param_.top(j)
+                << " differ in shape across files.";
+            hdf5_load_nd_dataset_rows(file_id,
+                this->layer_param_.top(j).c_str(), first_row, num_rows,
+                prefetch_chunk_[j]->mutable_cpu_data());
+          }
+          chunk_order.resize(num_rows);
+          for (int row = 0; row < num_rows; ++row) {
+            chunk_order[row] = row;
+          }
+          if (shuffle) {
+            caffe::shuffle(chunk_order.begin(), chunk_order.end(),
+                caffe_rng());
+          }
+          chunk_row = 0;
+        }
+        for (int j = 0; j < top_size; ++j) {
+          const int data_dim = batch->blobs_[j]->count(1);
+          caffe_copy(data_dim,
+              prefetch_chunk_[j]->cpu_data() +
+              chunk_order[chunk_row] * data_dim,
+              batch->blobs_[j]->mutable_cpu_data() + i * data_dim);
+        }
+      }
+      prefetch_full_.push(batch);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+  if (file_id >= 0) {
+    H5Fclose(file_id);
+  }
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::ForwardPrefetched(const vector<Blob<Dtype>*>& top,
+    bool gpu) {
+  HDF5Batch<Dtype>* batch =
+      prefetch_full_.pop("Data layer prefetch queue empty");
+  for (int j = 0; j < top.size(); ++j) {
+    const Blob<Dtype>& blob = *batch->blobs_[j];
+    caffe_copy(blob.count(), blob.cpu_data(),
+        gpu ? top[j]->mutable_gpu_data() : top[j]->mutable_cpu_data());
+  }
+  prefetch_free_.push(batch);
 }
 
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (this->layer_param_.hdf5_data_param().prefetch() > 0) {
+    ForwardPrefetched(top, false);
+    return;
+  }
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
   for (int i = 0; i < batch_size; ++i, ++current_row_) {
     if (current_row_ == hdf_blobs_[0]->shape(0)) {
@@ -1,3 +1,5 @@
+#include <sstream>
+#include <utility>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -80,15 +82,70 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+const Dtype* InnerProductLayer<Dtype>::packed_weights() {
+  const SyncedMemory* source = this->blobs_[0]->data().get();
+  const WeightCache::Sources sources(1,
+      std::make_pair(source, source->version()));
+  if (!packed_weight_ || sources != packed_weight_sources_ ||
+      M_ != packed_weight_batch_) {
+    std::ostringstream kind;
+    kind << "InnerProduct packed " << (transpose_ ? "T " : "N ") << N_ << "x"
+        << M_ << "x" << K_;
+    packed_weight_ = WeightCache::Get(kind.str(), sources, this,
+        &InnerProductLayer<Dtype>::BuildPackedWeights);
+    packed_weight_sources_ = sources;
+    packed_weight_batch_ = M_;
+  }
+  return packed_weight_->cpu_data();
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::BuildPackedWeights(
+    Blob<Dtype>* packed_weight) {
+  // Pack W (or W^T if transposed) as the left operand of top^T = W bottom^T.
+  packed_weight->Reshape(vector<int>(1,
+      caffe_cpu_gemm_pack_size<Dtype>(N_, M_, K_)));
+  caffe_cpu_gemm_pack<Dtype>(transpose_ ? CblasTrans : CblasNoTrans,
+      N_, M_, K_, (Dtype)1., this->blobs_[0]->cpu_data(),
+      packed_weight->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+#ifdef USE_MKL
+  // At inference the weights are constant, so pack them once instead of
+  // letting every gemm call repack them. Without MKL BLAS is used as is, as
+  // in BaseConvolutionLayer::forward_cpu_gemm.
+  const bool use_packed_weights = this->phase_ == TEST;
+#else
+  const bool use_packed_weights = false;
+#endif
+  if (use_packed_weights) {
+    const Dtype* packed_weight = packed_weights();
+    if (M_ == 1) {
+      caffe_cpu_packed_gemm<Dtype>(CblasTrans, N_, M_, K_, packed_weight,
+          bottom_data, (Dtype)0., top_data);
+    } else {
+      packed_top_.Reshape(N_, M_, 1, 1);
+      Dtype* packed_top_data = packed_top_.mutable_cpu_data();
+      caffe_cpu_packed_gemm<Dtype>(CblasTrans, N_, M_, K_, packed_weight,
+          bottom_data, (Dtype)0., packed_top_data);
+      for (int n = 0; n < N_; ++n) {
+        for (int m = 0; m < M_; ++m) {
+          top_data[m * N_ + n] = packed_top_data[n * M_ + m];
+        }
+      }
+    }
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -145,6 +202,5 @@ STUB_GPU(InnerProductLayer);
 #endif
 
 INSTANTIATE_CLASS(InnerProductLayer);
-REGISTER_LAYER_CLASS(InnerProduct);
 
 }  // namespace caffe
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "caffe/layers/quantized_conv_layer.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void QuantizedConvolutionLayer<Dtype>::LayerSetUp(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  CHECK(this->is_1x1_ ||
+        (this->num_spatial_axes_ == 2 && !this->force_nd_im2col_))
+      << "Quantized convolution only supports 2D or 1x1 convolution.";
+}
+
+template <typename Dtype>
+void QuantizedConvolutionLayer<Dtype>::QuantizeWeights() {
+  Blob<Dtype>* weight = this->forward_weight();
+  SyncedMemory* source = weight->data().get();
+  WeightCache::Sources sources(1, std::make_pair(source, source->version()));
+  if (quantized_ && sources == quantized_sources_) {
+    return;
+  }
+  std::ostringstream kind;
+  kind << "QuantizedConvolution " << this->num_output_ << "x"
+      << weight->count(1);
+  quantized_ = WeightCache::Get(kind.str(), sources, this,
+      &QuantizedConvolutionLayer<Dtype>::BuildQuantizedWeights);
+  // Swap in memory that is never allocated unless read or written, unless
+  // a net sharing the weights already did.
+  if (this->layer_param_.quantization_param().drop_float_weights() &&
+      source->head() != SyncedMemory::UNINITIALIZED) {
+    CHECK_EQ(weight, this->blobs_[0].get()) << "Layer "
+        << this->layer_param_.name() << " needs its float weights for the "
+        << "layers folded into it; unset drop_float_weights.";
+    weight->set_data(shared_ptr<SyncedMemory>(
+        new SyncedMemory(source->size())));
+    source = weight->data().get();
+    sources.assign(1, std::make_pair(source, source->version()));
+    WeightCache::Alias(kind.str(), sources, quantized_);
+  }
+  quantized_sources_ = sources;
+}
+
+template <typename Dtype>
+void QuantizedConvolutionLayer<Dtype>::BuildQuantizedWeights(
+    QuantizedWeights* quantized) {
+  const Blob<Dtype>* weight = this->forward_weight();
+  const int kernel_dim = weight->count(1);
+  quantized->weight.resize(weight->count());
+  quantized->scale.resize(this->num_output_);
+  caffe_cpu_quantize_rows(CblasNoTrans, this->num_output_, kernel_dim,
+      weight->cpu_data(), &quantized->weight[0], &quantized->scale[0]);
+}
+
+template <typename Dtype>
+void QuantizedConvolutionLayer<Dtype>::Forward_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  QuantizeWeights();
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  const int group_out_channels = this->num_output_ / this->group_;
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const int spatial_dim = this->out_spatial_dim_;
+  const int col_offset = kernel_dim * spatial_dim;
+  const Blob<Dtype>* bias_blob = this->forward_bias();
+  const Dtype* bias = bias_blob ? bias_blob->cpu_data() : NULL;
+  const bool relu =
+      quant_param.relu() || this->layer_param_.fusion_param().relu();
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int* input_shape = this->conv_input_shape_.cpu_data();
+  accumulator_.resize(this->num_output_ * spatial_dim);
+  if (!this->is_1x1_) {
+    quantized_col_.resize(this->group_ * col_offset);
+  }
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    Dtype range = quant_param.bottom_range();
+    if (range <= 0) {
+      range = caffe_cpu_amax(bottom[i]->count(), bottom_data);
+    }
+    const Dtype bottom_scale = range > 0 ? Dtype(127) / range : Dtype(1);
+    quantized_bottom_.resize(bottom[i]->count());
+    caffe_cpu_quantize(bottom[i]->count(), bottom_scale, bottom_data,
+        &quantized_bottom_[0]);
+    for (int n = 0; n < this->num_; ++n) {
+      const int8_t* col = &quantized_bottom_[n * this->bottom_dim_];
+      if (!this->is_1x1_) {
+        im2col_cpu(col, this->channels_, input_shape[1], input_shape[2],
+            kernel_shape[0], kernel_shape[1], pad[0], pad[1],
+            stride[0], stride[1], dilation[0], dilation[1],
+            &quantized_col_[0]);
+        col = &quantized_col_[0];
+      }
+      for (int g = 0; g < this->group_; ++g) {
+        caffe_cpu_gemm_s8s32(CblasNoTrans, group_out_channels, spatial_dim,
+            kernel_dim, &quantized_->weight[g * this->weight_offset_],
+            col + g * col_offset,
+            &accumulator_[g * group_out_channels * spatial_dim]);
+      }
+      // Dequantize, add the bias and apply the fused ReLU in one pass.
+      Dtype* top_n = top_data + n * this->top_dim_;
+      for (int c = 0; c < this->num_output_; ++c) {
+        const Dtype scale = Dtype(1) / (bottom_scale * quantized_->scale[c]);
+        const Dtype shift = bias ? bias[c] : Dtype(0);
+        const int32_t* acc = &accumulator_[c * spatial_dim];
+        Dtype* out = top_n + c * spatial_dim;
+        for (int s = 0; s < spatial_dim; ++s) {
+          out[s] = acc[s] * scale + shift;
+        }
+        if (relu) {
+          for (int s = 0; s < spatial_dim; ++s) {
+            out[s] = std::max(out[s], Dtype(0));
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void QuantizedConvolutionLayer<Dtype>::Backward_cpu(
+      const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+      const vector<Blob<Dtype>*>& bottom) {
+  LOG(FATAL) << "Quantized convolution is inference only; remove "
+      << "quantization_param to train layer " << this->layer_param_.name();
+}
+
+INSTANTIATE_CLASS(QuantizedConvolutionLayer);
+
+}  // namespace caffe
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "caffe/layers/quantized_inner_product_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void QuantizedInnerProductLayer<Dtype>::QuantizeWeights() {
+  SyncedMemory* source = this->blobs_[0]->data().get();
+  WeightCache::Sources sources(1, std::make_pair(source, source->version()));
+  if (quantized_ && sources == quantized_sources_) {
+    return;
+  }
+  std::ostringstream kind;
+  kind << "QuantizedInnerProduct " << (this->transpose_ ? "T " : "N ")
+      << this->N_ << "x" << this->K_;
+  quantized_ = WeightCache::Get(kind.str(), sources, this,
+      &QuantizedInnerProductLayer<Dtype>::BuildQuantizedWeights);
+  // Swap in memory that is never allocated unless read or written, unless
+  // a net sharing the weights already did.
+  if (this->layer_param_.quantization_param().drop_float_weights() &&
+      source->head() != SyncedMemory::UNINITIALIZED) {
+    this->blobs_[0]->set_data(shared_ptr<SyncedMemory>(
+        new SyncedMemory(source->size())));
+    source = this->blobs_[0]->data().get();
+    sources.assign(1, std::make_pair(source, source->version()));
+    WeightCache::Alias(kind.str(), sources, quantized_);
+  }
+  quantized_sources_ = sources;
+}
+
+template <typename Dtype>
+void QuantizedInnerProductLayer<Dtype>::BuildQuantizedWeights(
+    QuantizedWeights* quantized) {
+  quantized->weight.resize(this->N_ * this->K_);
+  quantized->scale.resize(this->N_);
+  caffe_cpu_quantize_rows(this->transpose_ ? CblasTrans : CblasNoTrans,
+      this->N_, this->K_, this->blobs_[0]->cpu_data(), &quantized->weight[0],
+      &quantized->scale[0]);
+}
+
+template <typename Dtype>
+void QuantizedInnerProductLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  QuantizeWeights();
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  const int M = this->M_, N = this->N_, K = this->K_;
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  Dtype range = quant_param.bottom_range();
+  if (range <= 0) {
+    range = caffe_cpu_amax(M * K, bottom_data);
+  }
+  const Dtype bottom_scale = range > 0 ? Dtype(127) / range : Dtype(1);
+  quantized_bottom_.resize(M * K);
+  caffe_cpu_quantize(M * K, bottom_scale, bottom_data, &quantized_bottom_[0]);
+  // top^T = W bottom^T, so each output reads one contiguous weight row.
+  accumulator_.resize(N * M);
+  caffe_cpu_gemm_s8s32(CblasTrans, N, M, K, &quantized_->weight[0],
+      &quantized_bottom_[0], &accumulator_[0]);
+  // Dequantize, add the bias and apply the fused ReLU in one pass.
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int n = 0; n < N; ++n) {
+    const Dtype scale = Dtype(1) / (bottom_scale * quantized_->scale[n]);
+    const Dtype shift = bias ? bias[n] : Dtype(0);
+    const int32_t* acc = &accumulator_[n * M];
+    for (int m = 0; m < M; ++m) {
+      const Dtype out = acc[m] * scale + shift;
+      top_data[m * N + n] = quant_param.relu() ? std::max(out, Dtype(0)) : out;
+    }
+  }
+}
+
+template <typename Dtype>
+void QuantizedInnerProductLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  LOG(FATAL) << "Quantized inner product is inference only; remove "
+      << "quantization_param to train layer " << this->layer_param_.name();
+}
+
+INSTANTIATE_CLASS(QuantizedInnerProductLayer);
+
+}  // namespace caffe
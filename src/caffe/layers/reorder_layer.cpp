@@ -0,0 +1,112 @@
+#include <vector>
+
+#include "caffe/layers/reorder_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Copies NCHW data into the blocked layout, zero filling padding channels.
+template <typename Dtype>
+static void nchw_to_blocked(const Dtype* nchw, const int num,
+    const int channels, const int spatial_dim, const int block,
+    Dtype* blocked) {
+  const int channel_blocks = (channels + block - 1) / block;
+  caffe_set(num * channel_blocks * spatial_dim * block, Dtype(0), blocked);
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* src = nchw + (n * channels + c) * spatial_dim;
+      Dtype* dst = blocked +
+          ((n * channel_blocks + c / block) * spatial_dim) * block + c % block;
+      for (int i = 0; i < spatial_dim; ++i) {
+        dst[i * block] = src[i];
+      }
+    }
+  }
+}
+
+// Copies the logical channels of blocked data back into NCHW.
+template <typename Dtype>
+static void blocked_to_nchw(const Dtype* blocked, const int num,
+    const int channels, const int spatial_dim, const int block,
+    Dtype* nchw) {
+  const int channel_blocks = (channels + block - 1) / block;
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* src = blocked +
+          ((n * channel_blocks + c / block) * spatial_dim) * block + c % block;
+      Dtype* dst = nchw + (n * channels + c) * spatial_dim;
+      for (int i = 0; i < spatial_dim; ++i) {
+        dst[i] = src[i * block];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_NE(top[0], bottom[0]) << this->type() << " Layer does not "
+      "allow in-place computation.";
+  block_ = this->layer_param_.blocked_layout_param().block();
+  CHECK_GT(block_, 0) << "Channel block size must be positive.";
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const int num_axes = bottom[0]->num_axes();
+  CHECK(num_axes == 4 || num_axes == 5) << "Input must have 4 axes (NCHW) "
+      << "or 5 axes (blocked NCHWc), but has " << num_axes;
+  to_blocked_ = (num_axes == 4);
+  num_ = bottom[0]->shape(0);
+  spatial_dim_ = bottom[0]->count(2, 4);
+  vector<int> top_shape(bottom[0]->shape().begin(),
+      bottom[0]->shape().begin() + 4);
+  if (to_blocked_) {
+    channels_ = bottom[0]->shape(1);
+    top_shape[1] = (channels_ + block_ - 1) / block_;
+    top_shape.push_back(block_);
+  } else {
+    const BlockedLayoutParameter& layout_param =
+        this->layer_param_.blocked_layout_param();
+    CHECK_EQ(layout_param.bottom_channels_size(), 1)
+        << "Unblocking requires the logical channel count of the input.";
+    channels_ = layout_param.bottom_channels(0);
+    CHECK_EQ(bottom[0]->shape(4), block_) << "Input block size mismatch.";
+    CHECK_EQ(bottom[0]->shape(1), (channels_ + block_ - 1) / block_)
+        << "Input channel blocks do not match " << channels_ << " channels.";
+    top_shape[1] = channels_;
+  }
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (to_blocked_) {
+    nchw_to_blocked(bottom[0]->cpu_data(), num_, channels_, spatial_dim_,
+        block_, top[0]->mutable_cpu_data());
+  } else {
+    blocked_to_nchw(bottom[0]->cpu_data(), num_, channels_, spatial_dim_,
+        block_, top[0]->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  // The gradient of a reorder is the inverse reorder of the top gradient.
+  if (to_blocked_) {
+    blocked_to_nchw(top[0]->cpu_diff(), num_, channels_, spatial_dim_,
+        block_, bottom[0]->mutable_cpu_diff());
+  } else {
+    nchw_to_blocked(top[0]->cpu_diff(), num_, channels_, spatial_dim_,
+        block_, bottom[0]->mutable_cpu_diff());
+  }
+}
+
+INSTANTIATE_CLASS(ReorderLayer);
+REGISTER_LAYER_CLASS(Reorder);
+
+}  // namespace caffe
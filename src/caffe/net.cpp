@@ -1,4 +1,7 @@
+#include <boost/bind.hpp>
+#include <stdint.h>
 #include <algorithm>
+#include <cstring>
 #include <map>
 #include <set>
 #include <string>
@@ -9,12 +12,18 @@
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fuse_layers.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/insert_reorders.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/optimize_graph.hpp"
+#include "caffe/util/task_graph.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -23,7 +32,7 @@ namespace caffe {
 
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
-    : root_net_(root_net) {
+    : root_net_(root_net), param_source_(NULL) {
   Init(param);
 }
 
@@ -31,7 +40,7 @@ template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase,
     const int level, const vector<string>* stages,
     const Net* root_net)
-    : root_net_(root_net) {
+    : root_net_(root_net), param_source_(NULL) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   // Set phase, stages and level
@@ -45,22 +54,59 @@ Net<Dtype>::Net(const string& param_file, Phase phase,
   Init(param);
 }
 
+template <typename Dtype>
+Net<Dtype>::Net(const Net* param_source)
+    : root_net_(NULL), param_source_(param_source) {
+  Init(param_source->net_param_);
+}
+
 template <typename Dtype>
 void Net<Dtype>::Init(const NetParameter& in_param) {
   CHECK(Caffe::root_solver() || root_net_)
       << "root_net_ needs to be set for all non-root solvers";
   // Set phase from the state.
   phase_ = in_param.state().phase();
+  net_param_.CopyFrom(in_param);
+  for (int i = 0; i < net_param_.layer_size(); ++i) {
+    net_param_.mutable_layer(i)->clear_blobs();
+  }
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
   FilterNet(in_param, &filtered_param);
+  if (filtered_param.output_blob_size() > 0) {
+    NetParameter pruned_param;
+    PruneNet(filtered_param, &pruned_param);
+    filtered_param.Swap(&pruned_param);
+  }
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
-  // Create a copy of filtered_param with splits added where necessary.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  if (filtered_param.optimize_graph() && phase_ == TEST &&
+      !filtered_param.force_backward()) {
+    // Without a backward pass, blobs read more than once need no splits.
+    OptimizeGraph(filtered_param, &param);
+  } else {
+    // Create a copy of filtered_param with splits added where necessary.
+    InsertSplits(filtered_param, &param);
+  }
+  // Switch to the channel-blocked layout where requested; it is implemented
+  // for CPU inference only.
+  if (param.channel_block() > 0 && phase_ == TEST &&
+      Caffe::mode() == Caffe::CPU) {
+    NetParameter blocked_param;
+    InsertReorders(param, &blocked_param);
+    param.Swap(&blocked_param);
+  }
+  // Likewise fold BatchNorm, Scale and ReLU layers into the convolutions
+  // they follow, unless a backward pass needs them to run.
+  if (param.fuse_layers() && phase_ == TEST && !param.force_backward() &&
+      Caffe::mode() == Caffe::CPU) {
+    NetParameter fused_param;
+    FuseLayers(param, &fused_param);
+    param.Swap(&fused_param);
+  }
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -95,6 +141,12 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       layers_[layer_id]->SetShared(true);
     } else {
       layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
+      if (param_source_ && param_source_->has_layer(layer_param.name())) {
+        // Finding its blobs set, the layer checks their shapes and skips
+        // filling its own.
+        layers_[layer_id]->blobs() =
+            param_source_->layer_by_name(layer_param.name())->blobs();
+      }
     }
     layer_names_.push_back(layer_param.name());
     LOG_IF(INFO, Caffe::root_solver())
@@ -264,13 +316,58 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     }
   }
-  // In the end, all remaining blobs are considered output blobs.
-  for (set<string>::iterator it = available_blobs.begin();
-      it != available_blobs.end(); ++it) {
+  // A net that never runs Backward needs no diffs, except where the loss
+  // layers keep their loss weights and scratch data.
+  bool net_needs_backward = false;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    net_needs_backward = net_needs_backward || layer_need_backward_[layer_id];
+    for (int bottom_id = 0; bottom_id < bottom_need_backward_[layer_id].size();
+         ++bottom_id) {
+      net_needs_backward = net_needs_backward ||
+          bottom_need_backward_[layer_id][bottom_id];
+    }
+  }
+  if (!net_needs_backward) {
+    vector<bool> keep_diff(blobs_.size(), false);
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      bool is_loss = false;
+      for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+        is_loss = is_loss ||
+            blob_loss_weights_[top_id_vecs_[layer_id][top_id]] != 0;
+      }
+      if (!is_loss) { continue; }
+      for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+        keep_diff[top_id_vecs_[layer_id][top_id]] = true;
+      }
+      for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+           ++bottom_id) {
+        keep_diff[bottom_id_vecs_[layer_id][bottom_id]] = true;
+      }
+    }
+    for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+      if (!keep_diff[blob_id]) {
+        blobs_[blob_id]->set_forward_only(true);
+      }
+    }
     LOG_IF(INFO, Caffe::root_solver())
-        << "This network produces output " << *it;
-    net_output_blobs_.push_back(blobs_[blob_name_to_idx[*it]].get());
-    net_output_blob_indices_.push_back(blob_name_to_idx[*it]);
+        << "This network does not need backward computation; its blobs "
+        << "keep no diffs.";
+  }
+  // In the end, all remaining blobs are considered output blobs, unless
+  // specific ones were requested.
+  vector<string> output_names(param.output_blob().begin(),
+                              param.output_blob().end());
+  if (output_names.empty()) {
+    output_names.assign(available_blobs.begin(), available_blobs.end());
+  }
+  for (int i = 0; i < output_names.size(); ++i) {
+    CHECK(blob_name_to_idx.count(output_names[i]))
+        << "Unknown output blob " << output_names[i];
+    LOG_IF(INFO, Caffe::root_solver())
+        << "This network produces output " << output_names[i];
+    const int blob_id = blob_name_to_idx[output_names[i]];
+    net_output_blobs_.push_back(blobs_[blob_id].get());
+    net_output_blob_indices_.push_back(blob_id);
   }
   for (size_t blob_id = 0; blob_id < blob_names_.size(); ++blob_id) {
     blob_names_index_[blob_names_[blob_id]] = blob_id;
@@ -278,11 +375,98 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
+  // Give each convolution the layers folded into it. The absorbed layers
+  // keep their parameters (so weights load and share as usual) but are
+  // skipped by the forward pass.
+  layer_fused_.resize(layers_.size());
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const FusionParameter& fusion_param =
+        layers_[layer_id]->layer_param().fusion_param();
+    layer_fused_[layer_id] = fusion_param.has_fused_into();
+    if (fusion_param.folded_layer_size() > 0) {
+      vector<Layer<Dtype>*> folded_layers;
+      for (int i = 0; i < fusion_param.folded_layer_size(); ++i) {
+        folded_layers.push_back(
+            layers_[layer_names_index_[fusion_param.folded_layer(i)]].get());
+      }
+      static_cast<BaseConvolutionLayer<Dtype>*>(layers_[layer_id].get())
+          ->set_folded_layers(folded_layers);
+    }
+  }
+  // Layers that replace their blobs in SetUp (Recurrent) still get the
+  // source's storage.
+  if (param_source_) {
+    ShareTrainedLayersWith(param_source_);
+  }
   ShareWeights();
+  shape_buckets_.clear();
+  for (int i = 0; i < param.shape_bucket_size(); ++i) {
+    const ShapeBucket& bucket = param.shape_bucket(i);
+    CHECK_EQ(bucket.shape_size(), net_input_blobs_.size())
+        << "shape_bucket " << i << " needs one shape per net input.";
+    shape_buckets_.push_back(vector<vector<int> >());
+    for (int j = 0; j < bucket.shape_size(); ++j) {
+      shape_buckets_.back().push_back(
+          vector<int>(bucket.shape(j).dim().begin(),
+                      bucket.shape(j).dim().end()));
+    }
+  }
+  if (!shape_buckets_.empty()) {
+    PlanShapeBuckets();
+  }
+  activations_shared_ = false;
+  if (param.share_activations() && phase_ == TEST) {
+    ShareActivations();
+  }
+  layer_recompute_.assign(layers_.size(), false);
+  recompute_after_.assign(layers_.size(), vector<int>());
+  if (param.recompute_activations() && phase_ == TRAIN) {
+    PlanRecompute();
+  }
+  forward_graph_.reset();
+  if (param.forward_threads() > 1 && phase_ == TEST &&
+      Caffe::mode() == Caffe::CPU) {
+    BuildForwardGraph(param.forward_threads());
+  }
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+// Sums the sizes of the distinct, allocated SyncedMemory in memories.
+static size_t AllocatedBytes(const vector<SyncedMemory*>& memories) {
+  set<const SyncedMemory*> counted;
+  size_t bytes = 0;
+  for (int i = 0; i < memories.size(); ++i) {
+    if (memories[i] && memories[i]->head() != SyncedMemory::UNINITIALIZED &&
+        counted.insert(memories[i]).second) {
+      bytes += memories[i]->size();
+    }
+  }
+  return bytes;
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::blob_data_bytes() const {
+  vector<SyncedMemory*> memories;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    if (blobs_[i]->count() > 0) {
+      memories.push_back(blobs_[i]->data().get());
+    }
+  }
+  return AllocatedBytes(memories);
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::blob_diff_bytes() const {
+  vector<SyncedMemory*> memories;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    if (blobs_[i]->count() > 0 && !blobs_[i]->forward_only()) {
+      memories.push_back(blobs_[i]->diff().get());
+    }
+  }
+  return AllocatedBytes(memories);
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -313,6 +497,45 @@ void Net<Dtype>::FilterNet(const NetParameter& param,
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::PruneNet(const NetParameter& param,
+    NetParameter* param_pruned) {
+  // Walk the layers backward from the requested outputs, keeping each layer
+  // that writes a blob still needed, whose bottoms are then needed in turn.
+  set<string> needed(param.output_blob().begin(), param.output_blob().end());
+  set<string> known(param.input().begin(), param.input().end());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    known.insert(param.layer(i).top().begin(), param.layer(i).top().end());
+  }
+  for (set<string>::const_iterator it = needed.begin(); it != needed.end();
+       ++it) {
+    CHECK(known.count(*it)) << "Unknown output blob " << *it;
+  }
+  vector<bool> keep(param.layer_size(), false);
+  for (int i = param.layer_size() - 1; i >= 0; --i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; !keep[i] && j < layer_param.top_size(); ++j) {
+      keep[i] = needed.count(layer_param.top(j)) > 0;
+    }
+    if (!keep[i]) {
+      LOG_IF(INFO, Caffe::root_solver()) << "Pruning layer "
+          << layer_param.name() << ", which no requested output needs";
+      continue;
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      needed.erase(layer_param.top(j));
+    }
+    needed.insert(layer_param.bottom().begin(), layer_param.bottom().end());
+  }
+  param_pruned->CopyFrom(param);
+  param_pruned->clear_layer();
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (keep[i]) {
+      param_pruned->add_layer()->CopyFrom(param.layer(i));
+    }
+  }
+}
+
 template <typename Dtype>
 bool Net<Dtype>::StateMeetsRule(const NetState& state,
     const NetStateRule& rule, const string& layer_name) {
@@ -426,7 +649,10 @@ int Net<Dtype>::AppendBottom(const NetParameter& param, const int layer_id,
     map<string, int>* blob_name_to_idx) {
   const LayerParameter& layer_param = param.layer(layer_id);
   const string& blob_name = layer_param.bottom(bottom_id);
-  if (available_blobs->find(blob_name) == available_blobs->end()) {
+  // Blobs are read by a single layer unless the net is optimized for
+  // inference (see OptimizeGraph), so look them up among all blobs, not just
+  // the yet unread ones.
+  if (blob_name_to_idx->find(blob_name) == blob_name_to_idx->end()) {
     LOG(FATAL) << "Unknown bottom blob '" << blob_name << "' (layer '"
                << layer_param.name() << "', bottom index " << bottom_id << ")";
   }
@@ -540,16 +766,292 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+// Returns the representative of blob i's storage group in the union-find
+// forest group, halving the path on the way.
+static int FindStorageGroup(vector<int>* group, int i) {
+  while ((*group)[i] != i) {
+    (*group)[i] = (*group)[(*group)[i]];
+    i = (*group)[i];
+  }
+  return i;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareActivations() {
+  const int num_blobs = blobs_.size();
+  // Group the blobs that use the same storage: those already sharing their
+  // data (Flatten, Reshape, ...) and the tops of Split layers, which take
+  // their bottom's data in Forward. Each group gets a single buffer, which
+  // must stay live from the first layer using any of its blobs to the last.
+  vector<int> group(num_blobs);
+  map<const SyncedMemory*, int> memory_group;
+  map<const SyncedMemory*, int> memory_holders;
+  for (int i = 0; i < num_blobs; ++i) {
+    group[i] = i;
+    if (blobs_[i]->count() > 0) {
+      const SyncedMemory* memory = blobs_[i]->data().get();
+      group[i] = memory_group.insert(make_pair(memory, i)).first->second;
+      ++memory_holders[memory];
+    }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (string(layers_[layer_id]->type()) != "Split") { continue; }
+    const int bottom_group =
+        FindStorageGroup(&group, bottom_id_vecs_[layer_id][0]);
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      group[FindStorageGroup(&group, top_id_vecs_[layer_id][top_id])] =
+          bottom_group;
+    }
+  }
+  vector<int> first_use(num_blobs, -1);
+  vector<int> last_use(num_blobs, -1);
+  vector<size_t> group_bytes(num_blobs, 0);
+  vector<bool> shareable(num_blobs, true);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int pass = 0; pass < 2; ++pass) {
+      const vector<int>& blob_ids =
+          pass ? top_id_vecs_[layer_id] : bottom_id_vecs_[layer_id];
+      for (int j = 0; j < blob_ids.size(); ++j) {
+        const int g = FindStorageGroup(&group, blob_ids[j]);
+        if (first_use[g] < 0) { first_use[g] = layer_id; }
+        last_use[g] = layer_id;
+        // Tops of layers without bottoms (Input, data layers, ...) are
+        // filled outside the forward pass and must keep their storage.
+        if (pass && bottom_id_vecs_[layer_id].empty()) {
+          shareable[g] = false;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    shareable[FindStorageGroup(&group, net_input_blob_indices_[i])] = false;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    shareable[FindStorageGroup(&group, net_output_blob_indices_[i])] = false;
+  }
+  for (int i = 0; i < num_blobs; ++i) {
+    const int g = FindStorageGroup(&group, i);
+    if (blobs_[i]->count() == 0) {
+      shareable[g] = false;
+      continue;
+    }
+    // Storage also held outside the net's blobs, such as a top exposing a
+    // layer's internal buffer, cannot be given to another blob.
+    const shared_ptr<SyncedMemory>& memory = blobs_[i]->data();
+    if (memory.use_count() > memory_holders[memory.get()]) {
+      shareable[g] = false;
+    }
+    group_bytes[g] = std::max(group_bytes[g], memory->size());
+  }
+  // Assign the groups to buffers in order of their first use, reusing a
+  // buffer once the last group in it is dead. Of the free buffers, take the
+  // smallest one that is large enough, or else grow the largest.
+  vector<pair<int, int> > groups_by_first_use;
+  for (int i = 0; i < num_blobs; ++i) {
+    if (group[i] == i && shareable[i] && first_use[i] >= 0) {
+      groups_by_first_use.push_back(make_pair(first_use[i], i));
+    }
+  }
+  std::sort(groups_by_first_use.begin(), groups_by_first_use.end());
+  vector<size_t> buffer_bytes;
+  vector<int> buffer_last_use;
+  vector<int> group_buffer(num_blobs, -1);
+  for (int i = 0; i < groups_by_first_use.size(); ++i) {
+    const int g = groups_by_first_use[i].second;
+    int best = -1;
+    for (int b = 0; b < buffer_bytes.size(); ++b) {
+      if (buffer_last_use[b] >= first_use[g]) { continue; }
+      const bool fits = buffer_bytes[b] >= group_bytes[g];
+      const bool best_fits = best >= 0 && buffer_bytes[best] >= group_bytes[g];
+      if (best < 0 || (fits && (!best_fits ||
+          buffer_bytes[b] < buffer_bytes[best])) ||
+          (!fits && !best_fits && buffer_bytes[b] > buffer_bytes[best])) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      best = buffer_bytes.size();
+      buffer_bytes.push_back(0);
+      buffer_last_use.push_back(-1);
+    }
+    buffer_bytes[best] = std::max(buffer_bytes[best], group_bytes[g]);
+    buffer_last_use[best] = last_use[g];
+    group_buffer[g] = best;
+  }
+  vector<shared_ptr<SyncedMemory> > buffers(buffer_bytes.size());
+  size_t shared_bytes = 0;
+  for (int b = 0; b < buffers.size(); ++b) {
+    buffers[b].reset(new SyncedMemory(buffer_bytes[b]));
+    shared_bytes += buffer_bytes[b];
+  }
+  set<const SyncedMemory*> replaced;
+  size_t replaced_bytes = 0;
+  for (int i = 0; i < num_blobs; ++i) {
+    const int b = group_buffer[FindStorageGroup(&group, i)];
+    if (b < 0) { continue; }
+    if (replaced.insert(blobs_[i]->data().get()).second) {
+      replaced_bytes += blobs_[i]->data()->size();
+    }
+    blobs_[i]->set_data(buffers[b]);
+  }
+  activations_shared_ = true;
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Sharing " << replaced_bytes << " bytes of activations in "
+      << buffers.size() << " buffers of " << shared_bytes << " bytes total.";
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanRecompute() {
+  const int num_blobs = blobs_.size();
+  vector<int> last_reader(num_blobs, -1);
+  vector<int> last_writer(num_blobs, -1);
+  vector<bool> read_by_split(num_blobs, false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const bool split = string(layers_[layer_id]->type()) == "Split";
+    for (int j = 0; j < bottom_id_vecs_[layer_id].size(); ++j) {
+      last_reader[bottom_id_vecs_[layer_id][j]] = layer_id;
+      read_by_split[bottom_id_vecs_[layer_id][j]] =
+          read_by_split[bottom_id_vecs_[layer_id][j]] || split;
+    }
+    for (int j = 0; j < top_id_vecs_[layer_id].size(); ++j) {
+      last_writer[top_id_vecs_[layer_id][j]] = layer_id;
+    }
+  }
+  vector<bool> is_output(num_blobs, false);
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    is_output[net_output_blob_indices_[i]] = true;
+  }
+  vector<bool> recomputed(num_blobs, false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    // Only layers that are cheap to run again, and give the same top when
+    // they do, are worth recomputing.
+    const LayerParameter& layer_param = layers_[layer_id]->layer_param();
+    const string type = layers_[layer_id]->type();
+    const bool cheap = type == "ReLU" || type == "LRN" ||
+        (type == "Pooling" && layer_param.pooling_param().pool() !=
+         PoolingParameter_PoolMethod_STOCHASTIC) ||
+        (type == "BatchNorm" &&
+         layer_param.batch_norm_param().use_global_stats());
+    if (!cheap || top_id_vecs_[layer_id].size() != 1 ||
+        bottom_id_vecs_[layer_id].empty()) {
+      continue;
+    }
+    // The top must be an intermediate result, not computed in place and not
+    // changed afterwards, read by later layers directly rather than through
+    // a Split, which would keep sharing its data.
+    const int top = top_id_vecs_[layer_id][0];
+    if (is_output[top] || last_reader[top] <= layer_id ||
+        last_writer[top] != layer_id || read_by_split[top]) {
+      continue;
+    }
+    // The bottoms must still hold the same values when Backward reaches the
+    // layer again.
+    bool bottoms_kept = true;
+    for (int j = 0; j < bottom_id_vecs_[layer_id].size(); ++j) {
+      const int bottom = bottom_id_vecs_[layer_id][j];
+      bottoms_kept = bottoms_kept && !recomputed[bottom] &&
+          last_writer[bottom] < layer_id;
+    }
+    if (!bottoms_kept) { continue; }
+    recomputed[top] = true;
+    layer_recompute_[layer_id] = true;
+    recompute_after_[last_reader[top]].push_back(layer_id);
+    LOG_IF(INFO, Caffe::root_solver())
+        << layer_names_[layer_id] << " recomputes its top in Backward.";
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseTops(const int layer_id) {
+  for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
+    Blob<Dtype>* top = top_vecs_[layer_id][top_id];
+    // Keep data still shared with another blob, like a Flatten layer's top.
+    if (top->count() > 0 && top->data().use_count() == 1) {
+      top->set_data(shared_ptr<SyncedMemory>(
+          new SyncedMemory(top->data()->size())));
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::BuildForwardGraph(const int num_threads) {
+  // Blobs sharing their data, like a Flatten layer's top and bottom, or a
+  // Split layer's tops and bottom, count as one for the dependencies.
+  const int num_blobs = blobs_.size();
+  vector<int> storage(num_blobs);
+  map<const SyncedMemory*, int> memory_storage;
+  for (int i = 0; i < num_blobs; ++i) {
+    storage[i] = i;
+    if (blobs_[i]->count() > 0) {
+      storage[i] = memory_storage.insert(
+          make_pair(blobs_[i]->data().get(), i)).first->second;
+    }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (string(layers_[layer_id]->type()) != "Split") { continue; }
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      storage[top_id_vecs_[layer_id][top_id]] =
+          storage[bottom_id_vecs_[layer_id][0]];
+    }
+  }
+  // Each layer waits for the last layer to write the storage it reads or
+  // writes, and for the layers reading the storage it writes since then.
+  forward_graph_.reset(new TaskGraph(layers_.size(), num_threads));
+  vector<int> last_writer(num_blobs, -1);
+  vector<vector<int> > readers(num_blobs);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    set<int> dependencies;
+    for (int j = 0; j < bottom_id_vecs_[layer_id].size(); ++j) {
+      const int s = storage[bottom_id_vecs_[layer_id][j]];
+      if (last_writer[s] >= 0) { dependencies.insert(last_writer[s]); }
+      readers[s].push_back(layer_id);
+    }
+    for (int j = 0; j < top_id_vecs_[layer_id].size(); ++j) {
+      const int s = storage[top_id_vecs_[layer_id][j]];
+      if (last_writer[s] >= 0) { dependencies.insert(last_writer[s]); }
+      dependencies.insert(readers[s].begin(), readers[s].end());
+      last_writer[s] = layer_id;
+      readers[s].clear();
+    }
+    dependencies.erase(layer_id);
+    for (set<int>::const_iterator it = dependencies.begin();
+         it != dependencies.end(); ++it) {
+      forward_graph_->AddDependency(*it, layer_id);
+    }
+  }
+  layer_losses_.resize(layers_.size());
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Running the forward pass on " << num_threads << " threads.";
+}
+
+template <typename Dtype>
+void Net<Dtype>::ForwardLayer(const int layer_id) {
+  layer_losses_[layer_id] = layer_fused_[layer_id] ? Dtype(0) :
+      layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
   Dtype loss = 0;
+  if (forward_graph_ && !debug_info_) {
+    forward_graph_->Run(start, end,
+        boost::bind(&Net<Dtype>::ForwardLayer, this, _1));
+    for (int i = start; i <= end; ++i) {
+      loss += layer_losses_[i];
+    }
+    return loss;
+  }
   for (int i = start; i <= end; ++i) {
+    if (layer_fused_[i]) { continue; }
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
+    for (int j = 0; j < recompute_after_[i].size(); ++j) {
+      ReleaseTops(recompute_after_[i][j]);
+    }
   }
   return loss;
 }
@@ -590,12 +1092,19 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  CHECK(!activations_shared_)
+      << "Backward is not supported by nets with share_activations set.";
   for (int i = start; i >= end; --i) {
+    for (int j = 0; j < recompute_after_[i].size(); ++j) {
+      const int layer_id = recompute_after_[i][j];
+      layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    }
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
     }
+    if (layer_recompute_[i]) { ReleaseTops(i); }
   }
 }
 
@@ -739,6 +1248,17 @@ void Net<Dtype>::Backward() {
   }
 }
 
+template <typename Dtype>
+shared_ptr<Net<Dtype> > Net<Dtype>::CreateExecutor() const {
+  CHECK_EQ(phase_, TEST) << "Only TEST-phase nets can create executors.";
+  // Bring the weights to the host now so that executors running
+  // concurrently only ever read them.
+  for (int i = 0; i < params_.size(); ++i) {
+    params_[i]->cpu_data();
+  }
+  return shared_ptr<Net<Dtype> >(new Net<Dtype>(this));
+}
+
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
@@ -746,6 +1266,65 @@ void Net<Dtype>::Reshape() {
   }
 }
 
+template <typename Dtype>
+int Net<Dtype>::FindShapeBucket(
+    const vector<vector<int> >& input_shapes) const {
+  CHECK_EQ(input_shapes.size(), net_input_blobs_.size())
+      << "Need one shape per net input.";
+  int best = -1;
+  size_t best_count = 0;
+  for (int b = 0; b < shape_buckets_.size(); ++b) {
+    bool fits = true;
+    size_t count = 0;
+    for (int i = 0; fits && i < input_shapes.size(); ++i) {
+      const vector<int>& shape = shape_buckets_[b][i];
+      fits = shape.size() == input_shapes[i].size();
+      size_t input_count = 1;
+      for (int j = 0; fits && j < shape.size(); ++j) {
+        fits = input_shapes[i][j] <= shape[j];
+        input_count *= shape[j];
+      }
+      count += input_count;
+    }
+    if (fits && (best < 0 || count < best_count)) {
+      best = b;
+      best_count = count;
+    }
+  }
+  return best;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReshapeToBucket(const int bucket) {
+  CHECK_GE(bucket, 0);
+  CHECK_LT(bucket, shape_buckets_.size());
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    net_input_blobs_[i]->Reshape(shape_buckets_[bucket][i]);
+  }
+  Reshape();
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanShapeBuckets() {
+  // Blobs only reallocate to grow, so after reshaping the net to every
+  // bucket each has the capacity the largest one needs, and switching
+  // between buckets later allocates nothing. Storage is only allocated when
+  // first used, so this costs little beyond the layers' Reshape calls.
+  vector<vector<int> > input_shapes;
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    input_shapes.push_back(net_input_blobs_[i]->shape());
+  }
+  for (int b = 0; b < shape_buckets_.size(); ++b) {
+    ReshapeToBucket(b);
+  }
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    net_input_blobs_[i]->Reshape(input_shapes[i]);
+  }
+  Reshape();
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Sized the blobs for " << shape_buckets_.size() << " shape buckets.";
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
   int num_source_layers = param.layer_size();
@@ -797,9 +1376,96 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
     const string trained_filename) {
-  NetParameter param;
-  ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+  // Rather than parse the whole file, map it and find the blobs in it. Float
+  // weights that are suitably aligned (see WriteNetParamsToAlignedBinaryFile)
+  // are then used in place, and the others copied from the mapping. The file
+  // must then not be truncated or written over in place while the net lives
+  // (see MappedFile); replace it by renaming a new file over it.
+  shared_ptr<MappedFile> file(new MappedFile(trained_filename));
+  vector<IndexedLayer> source_layers;
+  if (!IndexBinaryNetParams(file->data(), file->size(), &source_layers)) {
+    NetParameter param;
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+    CopyTrainedLayersFrom(param);
+    return;
+  }
+  size_t mapped_bytes = 0;
+  size_t copied_bytes = 0;
+  for (int i = 0; i < source_layers.size(); ++i) {
+    const string& source_layer_name = source_layers[i].name;
+    if (!layer_names_index_.count(source_layer_name)) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    const vector<IndexedBlob>& source_blobs = source_layers[i].blobs;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[layer_names_index_[source_layer_name]]->blobs();
+    CHECK_EQ(target_blobs.size(), source_blobs.size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const BlobProto& header = source_blobs[j].header;
+      Blob<Dtype>* target_blob = target_blobs[j].get();
+      if (!target_blob->ShapeEquals(header)) {
+        Blob<Dtype> source_blob;
+        if (header.has_num() || header.has_channels() ||
+            header.has_height() || header.has_width()) {
+          source_blob.Reshape(header.num(), header.channels(),
+                              header.height(), header.width());
+        } else {
+          source_blob.Reshape(header.shape());
+        }
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << source_blob.shape_string() << "; target param shape is "
+            << target_blob->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      const int count = target_blob->count();
+      if (header.double_data_size() > 0) {
+        CHECK_EQ(count, header.double_data_size());
+        Dtype* data = target_blob->mutable_cpu_data();
+        for (int k = 0; k < count; ++k) {
+          data[k] = header.double_data(k);
+        }
+      } else {
+        CHECK_EQ(count * sizeof(float), source_blobs[j].data_bytes)
+            << "Incorrect data size for param " << j << " of layer "
+            << source_layer_name;
+        char* source_data = file->data() + source_blobs[j].data_offset;
+        if (sizeof(Dtype) == sizeof(float) &&
+            reinterpret_cast<uintptr_t>(source_data) % sizeof(float) == 0) {
+          target_blob->data()->set_cpu_data(source_data, file);
+          mapped_bytes += count * sizeof(float);
+        } else {
+          Dtype* data = target_blob->mutable_cpu_data();
+          for (int k = 0; k < count; ++k) {
+            float value;
+            memcpy(&value, source_data + k * sizeof(float), sizeof(float));
+            data[k] = value;
+          }
+          copied_bytes += count * sizeof(float);
+        }
+      }
+      if (header.double_diff_size() > 0) {
+        CHECK_EQ(count, header.double_diff_size());
+        Dtype* diff = target_blob->mutable_cpu_diff();
+        for (int k = 0; k < count; ++k) {
+          diff[k] = header.double_diff(k);
+        }
+      } else if (header.diff_size() > 0) {
+        CHECK_EQ(count, header.diff_size());
+        Dtype* diff = target_blob->mutable_cpu_diff();
+        for (int k = 0; k < count; ++k) {
+          diff[k] = header.diff(k);
+        }
+      }
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Mapped " << mapped_bytes
+      << " bytes and copied " << copied_bytes << " bytes of weights from "
+      << trained_filename;
 }
 
 template <typename Dtype>
@@ -7,6 +7,7 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -454,7 +455,7 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
   net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
+  WriteNetParamsToAlignedBinaryFile(net_param, model_filename);
   return model_filename;
 }
 
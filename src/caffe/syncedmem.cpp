@@ -4,6 +4,15 @@
 
 namespace caffe {
 
+// The versions handed out so far, shared by all memory. Every write to a
+// SyncedMemory takes a new one, so it is taken with an atomic increment
+// rather than a lock.
+static uint64_t last_version = 0;
+
+void SyncedMemory::UpdateVersion() {
+  version_ = __sync_add_and_fetch(&last_version, 1);
+}
+
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
@@ -140,13 +149,19 @@ const void* SyncedMemory::cpu_data() {
 }
 
 void SyncedMemory::set_cpu_data(void* data) {
+  set_cpu_data(data, shared_ptr<void>());
+}
+
+void SyncedMemory::set_cpu_data(void* data, const shared_ptr<void>& owner) {
   CHECK(data);
   if (own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
   }
   cpu_ptr_ = data;
+  cpu_data_owner_ = owner;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  UpdateVersion();
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -183,6 +198,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  UpdateVersion();
 #else
   NO_GPU;
 #endif
@@ -191,6 +207,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
   head_ = HEAD_AT_CPU;
+  UpdateVersion();
   return cpu_ptr_;
 }
 
@@ -198,6 +215,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  UpdateVersion();
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -209,6 +227,7 @@ void* SyncedMemory::mutable_ocl_data() {
 #ifdef USE_OCL
   to_ocl(1);
   head_ = HEAD_AT_OCL;
+  UpdateVersion();
   return ocl_ptr_;
 #else
   NO_OCL;
@@ -219,6 +238,7 @@ void* SyncedMemory::mutable_ocl_data(int RW) {
 #ifdef USE_OCL
   to_ocl(RW);
   head_ = HEAD_AT_OCL;
+  UpdateVersion();
   return ocl_ptr_;
 #else
   NO_OCL;
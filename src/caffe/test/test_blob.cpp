@@ -5,6 +5,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -68,6 +69,56 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestForwardOnly) {
+  Blob<TypeParam>* blob = this->blob_preshaped_;
+  blob->set_forward_only(true);
+  EXPECT_TRUE(blob->forward_only());
+  // Growing the blob allocates new data but still no diff.
+  blob->Reshape(3, 3, 4, 5);
+  EXPECT_TRUE(blob->mutable_cpu_data());
+  EXPECT_EQ(0, blob->asum_diff());
+  // Sharing diffs with a blob that has one leaves both as they were.
+  Blob<TypeParam> other(3, 3, 4, 5);
+  caffe_set(other.count(), TypeParam(1), other.mutable_cpu_diff());
+  blob->ShareDiff(other);
+  EXPECT_EQ(0, blob->asum_diff());
+  other.ShareDiff(*blob);
+  EXPECT_EQ(180, other.asum_diff());
+  blob->set_forward_only(false);
+  EXPECT_EQ(180 * sizeof(TypeParam), blob->diff()->size());
+}
+
+TYPED_TEST(BlobSimpleTest, TestForwardOnlyLazyDiff) {
+  Blob<TypeParam>* blob = this->blob_preshaped_;
+  blob->set_forward_only(true);
+  // A diff asked for is allocated then, zeroed.
+  const TypeParam* diff = blob->cpu_diff();
+  for (int i = 0; i < blob->count(); ++i) {
+    EXPECT_EQ(0, diff[i]);
+  }
+  caffe_set(blob->count(), TypeParam(1), blob->mutable_cpu_diff());
+  EXPECT_EQ(blob->count(), blob->asum_diff());
+  // Growing the blob drops it again.
+  blob->Reshape(3, 3, 4, 5);
+  EXPECT_EQ(0, blob->asum_diff());
+  EXPECT_EQ(180 * sizeof(TypeParam), blob->diff()->size());
+}
+
+TYPED_TEST(BlobSimpleTest, TestShapeVersion) {
+  Blob<TypeParam>* blob = this->blob_preshaped_;
+  const uint64_t version = blob->shape_version();
+  EXPECT_NE(this->blob_->shape_version(), version);
+  blob->Reshape(2, 3, 4, 5);
+  EXPECT_EQ(version, blob->shape_version());
+  blob->Reshape(2, 3, 5, 4);
+  const uint64_t reshaped_version = blob->shape_version();
+  EXPECT_NE(version, reshaped_version);
+  // Reshaping back does not restore the old version.
+  blob->Reshape(2, 3, 4, 5);
+  EXPECT_NE(version, blob->shape_version());
+  EXPECT_NE(reshaped_version, blob->shape_version());
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +7,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/quantized_conv_layer.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -500,6 +502,42 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestQuantizedConvolutionGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  // No bottom_range: the input range is measured on the fly.
+  layer_param.mutable_quantization_param()->set_relu(true);
+  shared_ptr<Layer<Dtype> > layer(
+      new QuantizedConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass == 1) {
+      // Changing the weights must invalidate the int8 copy.
+      caffe_scal<Dtype>(layer->blobs()[0]->count(), Dtype(-1),
+          layer->blobs()[0]->mutable_cpu_data());
+    }
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Check against the float reference convolution, rectified, to within
+    // quantization error.
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], std::max(ref_top_data[i], Dtype(0)), 0.15);
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
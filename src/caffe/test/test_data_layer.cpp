@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -11,7 +12,9 @@
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/tensor_record.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -28,6 +31,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
       : backend_(DataParameter_DB_LEVELDB),
         blob_top_data_(new Blob<Dtype>()),
         blob_top_label_(new Blob<Dtype>()),
+        decode_threads_(1),
         seed_(1701) {}
   virtual void SetUp() {
     filename_.reset(new string());
@@ -75,6 +79,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads_);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -180,6 +185,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads_);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -231,6 +237,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads_);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -336,6 +343,226 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // Checks that the labels of the next batches read by a layer reading
+  // records labelled by Fill follow labels.
+  void CheckLabels(const LayerParameter& param, const int* labels,
+      const int num_labels) {
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    const int batch_size = param.data_param().batch_size();
+    for (int i = 0; i < num_labels; i += batch_size) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int j = 0; j < batch_size && i + j < num_labels; ++j) {
+        EXPECT_EQ(labels[i + j], blob_top_label_->cpu_data()[j])
+            << "debug: item " << i + j;
+      }
+    }
+  }
+
+  void TestReadKeyRanges() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_reader_threads(2);
+    // Keys 0 and 1 are read by one thread, 2 to 4 by the other, each
+    // wrapping around its own range, and taken from in proportion to their
+    // sizes: every record once in 5.
+    const int labels[] = { 2, 0, 3, 1, 4, 2, 0, 3, 1, 4 };
+    CheckLabels(param, labels, 10);
+    // With more threads than keys, each key is read by a thread of its own,
+    // and none twice as often as the others.
+    data_param->set_reader_threads(8);
+    const int single_labels[] = { 0, 1, 2, 3, 4, 0, 1, 2, 3, 4 };
+    CheckLabels(param, single_labels, 10);
+  }
+
+  void TestReadShards() {
+    // A second shard, whose labels start at 10.
+    const string source2 = *filename_ + "_2";
+    scoped_ptr<db::DB> db(db::GetDB(backend_));
+    db->Open(source2, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < 3; ++i) {
+      Datum datum;
+      datum.set_label(10 + i);
+      datum.set_channels(2);
+      datum.set_height(3);
+      datum.set_width(4);
+      datum.mutable_data()->assign(24, static_cast<char>(i));
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(format_int(i), out);
+    }
+    txn->Commit();
+    db->Close();
+
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(4);
+    data_param->add_shard(*filename_);
+    data_param->add_shard(source2);
+    data_param->set_backend(backend_);
+    // The shards are taken from in proportion to their sizes, 5 and 3: every
+    // record once in 8.
+    const int labels[] = { 0, 10, 1, 2, 11, 3, 12, 4, 0, 10, 1, 2 };
+    CheckLabels(param, labels, 12);
+  }
+
+  void TestReadShuffle() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    data_param->set_read_ahead(2);
+
+    // Every epoch, one batch here, reads each record once, in an order that
+    // depends on the random seed only.
+    vector<vector<int> > epochs;
+    Caffe::set_random_seed(seed_);
+    {
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 10; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        vector<int> labels(blob_top_label_->cpu_data(),
+            blob_top_label_->cpu_data() + 5);
+        epochs.push_back(labels);
+        std::sort(labels.begin(), labels.end());
+        for (int i = 0; i < 5; ++i) {
+          EXPECT_EQ(i, labels[i]);
+        }
+      }
+    }
+    bool reshuffled = false;
+    for (int iter = 1; iter < epochs.size(); ++iter) {
+      reshuffled = reshuffled || epochs[iter] != epochs[0];
+    }
+    EXPECT_TRUE(reshuffled);
+
+    Caffe::set_random_seed(seed_);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int iter = 0; iter < epochs.size(); ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(epochs[iter][i], blob_top_label_->cpu_data()[i]);
+      }
+    }
+  }
+
+  void TestReadMultiLabel(DataParameter_DB backend) {
+    const int num_inputs = 5;
+    const int label_size = 3;
+    // Save data with 1 to label_size labels, every other as a tensor record.
+    LOG(INFO) << "Using temporary dataset " << *filename_;
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(*filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < num_inputs; ++i) {
+      Datum datum;
+      datum.set_channels(1);
+      datum.set_height(2);
+      datum.set_width(2);
+      datum.set_data(string(4, static_cast<char>(i)));
+      for (int j = 0; j < i % label_size + 1; ++j) {
+        datum.add_labels(i + j * 0.5);
+      }
+      string out;
+      if (i % 2) {
+        DatumToTensorRecord(datum, &out);
+      } else {
+        CHECK(datum.SerializeToString(&out));
+      }
+      txn->Put(format_int(i), out);
+    }
+    txn->Commit();
+    db->Close();
+
+    LayerParameter param;
+    param.set_phase(TEST);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(num_inputs);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend);
+    data_param->set_label_size(label_size);
+    data_param->set_decode_threads(decode_threads_);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(2, blob_top_label_->num_axes());
+    EXPECT_EQ(num_inputs, blob_top_label_->shape(0));
+    EXPECT_EQ(label_size, blob_top_label_->shape(1));
+    for (int iter = 0; iter < 3; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < num_inputs; ++i) {
+        for (int j = 0; j < label_size; ++j) {
+          const Dtype label = j <= i % label_size ? i + j * 0.5 : -1;
+          EXPECT_EQ(label, blob_top_label_->cpu_data()[i * label_size + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
+      }
+    }
+  }
+
+  void TestReadLegacyLabel(DataParameter_DB backend) {
+    const int num_inputs = 4;
+    const int label_size = 3;
+    // Save data with a label but no labels, as written before multi-label
+    // data, but for the last which has both; every other as a tensor record.
+    LOG(INFO) << "Using temporary dataset " << *filename_;
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(*filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < num_inputs; ++i) {
+      Datum datum;
+      datum.set_channels(1);
+      datum.set_height(2);
+      datum.set_width(2);
+      datum.set_data(string(4, static_cast<char>(i)));
+      datum.set_label(i);
+      if (i == num_inputs - 1) {
+        datum.add_labels(0.5);
+      }
+      string out;
+      if (i % 2) {
+        DatumToTensorRecord(datum, &out);
+      } else {
+        CHECK(datum.SerializeToString(&out));
+      }
+      txn->Put(format_int(i), out);
+    }
+    txn->Commit();
+    db->Close();
+
+    LayerParameter param;
+    param.set_phase(TEST);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(num_inputs);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend);
+    data_param->set_label_size(label_size);
+    data_param->set_decode_threads(decode_threads_);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    for (int i = 0; i < num_inputs; ++i) {
+      // The label is the first of the row, unless there are labels.
+      const Dtype first = i == num_inputs - 1 ? 0.5 : i;
+      EXPECT_EQ(first, blob_top_label_->cpu_data()[i * label_size]);
+      for (int j = 1; j < label_size; ++j) {
+        EXPECT_EQ(-1, blob_top_label_->cpu_data()[i * label_size + j]);
+      }
+    }
+  }
+
   virtual ~DataLayerTest() { delete blob_top_data_; delete blob_top_label_; }
 
   DataParameter_DB backend_;
@@ -344,6 +571,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
   Blob<Dtype>* const blob_top_label_;
   vector<Blob<Dtype>*> blob_bottom_vec_;
   vector<Blob<Dtype>*> blob_top_vec_;
+  int decode_threads_;
   int seed_;
 };
 
@@ -360,6 +588,14 @@ TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
 
+TYPED_TEST(DataLayerTest, TestReadMultiLabelLevelDB) {
+  this->TestReadMultiLabel(DataParameter_DB_LEVELDB);
+}
+
+TYPED_TEST(DataLayerTest, TestReadLegacyLabelLevelDB) {
+  this->TestReadLegacyLabel(DataParameter_DB_LEVELDB);
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLevelDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
@@ -400,6 +636,14 @@ TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
 
+TYPED_TEST(DataLayerTest, TestReadMultiLabelLMDB) {
+  this->TestReadMultiLabel(DataParameter_DB_LMDB);
+}
+
+TYPED_TEST(DataLayerTest, TestReadLegacyLabelLMDB) {
+  this->TestReadLegacyLabel(DataParameter_DB_LMDB);
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLMDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LMDB);
@@ -428,6 +672,47 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   this->TestReadCrop(TEST);
 }
 
+TYPED_TEST(DataLayerTest, TestReadThreadsLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainThreadsLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestReadCrop(TRAIN);
+}
+
+// Test that the sequence of random crops is consistent when using
+// Caffe::set_random_seed, whatever the order the decode threads run in.
+TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededThreadsLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestReadCropTrainSequenceSeeded();
+}
+
+TYPED_TEST(DataLayerTest, TestReadKeyRangesLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadKeyRanges();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardsLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShards();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShuffle();
+}
+
 #endif  // USE_LMDB
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -258,6 +259,63 @@ TYPED_TEST(DataTransformTest, TestCropMirrorTest) {
 }
 
 
+TYPED_TEST(DataTransformTest, TestCropMirrorMeanScaleFloat) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int label = 0;
+  const int channels = 3;
+  const int height = 6;
+  const int width = 7;
+  const int crop_size = 4;
+  const TypeParam scale = 0.5;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(scale);
+  transform_param.add_mean_value(1);
+  transform_param.add_mean_value(2);
+  transform_param.add_mean_value(3);
+  Datum datum;
+  FillDatum(label, channels, height, width, unique_pixels, &datum);
+  // The same pixels stored as floats must transform identically.
+  Datum float_datum(datum);
+  float_datum.clear_data();
+  for (int j = 0; j < datum.data().size(); ++j) {
+    float_datum.add_float_data(static_cast<uint8_t>(datum.data()[j]));
+  }
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  Blob<TypeParam> float_blob(1, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  DataTransformer<TypeParam> float_transformer(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  Caffe::set_random_seed(this->seed_);
+  float_transformer.InitRand();
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(datum, &blob);
+    float_transformer.Transform(float_datum, &float_blob);
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], float_blob.cpu_data()[j]);
+    }
+    // Each row is a run of consecutive source pixels, forwards or mirrored,
+    // with the channel's mean removed and scaled.
+    const TypeParam* data = blob.cpu_data();
+    const TypeParam step = data[1] - data[0];
+    EXPECT_EQ(scale, std::abs(step));
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < crop_size; ++h) {
+        const TypeParam* row = data + blob.offset(0, c, h);
+        const TypeParam pixel = row[0] / scale + (c + 1);
+        EXPECT_GE(pixel, c * height * width);
+        EXPECT_LT(pixel, (c + 1) * height * width);
+        for (int w = 1; w < crop_size; ++w) {
+          EXPECT_EQ(step, row[w] - row[w - 1]);
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(DataTransformTest, TestMeanValue) {
   TransformationParameter transform_param;
   const bool unique_pixels = false;  // pixels are equal to label
@@ -1,5 +1,7 @@
 #if defined(USE_LEVELDB) && defined(USE_LMDB) && defined(USE_OPENCV)
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
+#include <vector>
 
 #include "boost/scoped_ptr.hpp"
 #include "gtest/gtest.h"
@@ -93,6 +95,24 @@ TYPED_TEST(DBTest, TestSeekToFirst) {
   EXPECT_EQ(datum.width(), 480);
 }
 
+TYPED_TEST(DBTest, TestSeek) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  cursor->Seek("fish-bike.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  // Seeking a missing key moves to the next one.
+  cursor->Seek("d");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  cursor->Seek("a");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "cat.jpg");
+  cursor->Seek("g");
+  EXPECT_FALSE(cursor->valid());
+}
+
 TYPED_TEST(DBTest, TestKeyValue) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::READ);
@@ -117,6 +137,102 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueInPlace) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  const char* first_data;
+  size_t first_size;
+  cursor->value(&first_data, &first_size);
+  EXPECT_EQ(cursor->value(), string(first_data, first_size));
+  const string first_value = cursor->value();
+  cursor->Next();
+  const char* data;
+  size_t size;
+  cursor->value(&data, &size);
+  EXPECT_EQ(cursor->value(), string(data, size));
+  // LMDB values stay in its memory map as the cursor moves on.
+  EXPECT_EQ(TypeParam::backend == DataParameter_DB_LMDB,
+      cursor->stable_values());
+  if (cursor->stable_values()) {
+    EXPECT_EQ(first_value, string(first_data, first_size));
+  }
+}
+
+TYPED_TEST(DBTest, TestKeyIndex) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  vector<string> keys;
+  db::GetKeyIndex(this->source_, db.get(), &keys);
+  ASSERT_EQ(2, keys.size());
+  EXPECT_EQ("cat.jpg", keys[0]);
+  EXPECT_EQ("fish-bike.jpg", keys[1]);
+  // The keys are read from the index from then on, while its header matches
+  // the database.
+  const string index_file = this->source_ + ".keys";
+  string header;
+  std::ifstream input(index_file.c_str());
+  std::getline(input, header);
+  input.close();
+  ASSERT_FALSE(header.empty());
+  std::ofstream index(index_file.c_str(), std::ios::out | std::ios::trunc);
+  index << header << "\ncat.jpg\ndog.jpg\n";
+  index.close();
+  db::GetKeyIndex(this->source_, db.get(), &keys);
+  ASSERT_EQ(2, keys.size());
+  EXPECT_EQ("dog.jpg", keys[1]);
+  // An index with more keys than its header says is listed again.
+  index.open(index_file.c_str(), std::ios::out | std::ios::app);
+  index << "fish.jpg\n";
+  index.close();
+  db::GetKeyIndex(this->source_, db.get(), &keys);
+  ASSERT_EQ(2, keys.size());
+  EXPECT_EQ("fish-bike.jpg", keys[1]);
+}
+
+TYPED_TEST(DBTest, TestKeyIndexStale) {
+  vector<string> keys;
+  {
+    scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+    db->Open(this->source_, db::READ);
+    db::GetKeyIndex(this->source_, db.get(), &keys);
+    ASSERT_EQ(2, keys.size());
+  }
+  {
+    scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+    db->Open(this->source_, db::WRITE);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    txn->Put("dog.jpg", "dog");
+    txn->Commit();
+  }
+  // The index of the database before the write is not used.
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  db::GetKeyIndex(this->source_, db.get(), &keys);
+  ASSERT_EQ(3, keys.size());
+  EXPECT_EQ("dog.jpg", keys[1]);
+}
+
+TYPED_TEST(DBTest, TestSplitKeys) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  vector<int> range_sizes;
+  vector<string> begin_keys = db::SplitKeys(cursor.get(), 1, &range_sizes);
+  ASSERT_EQ(1, begin_keys.size());
+  EXPECT_EQ("", begin_keys[0]);
+  ASSERT_EQ(1, range_sizes.size());
+  EXPECT_EQ(2, range_sizes[0]);
+  // No more ranges than keys.
+  begin_keys = db::SplitKeys(cursor.get(), 3, &range_sizes);
+  ASSERT_EQ(2, begin_keys.size());
+  EXPECT_EQ("", begin_keys[0]);
+  EXPECT_EQ("fish-bike.jpg", begin_keys[1]);
+  ASSERT_EQ(2, range_sizes.size());
+  EXPECT_EQ(1, range_sizes[0]);
+  EXPECT_EQ(1, range_sizes[1]);
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
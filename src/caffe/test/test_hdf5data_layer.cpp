@@ -14,6 +14,17 @@
 
 namespace caffe {
 
+// Lets tests see the blobs an HDF5DataLayer keeps.
+template <typename Dtype>
+class HDF5DataLayerBlobs : public HDF5DataLayer<Dtype> {
+ public:
+  explicit HDF5DataLayerBlobs(const LayerParameter& param)
+      : HDF5DataLayer<Dtype>(param) {}
+  using HDF5DataLayer<Dtype>::hdf_blobs_;
+  using HDF5DataLayer<Dtype>::prefetch_;
+  using HDF5DataLayer<Dtype>::prefetch_chunk_;
+};
+
 template <typename TypeParam>
 class HDF5DataLayerTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -35,6 +46,89 @@ class HDF5DataLayerTest : public MultiDeviceTest<TypeParam> {
     LOG(INFO)<< "Using sample HDF5 data file " << filename;
   }
 
+  // Reads the sample data, if prefetch, chunk_rows rows at a time.
+  void TestRead(int prefetch, int chunk_rows) {
+    // Create LayerParameter with the known parameters.
+    // The data file we are reading has 10 rows and 8 columns,
+    // with values from 0 to 10*8 reshaped in row-major order.
+    LayerParameter param;
+    param.add_top("data");
+    param.add_top("label");
+    param.add_top("label2");
+
+    HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+    int batch_size = 5;
+    hdf5_data_param->set_batch_size(batch_size);
+    hdf5_data_param->set_source(*filename);
+    hdf5_data_param->set_prefetch(prefetch);
+    hdf5_data_param->set_chunk_rows(chunk_rows);
+    int num_cols = 8;
+    int height = 6;
+    int width = 5;
+
+    // Test that the layer setup got the correct parameters.
+    HDF5DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), batch_size);
+    EXPECT_EQ(blob_top_data_->channels(), num_cols);
+    EXPECT_EQ(blob_top_data_->height(), height);
+    EXPECT_EQ(blob_top_data_->width(), width);
+
+    EXPECT_EQ(blob_top_label_->num_axes(), 2);
+    EXPECT_EQ(blob_top_label_->shape(0), batch_size);
+    EXPECT_EQ(blob_top_label_->shape(1), 1);
+
+    EXPECT_EQ(blob_top_label2_->num_axes(), 2);
+    EXPECT_EQ(blob_top_label2_->shape(0), batch_size);
+    EXPECT_EQ(blob_top_label2_->shape(1), 1);
+
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+
+    // Go through the data 10 times (5 batches).
+    const int data_size = num_cols * height * width;
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+
+      // On even iterations, we're reading the first half of the data.
+      // On odd iterations, we're reading the second half of the data.
+      // NB: label is 1-indexed
+      int label_offset = 1 + ((iter % 2 == 0) ? 0 : batch_size);
+      int label2_offset = 1 + label_offset;
+      int data_offset = (iter % 2 == 0) ? 0 : batch_size * data_size;
+
+      // Every two iterations we are reading the second file,
+      // which has the same labels, but data is offset by total data size,
+      // which is 2400 (see generate_sample_data).
+      int file_offset = (iter % 4 < 2) ? 0 : 2400;
+
+      for (int i = 0; i < batch_size; ++i) {
+        EXPECT_EQ(
+          label_offset + i,
+          blob_top_label_->cpu_data()[i]);
+        EXPECT_EQ(
+          label2_offset + i,
+          blob_top_label2_->cpu_data()[i]);
+      }
+      for (int i = 0; i < batch_size; ++i) {
+        for (int j = 0; j < num_cols; ++j) {
+          for (int h = 0; h < height; ++h) {
+            for (int w = 0; w < width; ++w) {
+              int idx = (
+                i * num_cols * height * width +
+                j * height * width +
+                h * width + w);
+              EXPECT_EQ(
+                file_offset + data_offset + idx,
+                blob_top_data_->cpu_data()[idx])
+                << "debug: i " << i << " j " << j
+                << " iter " << iter;
+            }
+          }
+        }
+      }
+    }
+  }
+
   virtual ~HDF5DataLayerTest() {
     delete blob_top_data_;
     delete blob_top_label_;
@@ -53,83 +147,87 @@ class HDF5DataLayerTest : public MultiDeviceTest<TypeParam> {
 TYPED_TEST_CASE(HDF5DataLayerTest, TestDtypesAndDevices);
 
 TYPED_TEST(HDF5DataLayerTest, TestRead) {
+  this->TestRead(0, 1024);
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestReadPrefetch) {
+  // Chunks of 3 of the 10 rows of a file straddle the batches of 5.
+  this->TestRead(2, 3);
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestReadPrefetchMemory) {
   typedef typename TypeParam::Dtype Dtype;
-  // Create LayerParameter with the known parameters.
-  // The data file we are reading has 10 rows and 8 columns,
-  // with values from 0 to 10*8 reshaped in row-major order.
   LayerParameter param;
   param.add_top("data");
   param.add_top("label");
   param.add_top("label2");
-
   HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
-  int batch_size = 5;
+  const int batch_size = 5;
+  const int chunk_rows = 3;
   hdf5_data_param->set_batch_size(batch_size);
   hdf5_data_param->set_source(*(this->filename));
-  int num_cols = 8;
-  int height = 6;
-  int width = 5;
-
-  // Test that the layer setup got the correct parameters.
-  HDF5DataLayer<Dtype> layer(param);
+  hdf5_data_param->set_prefetch(2);
+  hdf5_data_param->set_chunk_rows(chunk_rows);
+  HDF5DataLayerBlobs<Dtype> layer(param);
   layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
-  EXPECT_EQ(this->blob_top_data_->num(), batch_size);
-  EXPECT_EQ(this->blob_top_data_->channels(), num_cols);
-  EXPECT_EQ(this->blob_top_data_->height(), height);
-  EXPECT_EQ(this->blob_top_data_->width(), width);
-
-  EXPECT_EQ(this->blob_top_label_->num_axes(), 2);
-  EXPECT_EQ(this->blob_top_label_->shape(0), batch_size);
-  EXPECT_EQ(this->blob_top_label_->shape(1), 1);
-
-  EXPECT_EQ(this->blob_top_label2_->num_axes(), 2);
-  EXPECT_EQ(this->blob_top_label2_->shape(0), batch_size);
-  EXPECT_EQ(this->blob_top_label2_->shape(1), 1);
+  for (int iter = 0; iter < 4; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  }
+  layer.StopInternalThread();
+  // No more than a batch or a chunk of the 10 rows of a file is held.
+  EXPECT_EQ(0, layer.hdf_blobs_.size());
+  ASSERT_EQ(3, layer.prefetch_chunk_.size());
+  for (int j = 0; j < 3; ++j) {
+    const int row_size = this->blob_top_vec_[j]->count(1);
+    EXPECT_EQ(chunk_rows * row_size * sizeof(Dtype),
+        layer.prefetch_chunk_[j]->data()->size());
+    for (int i = 0; i < layer.prefetch_.size(); ++i) {
+      EXPECT_EQ(batch_size * row_size * sizeof(Dtype),
+          layer.prefetch_[i]->blobs_[j]->data()->size());
+    }
+  }
+}
 
+TYPED_TEST(HDF5DataLayerTest, TestReadPrefetchShuffle) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_shuffle(true);
+  hdf5_data_param->set_prefetch(2);
+  hdf5_data_param->set_chunk_rows(4);
+  HDF5DataLayer<Dtype> layer(param);
   layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
 
-  // Go through the data 10 times (5 batches).
-  const int data_size = num_cols * height * width;
-  for (int iter = 0; iter < 10; ++iter) {
-    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
-
-    // On even iterations, we're reading the first half of the data.
-    // On odd iterations, we're reading the second half of the data.
-    // NB: label is 1-indexed
-    int label_offset = 1 + ((iter % 2 == 0) ? 0 : batch_size);
-    int label2_offset = 1 + label_offset;
-    int data_offset = (iter % 2 == 0) ? 0 : batch_size * data_size;
-
-    // Every two iterations we are reading the second file,
-    // which has the same labels, but data is offset by total data size,
-    // which is 2400 (see generate_sample_data).
-    int file_offset = (iter % 4 < 2) ? 0 : 2400;
-
-    for (int i = 0; i < batch_size; ++i) {
-      EXPECT_EQ(
-        label_offset + i,
-        this->blob_top_label_->cpu_data()[i]);
-      EXPECT_EQ(
-        label2_offset + i,
-        this->blob_top_label2_->cpu_data()[i]);
-    }
-    for (int i = 0; i < batch_size; ++i) {
-      for (int j = 0; j < num_cols; ++j) {
-        for (int h = 0; h < height; ++h) {
-          for (int w = 0; w < width; ++w) {
-            int idx = (
-              i * num_cols * height * width +
-              j * height * width +
-              h * width + w);
-            EXPECT_EQ(
-              file_offset + data_offset + idx,
-              this->blob_top_data_->cpu_data()[idx])
-              << "debug: i " << i << " j " << j
-              << " iter " << iter;
-          }
+  // Each pass over the 2 files of 10 rows, 4 batches, outputs each row once,
+  // with its labels.
+  const int data_size = 8 * 6 * 5;
+  for (int pass = 0; pass < 3; ++pass) {
+    vector<int> seen(20, 0);
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const int label = this->blob_top_label_->cpu_data()[i];
+        ASSERT_GE(label, 1);
+        ASSERT_LE(label, 10);
+        EXPECT_EQ(label + 1, this->blob_top_label2_->cpu_data()[i]);
+        const Dtype* data = this->blob_top_data_->cpu_data() + i * data_size;
+        // The second file has its data offset by 2400.
+        const int file = data[0] >= 2400 ? 1 : 0;
+        for (int j = 0; j < data_size; ++j) {
+          EXPECT_EQ(file * 2400 + (label - 1) * data_size + j, data[j]);
         }
+        ++seen[file * 10 + label - 1];
       }
     }
+    for (int row = 0; row < 20; ++row) {
+      EXPECT_EQ(1, seen[row]) << "debug: pass " << pass << " row " << row;
+    }
   }
 }
 
@@ -0,0 +1,65 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  // A 2 x 2 color image of 12 bytes, all of value.
+  cv::Mat Image(int value) {
+    return cv::Mat(2, 2, CV_8UC3, cv::Scalar(value, value, value));
+  }
+};
+
+TEST_F(ImageCacheTest, TestGetPut) {
+  ImageCache cache(100);
+  cv::Mat image;
+  EXPECT_FALSE(cache.Get("a", &image));
+  cache.Put("a", Image(1));
+  ASSERT_TRUE(cache.Get("a", &image));
+  EXPECT_EQ(1, image.at<cv::Vec3b>(1, 1)[2]);
+  EXPECT_EQ(12, cache.bytes());
+  // A key is cached once.
+  cache.Put("a", Image(2));
+  ASSERT_TRUE(cache.Get("a", &image));
+  EXPECT_EQ(1, image.at<cv::Vec3b>(1, 1)[2]);
+  EXPECT_EQ(12, cache.bytes());
+}
+
+TEST_F(ImageCacheTest, TestEvictLeastRecentlyUsed) {
+  ImageCache cache(36);
+  cache.Put("a", Image(1));
+  cache.Put("b", Image(2));
+  cache.Put("c", Image(3));
+  cv::Mat image;
+  ASSERT_TRUE(cache.Get("a", &image));
+  cache.Put("d", Image(4));
+  EXPECT_EQ(36, cache.bytes());
+  EXPECT_TRUE(cache.Get("a", &image));
+  EXPECT_FALSE(cache.Get("b", &image));
+  EXPECT_TRUE(cache.Get("c", &image));
+  ASSERT_TRUE(cache.Get("d", &image));
+  EXPECT_EQ(4, image.at<cv::Vec3b>(0, 0)[0]);
+}
+
+TEST_F(ImageCacheTest, TestTooLarge) {
+  ImageCache cache(20);
+  cache.Put("a", Image(1));
+  cache.Put("b", cv::Mat(3, 3, CV_8UC3));
+  cv::Mat image;
+  EXPECT_TRUE(cache.Get("a", &image));
+  EXPECT_FALSE(cache.Get("b", &image));
+  EXPECT_EQ(12, cache.bytes());
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -215,5 +215,42 @@ TYPED_TEST(ImageDataLayerTest, TestSpace) {
   EXPECT_EQ(this->blob_top_label_->cpu_data()[0], 1);
 }
 
+TYPED_TEST(ImageDataLayerTest, TestImageCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(1);
+  image_data_param->set_source(this->filename_reshape_.c_str());
+  image_data_param->set_new_height(32);
+  image_data_param->set_new_width(48);
+  image_data_param->set_shuffle(false);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Room for both images, then for one only, evicting the other every time.
+  const int image_bytes = 3 * 32 * 48;
+  for (int capacity = 2 * image_bytes; capacity >= image_bytes;
+       capacity -= image_bytes) {
+    image_data_param->set_image_cache_bytes(capacity);
+    ImageDataLayer<Dtype> cached_layer(param);
+    vector<Blob<Dtype>*> cached_top_vec;
+    Blob<Dtype> cached_data, cached_label;
+    cached_top_vec.push_back(&cached_data);
+    cached_top_vec.push_back(&cached_label);
+    cached_layer.SetUp(this->blob_bottom_vec_, cached_top_vec);
+    // Go through the data three times
+    for (int iter = 0; iter < 6; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      cached_layer.Forward(this->blob_bottom_vec_, cached_top_vec);
+      ASSERT_EQ(this->blob_top_data_->count(), cached_data.count());
+      for (int i = 0; i < cached_data.count(); ++i) {
+        EXPECT_EQ(this->blob_top_data_->cpu_data()[i],
+            cached_data.cpu_data()[i]);
+      }
+      EXPECT_EQ(this->blob_top_label_->cpu_data()[0],
+          cached_label.cpu_data()[0]);
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +7,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/quantized_inner_product_layer.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -208,6 +210,147 @@ TYPED_TEST(InnerProductLayerTest, TestForwardTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardPackedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  // With MKL, in the TEST phase the CPU forward uses weights packed once;
+  // check that it matches the TRAIN phase result, including after the
+  // weights change.
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_nobatch_);
+  Blob<Dtype>* const bottoms[2] =
+      { this->blob_bottom_, this->blob_bottom_nobatch_ };
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    for (int b = 0; b < 2; ++b) {
+      vector<Blob<Dtype>*> bottom_vec(1, bottoms[b]);
+      LayerParameter layer_param;
+      InnerProductParameter* inner_product_param =
+          layer_param.mutable_inner_product_param();
+      inner_product_param->set_num_output(10);
+      inner_product_param->set_transpose(transpose);
+      inner_product_param->mutable_weight_filler()->set_type("uniform");
+      inner_product_param->mutable_bias_filler()->set_type("uniform");
+      InnerProductLayer<Dtype> layer(layer_param);
+      layer.SetUp(bottom_vec, this->blob_top_vec_);
+      layer_param.set_phase(TEST);
+      InnerProductLayer<Dtype> packed_layer(layer_param);
+      Blob<Dtype> packed_top;
+      vector<Blob<Dtype>*> packed_top_vec(1, &packed_top);
+      packed_layer.blobs().push_back(layer.blobs()[0]);
+      packed_layer.blobs().push_back(layer.blobs()[1]);
+      packed_layer.SetUp(bottom_vec, packed_top_vec);
+      for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+          // Changing the weights must invalidate the packed copy.
+          caffe_scal<Dtype>(layer.blobs()[0]->count(), Dtype(-2),
+              layer.blobs()[0]->mutable_cpu_data());
+        }
+        layer.Forward(bottom_vec, this->blob_top_vec_);
+        packed_layer.Forward(bottom_vec, packed_top_vec);
+        ASSERT_EQ(this->blob_top_->count(), packed_top.count());
+        for (int i = 0; i < packed_top.count(); ++i) {
+          EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+              packed_top.cpu_data()[i], 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardQuantized) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The int8 layer should match the float one to within quantization error,
+  // with the ReLU fused into the dequantization.
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("uniform");
+    inner_product_param->mutable_weight_filler()->set_min(-1);
+    inner_product_param->mutable_weight_filler()->set_max(1);
+    inner_product_param->mutable_bias_filler()->set_type("uniform");
+    InnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer_param.mutable_quantization_param()->set_bottom_range(1);
+    layer_param.mutable_quantization_param()->set_relu(true);
+    QuantizedInnerProductLayer<Dtype> quantized_layer(layer_param);
+    Blob<Dtype> quantized_top;
+    vector<Blob<Dtype>*> quantized_top_vec(1, &quantized_top);
+    quantized_layer.blobs().push_back(layer.blobs()[0]);
+    quantized_layer.blobs().push_back(layer.blobs()[1]);
+    quantized_layer.SetUp(this->blob_bottom_vec_, quantized_top_vec);
+    for (int pass = 0; pass < 2; ++pass) {
+      if (pass == 1) {
+        // Changing the weights must invalidate the int8 copy.
+        caffe_scal<Dtype>(layer.blobs()[0]->count(), Dtype(-2),
+            layer.blobs()[0]->mutable_cpu_data());
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      quantized_layer.Forward(this->blob_bottom_vec_, quantized_top_vec);
+      ASSERT_EQ(this->blob_top_->count(), quantized_top.count());
+      for (int i = 0; i < quantized_top.count(); ++i) {
+        EXPECT_NEAR(std::max(this->blob_top_->cpu_data()[i], Dtype(0)),
+            quantized_top.cpu_data()[i], 0.1);
+      }
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardQuantizedDropFloatWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  // With drop_float_weights the float weights are freed once quantized, and
+  // new weights written into the blob are quantized in turn.
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("uniform");
+  inner_product_param->mutable_weight_filler()->set_min(-1);
+  inner_product_param->mutable_weight_filler()->set_max(1);
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_param.mutable_quantization_param()->set_bottom_range(1);
+  layer_param.mutable_quantization_param()->set_drop_float_weights(true);
+  QuantizedInnerProductLayer<Dtype> quantized_layer(layer_param);
+  Blob<Dtype> quantized_top;
+  vector<Blob<Dtype>*> quantized_top_vec(1, &quantized_top);
+  Blob<Dtype> weight_copy;
+  weight_copy.CopyFrom(*layer.blobs()[0], false, true);
+  quantized_layer.blobs().push_back(
+      shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  quantized_layer.blobs()[0]->CopyFrom(weight_copy, false, true);
+  quantized_layer.blobs().push_back(layer.blobs()[1]);
+  quantized_layer.SetUp(this->blob_bottom_vec_, quantized_top_vec);
+  for (int pass = 0; pass < 3; ++pass) {
+    if (pass == 2) {
+      // Writing new weights has them quantized and dropped as well.
+      caffe_scal<Dtype>(weight_copy.count(), Dtype(-2),
+          weight_copy.mutable_cpu_data());
+      caffe_copy(weight_copy.count(), weight_copy.cpu_data(),
+          quantized_layer.blobs()[0]->mutable_cpu_data());
+      caffe_copy(weight_copy.count(), weight_copy.cpu_data(),
+          layer.blobs()[0]->mutable_cpu_data());
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    quantized_layer.Forward(this->blob_bottom_vec_, quantized_top_vec);
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+        quantized_layer.blobs()[0]->data()->head());
+    ASSERT_EQ(this->blob_top_->count(), quantized_top.count());
+    for (int i = 0; i < quantized_top.count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+          quantized_top.cpu_data()[i], 0.1);
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_nobatch_);
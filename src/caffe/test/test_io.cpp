@@ -420,5 +420,30 @@ TEST_F(IOTest, TestDecodeDatumToCVMatContentNative) {
   }
 }
 
+TEST_F(IOTest, TestParseDatumRecord) {
+  Datum datum;
+  datum.set_channels(1);
+  datum.set_height(2);
+  datum.set_width(3);
+  datum.set_data("abcdef");
+  datum.set_label(7);
+  string value;
+  CHECK(datum.SerializeToString(&value));
+  for (int alias = 0; alias < 2; ++alias) {
+    DatumRecord record;
+    EXPECT_TRUE(ParseDatumRecord(value.data(), value.size(), alias, &record));
+    EXPECT_EQ("abcdef", string(record.data, record.size));
+    Datum parsed(record.datum);
+    if (alias) {
+      // The data bytes are left in the value.
+      EXPECT_FALSE(record.datum.has_data());
+      EXPECT_GE(record.data, value.data());
+      EXPECT_LE(record.data + record.size, value.data() + value.size());
+      parsed.set_data(record.data, record.size);
+    }
+    EXPECT_EQ(datum.DebugString(), parsed.DebugString());
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
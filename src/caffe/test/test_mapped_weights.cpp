@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class MappedWeightsTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    param_.set_name("TestNetwork");
+    for (int i = 0; i < 3; ++i) {
+      LayerParameter* layer = param_.add_layer();
+      layer->set_name("layer" + format_int(i));
+      layer->set_type("InnerProduct");
+      // The middle layer has no blobs.
+      for (int j = 0; i != 1 && j < 2; ++j) {
+        BlobProto* blob = layer->add_blobs();
+        blob->mutable_shape()->add_dim(i + 2);
+        blob->mutable_shape()->add_dim(j + 3);
+        for (int k = 0; k < (i + 2) * (j + 3); ++k) {
+          blob->add_data(i * 100 + j * 10 + k);
+        }
+      }
+    }
+    // Blobs with the legacy shape or double data are supported too.
+    BlobProto* legacy_blob = param_.mutable_layer(2)->add_blobs();
+    legacy_blob->set_num(1);
+    legacy_blob->set_channels(1);
+    legacy_blob->set_height(1);
+    legacy_blob->set_width(2);
+    legacy_blob->add_double_data(0.5);
+    legacy_blob->add_double_data(1.5);
+  }
+
+  // Checks that the index of filename describes param_.
+  void CheckIndex(const string& filename, const bool aligned) {
+    MappedFile file(filename);
+    vector<IndexedLayer> layers;
+    ASSERT_TRUE(IndexBinaryNetParams(file.data(), file.size(), &layers));
+    ASSERT_EQ(param_.layer_size(), layers.size());
+    for (int i = 0; i < layers.size(); ++i) {
+      const LayerParameter& layer = param_.layer(i);
+      EXPECT_EQ(layer.name(), layers[i].name);
+      ASSERT_EQ(layer.blobs_size(), layers[i].blobs.size());
+      for (int j = 0; j < layers[i].blobs.size(); ++j) {
+        const BlobProto& blob = layer.blobs(j);
+        const IndexedBlob& indexed_blob = layers[i].blobs[j];
+        BlobProto header(blob);
+        header.clear_data();
+        EXPECT_EQ(header.DebugString(), indexed_blob.header.DebugString());
+        ASSERT_EQ(blob.data_size() * sizeof(float), indexed_blob.data_bytes);
+        const char* data = file.data() + indexed_blob.data_offset;
+        if (aligned && blob.data_size() > 0) {
+          EXPECT_EQ(0, reinterpret_cast<uintptr_t>(data) % 64);
+        }
+        for (int k = 0; k < blob.data_size(); ++k) {
+          float value;
+          memcpy(&value, data + k * sizeof(float), sizeof(float));
+          EXPECT_EQ(blob.data(k), value);
+        }
+      }
+    }
+  }
+
+  NetParameter param_;
+};
+
+TEST_F(MappedWeightsTest, TestIndex) {
+  string filename;
+  MakeTempFilename(&filename);
+  WriteProtoToBinaryFile(param_, filename);
+  CheckIndex(filename, false);
+}
+
+TEST_F(MappedWeightsTest, TestIndexV1Layers) {
+  // Nets using the deprecated V1 layers need the full parser and upgrade.
+  param_.add_layers()->set_name("v1_layer");
+  string filename;
+  MakeTempFilename(&filename);
+  WriteProtoToBinaryFile(param_, filename);
+  MappedFile file(filename);
+  vector<IndexedLayer> layers;
+  EXPECT_FALSE(IndexBinaryNetParams(file.data(), file.size(), &layers));
+}
+
+TEST_F(MappedWeightsTest, TestWriteAligned) {
+  string filename;
+  MakeTempFilename(&filename);
+  WriteNetParamsToAlignedBinaryFile(param_, filename);
+  CheckIndex(filename, true);
+  // The file is an ordinary NetParameter, padding aside.
+  NetParameter param;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(filename, &param));
+  ASSERT_EQ(param_.layer_size(), param.layer_size());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    ASSERT_EQ(param_.layer(i).blobs_size(), param.layer(i).blobs_size());
+    for (int j = 0; j < param.layer(i).blobs_size(); ++j) {
+      param.mutable_layer(i)->mutable_blobs(j)->mutable_unknown_fields()
+          ->Clear();
+    }
+  }
+  EXPECT_EQ(param_.DebugString(), param.DebugString());
+}
+
+}  // namespace caffe
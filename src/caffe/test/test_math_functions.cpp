@@ -1,6 +1,8 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +121,97 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestPackedGemm) {
+  // Compare against caffe_cpu_gemm for each transpose and a nonzero beta,
+  // with M not a multiple of the packing panel height.
+  const int M = 13, N = 70, K = 9;
+  const TypeParam alpha = 0.5, beta = 2;
+  Blob<TypeParam> A(1, 1, M, K), B(1, 1, K, N);
+  Blob<TypeParam> C(1, 1, M, N), C_packed(1, 1, M, N);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&A);
+  filler.Fill(&B);
+  filler.Fill(&C);
+  Blob<TypeParam> packed_A(1, 1, 1,
+      caffe_cpu_gemm_pack_size<TypeParam>(M, N, K));
+  for (int trans_a = 0; trans_a < 2; ++trans_a) {
+    for (int trans_b = 0; trans_b < 2; ++trans_b) {
+      const CBLAS_TRANSPOSE TransA = trans_a ? CblasTrans : CblasNoTrans;
+      const CBLAS_TRANSPOSE TransB = trans_b ? CblasTrans : CblasNoTrans;
+      caffe_copy(C.count(), C.cpu_data(), C_packed.mutable_cpu_data());
+      caffe_cpu_gemm_pack<TypeParam>(TransA, M, N, K, alpha, A.cpu_data(),
+          packed_A.mutable_cpu_data());
+      caffe_cpu_packed_gemm<TypeParam>(TransB, M, N, K, packed_A.cpu_data(),
+          B.cpu_data(), beta, C_packed.mutable_cpu_data());
+      caffe_cpu_gemm<TypeParam>(TransA, TransB, M, N, K, alpha, A.cpu_data(),
+          B.cpu_data(), beta, C.mutable_cpu_data());
+      for (int i = 0; i < C.count(); ++i) {
+        EXPECT_NEAR(C.cpu_data()[i], C_packed.cpu_data()[i], 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmS8S32) {
+  // Quantize Gaussian operands coarsely enough that some values saturate,
+  // then compare the int8 gemm with caffe_cpu_gemm on the same integers,
+  // which is exact at these magnitudes.
+  const int M = 5, N = 19, K = 33;
+  const TypeParam scale = 60;
+  Blob<TypeParam> A(1, 1, M, K), B(1, 1, K, N);
+  Blob<TypeParam> A_int(1, 1, M, K), B_int(1, 1, K, N), C(1, 1, M, N);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&A);
+  filler.Fill(&B);
+  vector<int8_t> A_quantized(A.count()), B_quantized(B.count());
+  caffe_cpu_quantize(A.count(), scale, A.cpu_data(), &A_quantized[0]);
+  caffe_cpu_quantize(B.count(), scale, B.cpu_data(), &B_quantized[0]);
+  for (int i = 0; i < A.count(); ++i) {
+    const TypeParam expected = std::max(TypeParam(-127), std::min(
+        TypeParam(127), std::floor(scale * A.cpu_data()[i] + TypeParam(0.5))));
+    EXPECT_EQ(expected, A_quantized[i]);
+    A_int.mutable_cpu_data()[i] = A_quantized[i];
+  }
+  for (int i = 0; i < B.count(); ++i) {
+    B_int.mutable_cpu_data()[i] = B_quantized[i];
+  }
+  vector<int32_t> C_quantized(C.count());
+  for (int trans_b = 0; trans_b < 2; ++trans_b) {
+    const CBLAS_TRANSPOSE TransB = trans_b ? CblasTrans : CblasNoTrans;
+    caffe_cpu_gemm_s8s32(TransB, M, N, K, &A_quantized[0], &B_quantized[0],
+        &C_quantized[0]);
+    caffe_cpu_gemm<TypeParam>(CblasNoTrans, TransB, M, N, K, 1.,
+        A_int.cpu_data(), B_int.cpu_data(), 0., C.mutable_cpu_data());
+    for (int i = 0; i < C.count(); ++i) {
+      EXPECT_EQ(C.cpu_data()[i], C_quantized[i]);
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmS8S32Threads) {
+  // Splitting the rows between threads must not change the result.
+  const int M = 50, N = 300, K = 500;
+  vector<int8_t> A(M * K), B(K * N);
+  for (int i = 0; i < A.size(); ++i) {
+    A[i] = static_cast<int8_t>(caffe_rng_rand() % 255 - 127);
+  }
+  for (int i = 0; i < B.size(); ++i) {
+    B[i] = static_cast<int8_t>(caffe_rng_rand() % 255 - 127);
+  }
+  vector<int32_t> C_single(M * N), C_threaded(M * N);
+  for (int trans_b = 0; trans_b < 2; ++trans_b) {
+    const CBLAS_TRANSPOSE TransB = trans_b ? CblasTrans : CblasNoTrans;
+    caffe_set_gemm_s8s32_threads(1);
+    caffe_cpu_gemm_s8s32(TransB, M, N, K, &A[0], &B[0], &C_single[0]);
+    caffe_set_gemm_s8s32_threads(3);
+    caffe_cpu_gemm_s8s32(TransB, M, N, K, &A[0], &B[0], &C_threaded[0]);
+    caffe_set_gemm_s8s32_threads(0);
+    EXPECT_TRUE(C_single == C_threaded);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <string>
 #include <utility>
 #include <vector>
@@ -10,7 +12,10 @@
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/optimize_graph.hpp"
+#include "caffe/util/weight_cache.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -629,6 +634,372 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitFusedLayersNet(const bool fuse_layers,
+      const bool force_backward = false) {
+    ostringstream proto;
+    proto <<
+        "name: 'FusedLayersNetwork' "
+        "state: { phase: TEST } "
+        "fuse_layers: " << (fuse_layers ? "true" : "false") << " "
+        "force_backward: " << (force_backward ? "true" : "false") << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 7 dim: 7 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    bias_term: false "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bn1' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'scale1' "
+        "  type: 'Scale' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "  scale_param { "
+        "    bias_term: true "
+        "    filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 6 "
+        "    kernel_size: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'scale2' "
+        "  type: 'Scale' "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "  scale_param { "
+        "    filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'relu2' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitBranchingNet(const string& net_options) {
+    ostringstream proto;
+    proto <<
+        "name: 'BranchingNetwork' "
+        "state: { phase: TEST } "
+        << net_options << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 4 dim: 4 } "
+        "  } "
+        "} ";
+    const char* inner_products[][3] = {
+        {"ip1", "data", "8"}, {"ip2", "ip1", "12"}, {"ip3a", "ip2", "6"},
+        {"ip3b", "ip2", "6"}, {"ip4", "flat", "5"}};
+    for (int i = 0; i < 5; ++i) {
+      proto <<
+          "layer { "
+          "  name: '" << inner_products[i][0] << "' "
+          "  type: 'InnerProduct' "
+          "  bottom: '" << inner_products[i][1] << "' "
+          "  top: '" << inner_products[i][0] << "' "
+          "  inner_product_param { "
+          "    num_output: " << inner_products[i][2] << " "
+          "    weight_filler { "
+          "      type: 'gaussian' "
+          "      std: 0.5 "
+          "    } "
+          "    bias_filler { "
+          "      type: 'gaussian' "
+          "      std: 0.5 "
+          "    } "
+          "  } "
+          "} ";
+      if (i == 0) {
+        proto <<
+            "layer { "
+            "  name: 'relu1' "
+            "  type: 'ReLU' "
+            "  bottom: 'ip1' "
+            "  top: 'ip1' "
+            "} ";
+      } else if (i == 3) {
+        proto <<
+            "layer { "
+            "  name: 'sum' "
+            "  type: 'Eltwise' "
+            "  bottom: 'ip3a' "
+            "  bottom: 'ip3b' "
+            "  top: 'sum' "
+            "} "
+            "layer { "
+            "  name: 'flat' "
+            "  type: 'Flatten' "
+            "  bottom: 'sum' "
+            "  top: 'flat' "
+            "} ";
+      }
+    }
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitRecomputeNet(const bool recompute_activations) {
+    ostringstream proto;
+    proto <<
+        "name: 'RecomputeNetwork' "
+        "state: { phase: TRAIN } "
+        "force_backward: true "
+        "recompute_activations: "
+        << (recompute_activations ? "true" : "false") << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 6 dim: 6 } "
+        "  shape: { dim: 2 dim: 3 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv1' "
+        "  top: 'pool1' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 2 "
+        "    stride: 2 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'pool1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 5 "
+        "    kernel_size: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'relu2' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'relu2' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitBlockedLayoutNet(const int channel_block) {
+    ostringstream proto;
+    proto <<
+        "name: 'BlockedLayoutNetwork' "
+        "state: { phase: TEST } "
+        "channel_block: " << channel_block << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 5 dim: 9 dim: 9 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 11 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv1' "
+        "  top: 'pool1' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 3 "
+        "    stride: 2 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'pool1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 8 "
+        "    kernel_size: 3 "
+        "    pad: 2 "
+        "    dilation: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv3' "
+        "  type: 'Convolution' "
+        "  bottom: 'pool1' "
+        "  top: 'conv3' "
+        "  convolution_param { "
+        "    num_output: 5 "
+        "    kernel_size: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'conv2' "
+        "  bottom: 'conv3' "
+        "  top: 'concat' "
+        "} "
+        "layer { "
+        "  name: 'norm1' "
+        "  type: 'LRN' "
+        "  bottom: 'concat' "
+        "  top: 'norm1' "
+        "  lrn_param { "
+        "    local_size: 5 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'pool2' "
+        "  type: 'Pooling' "
+        "  bottom: 'norm1' "
+        "  top: 'pool2' "
+        "  pooling_param { "
+        "    pool: AVE "
+        "    kernel_size: 2 "
+        "    pad: 1 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'softmax' "
+        "  type: 'Softmax' "
+        "  bottom: 'pool2' "
+        "  top: 'softmax' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -2374,6 +2745,93 @@ TEST_F(FilterNetTest, TestFilterInOutByExcludeMultiRule) {
   this->RunFilterNetTest(input_proto_test, output_proto_test);
 }
 
+class OptimizeGraphTest : public ::testing::Test {
+ protected:
+  void RunOptimizeGraphTest(
+      const string& input_param_string, const string& output_param_string) {
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    OptimizeGraph(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+    // Also test idempotence.
+    NetParameter double_output_param;
+    OptimizeGraph(actual_output_param, &double_output_param);
+    EXPECT_EQ(actual_output_param.DebugString(),
+       double_output_param.DebugString());
+  }
+};
+
+TEST_F(OptimizeGraphTest, TestRemoveAndComputeInPlace) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'relu0' type: 'ReLU' bottom: 'data' top: 'relu0' } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'relu0' top: 'ip1' } "
+      "layer { name: 'drop1' type: 'Dropout' bottom: 'ip1' top: 'drop1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'drop1' top: 'relu1' } "
+      "layer { name: 'split' type: 'Split' bottom: 'relu1' "
+      "  top: 'split1' top: 'split2' } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'split1' top: 'ip2' } "
+      "layer { name: 'ip3' type: 'InnerProduct' bottom: 'split2' top: 'ip3' } "
+      "layer { name: 'power' type: 'Power' bottom: 'ip2' top: 'power' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' bottom: 'ip3' top: 'sigmoid' } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'power' bottom: 'sigmoid' "
+      "  top: 'sum' } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'sum' top: 'relu2' } ";
+  // relu0 would overwrite the input and relu2 rename the output, so they
+  // are left alone.
+  const string& output_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'relu0' type: 'ReLU' bottom: 'data' top: 'relu0' } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'relu0' top: 'ip1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'ip1' top: 'ip1' } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'ip1' top: 'ip2' } "
+      "layer { name: 'ip3' type: 'InnerProduct' bottom: 'ip1' top: 'ip3' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' bottom: 'ip3' top: 'ip3' } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'ip2' bottom: 'ip3' "
+      "  top: 'sum' } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'sum' top: 'relu2' } ";
+  this->RunOptimizeGraphTest(input_proto, output_proto);
+}
+
+TEST_F(OptimizeGraphTest, TestKeepRequestedBlobs) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "output_blob: 'drop1' "
+      "output_blob: 'ip2' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' top: 'ip1' } "
+      "layer { name: 'drop1' type: 'Dropout' bottom: 'ip1' top: 'drop1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'drop1' top: 'relu1' } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'relu1' top: 'ip2' } "
+      "layer { name: 'drop2' type: 'Dropout' bottom: 'ip2' top: 'ip2' } "
+      "layer { name: 'drop3' type: 'Dropout' bottom: 'ip2' top: 'drop3' "
+      "  phase: TRAIN } "
+      "layer { name: 'ip3' type: 'InnerProduct' bottom: 'drop3' top: 'ip3' } ";
+  // Only the in-place Dropout layer can go: the others copy a requested
+  // blob or run in the TRAIN phase.
+  const string& output_proto =
+      "name: 'TestNetwork' "
+      "output_blob: 'drop1' "
+      "output_blob: 'ip2' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' top: 'ip1' } "
+      "layer { name: 'drop1' type: 'Dropout' bottom: 'ip1' top: 'drop1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'drop1' top: 'relu1' } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'relu1' top: 'ip2' } "
+      "layer { name: 'drop3' type: 'Dropout' bottom: 'ip2' top: 'drop3' "
+      "  phase: TRAIN } "
+      "layer { name: 'ip3' type: 'InnerProduct' bottom: 'drop3' top: 'ip3' } ";
+  this->RunOptimizeGraphTest(input_proto, output_proto);
+}
+
 TYPED_TEST(NetTest, TestReshape) {
   typedef typename TypeParam::Dtype Dtype;
   // We set up bottom blobs of two different sizes, switch between
@@ -2446,6 +2904,626 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestBlockedLayout) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run the same net, with the same weights, in the NCHW and the blocked
+  // layout and check that the outputs match.
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(Caffe::CPU);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 5, 9, 9);
+  filler.Fill(&input);
+
+  this->InitBlockedLayoutNet(0);
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->blob_by_name("data")->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> planar_output;
+  planar_output.CopyFrom(*this->net_->blob_by_name("pool2"), false, true);
+  EXPECT_FALSE(this->net_->has_layer("pool2_reorder"));
+
+  this->InitBlockedLayoutNet(8);
+  // Pack the initial weights first, for the trained ones to be repacked.
+  this->net_->Forward();
+  this->net_->CopyTrainedLayersFrom(trained_param);
+  EXPECT_TRUE(this->net_->has_blob("conv1_blocked"));
+  EXPECT_TRUE(this->net_->has_layer("pool2_reorder"));
+  const vector<int>& blocked_shape =
+      this->net_->blob_by_name("concat_blocked")->shape();
+  ASSERT_EQ(5, blocked_shape.size());
+  EXPECT_EQ(2, blocked_shape[1]);
+  EXPECT_EQ(8, blocked_shape[4]);
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->blob_by_name("data")->mutable_cpu_data());
+  this->net_->Forward();
+  const Blob<Dtype>* blocked_output = this->net_->blob_by_name("pool2").get();
+  ASSERT_EQ(planar_output.shape(), blocked_output->shape());
+  for (int i = 0; i < planar_output.count(); ++i) {
+    EXPECT_NEAR(planar_output.cpu_data()[i], blocked_output->cpu_data()[i],
+        1e-5);
+  }
+}
+
+TYPED_TEST(NetTest, TestBlockedLayoutBlockSizes) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Check the blocked convolution against NCHW for a block size taking the
+  // generic loop and one taking the other fast path than the test above.
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(Caffe::CPU);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 5, 9, 9);
+  filler.Fill(&input);
+
+  this->InitBlockedLayoutNet(0);
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->blob_by_name("data")->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> planar_output;
+  planar_output.CopyFrom(*this->net_->blob_by_name("pool2"), false, true);
+
+  const int blocks[] = {4, 16};
+  for (int b = 0; b < 2; ++b) {
+    this->InitBlockedLayoutNet(blocks[b]);
+    this->net_->CopyTrainedLayersFrom(trained_param);
+    EXPECT_TRUE(this->net_->has_blob("conv1_blocked"));
+    caffe_copy(input.count(), input.cpu_data(),
+        this->net_->blob_by_name("data")->mutable_cpu_data());
+    this->net_->Forward();
+    const Blob<Dtype>* blocked_output =
+        this->net_->blob_by_name("pool2").get();
+    ASSERT_EQ(planar_output.shape(), blocked_output->shape());
+    for (int i = 0; i < planar_output.count(); ++i) {
+      EXPECT_NEAR(planar_output.cpu_data()[i], blocked_output->cpu_data()[i],
+          1e-5);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run the same net, with the same weights, with and without fusing the
+  // BatchNorm, Scale and ReLU layers into the convolutions, and check that
+  // the outputs match.
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(Caffe::CPU);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 7, 7);
+  filler.Fill(&input);
+
+  this->InitFusedLayersNet(false);
+  // Give the BatchNorm layer nontrivial statistics.
+  const vector<shared_ptr<Blob<Dtype> > >& bn_blobs =
+      this->net_->layer_by_name("bn1")->blobs();
+  filler.Fill(bn_blobs[0].get());
+  FillerParameter variance_filler_param;
+  variance_filler_param.set_min(0.5);
+  variance_filler_param.set_max(1.5);
+  UniformFiller<Dtype> variance_filler(variance_filler_param);
+  variance_filler.Fill(bn_blobs[1].get());
+  bn_blobs[2]->mutable_cpu_data()[0] = 2;
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->blob_by_name("data")->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> unfused_output;
+  unfused_output.CopyFrom(*this->net_->blob_by_name("relu2"), false, true);
+  shared_ptr<Net<Dtype> > unfused_net = this->net_;
+
+  this->InitFusedLayersNet(true);
+  this->net_->CopyTrainedLayersFrom(trained_param);
+  EXPECT_EQ("conv1", this->net_->layer_by_name("bn1")->layer_param()
+      .fusion_param().fused_into());
+  EXPECT_EQ("conv1", this->net_->layer_by_name("relu1")->layer_param()
+      .fusion_param().fused_into());
+  EXPECT_EQ("conv2", this->net_->layer_by_name("scale2")->layer_param()
+      .fusion_param().fused_into());
+  // relu2 is not in place, so it still runs.
+  EXPECT_FALSE(this->net_->layer_by_name("relu2")->layer_param()
+      .has_fusion_param());
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->blob_by_name("data")->mutable_cpu_data());
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass == 1) {
+      // Changing a folded layer's parameters must refold the weights.
+      for (int i = 0; i < 2; ++i) {
+        Net<Dtype>* net = i ? this->net_.get() : unfused_net.get();
+        caffe_scal<Dtype>(4, Dtype(-0.5),
+            net->layer_by_name("scale1")->blobs()[0]->mutable_cpu_data());
+      }
+      unfused_net->Forward();
+      unfused_output.CopyFrom(*unfused_net->blob_by_name("relu2"));
+    }
+    this->net_->Forward();
+    const Blob<Dtype>* fused_output = this->net_->blob_by_name("relu2").get();
+    ASSERT_EQ(unfused_output.shape(), fused_output->shape());
+    for (int i = 0; i < unfused_output.count(); ++i) {
+      EXPECT_NEAR(unfused_output.cpu_data()[i], fused_output->cpu_data()[i],
+          1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseLayersForceBackward) {
+  // A backward pass needs the BatchNorm, Scale and ReLU layers to run, so
+  // force_backward leaves them unfused.
+  Caffe::set_mode(Caffe::CPU);
+  this->InitFusedLayersNet(true, true);
+  const char* layer_names[] = {"bn1", "scale1", "relu1", "scale2"};
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_FALSE(this->net_->layer_by_name(layer_names[i])->layer_param()
+        .has_fusion_param());
+  }
+  this->net_->Forward();
+  this->net_->Backward();
+}
+
+TYPED_TEST(NetTest, TestShareActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run the same net, with the same weights, with and without sharing the
+  // activation storage, and check that the outputs match.
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 4, 4);
+  filler.Fill(&input);
+
+  this->InitBranchingNet("");
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->blob_by_name("data")->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> unshared_output;
+  unshared_output.CopyFrom(*this->net_->blob_by_name("ip4"), false, true);
+
+  this->InitBranchingNet("share_activations: true");
+  this->net_->CopyTrainedLayersFrom(trained_param);
+  // ip1 is dead once ip2 is computed, so ip3a can reuse its storage; the
+  // input and the output keep theirs.
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  const shared_ptr<SyncedMemory>& data = blobs[0]->data();
+  const shared_ptr<SyncedMemory>& output = blobs.back()->data();
+  EXPECT_EQ(this->net_->blob_by_name("ip1")->data(),
+      this->net_->blob_by_name("ip3a")->data());
+  for (int i = 1; i < blobs.size() - 1; ++i) {
+    EXPECT_NE(data, blobs[i]->data());
+    EXPECT_NE(output, blobs[i]->data());
+  }
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->blob_by_name("data")->mutable_cpu_data());
+  for (int pass = 0; pass < 2; ++pass) {
+    this->net_->Forward();
+    const Blob<Dtype>* shared_output = this->net_->blob_by_name("ip4").get();
+    ASSERT_EQ(unshared_output.shape(), shared_output->shape());
+    for (int i = 0; i < unshared_output.count(); ++i) {
+      EXPECT_FLOAT_EQ(unshared_output.cpu_data()[i],
+          shared_output->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestRecomputeActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Train the same net, with the same weights, with and without recomputing
+  // the Pooling and ReLU tops in Backward, and check that the loss and the
+  // gradients match.
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(2, 3, 6, 6);
+  Blob<Dtype> target(2, 3, 1, 1);
+  filler.Fill(&data);
+  filler.Fill(&target);
+
+  this->InitRecomputeNet(false);
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  shared_ptr<Net<Dtype> > stored_net = this->net_;
+  this->InitRecomputeNet(true);
+  this->net_->CopyTrainedLayersFrom(trained_param);
+  shared_ptr<Net<Dtype> > recompute_net = this->net_;
+  for (int i = 0; i < 2; ++i) {
+    Net<Dtype>* net = i ? recompute_net.get() : stored_net.get();
+    caffe_copy(data.count(), data.cpu_data(),
+        net->blob_by_name("data")->mutable_cpu_data());
+    caffe_copy(target.count(), target.cpu_data(),
+        net->blob_by_name("target")->mutable_cpu_data());
+  }
+  for (int iter = 0; iter < 2; ++iter) {
+    Dtype stored_loss, recompute_loss;
+    stored_net->Forward(&stored_loss);
+    recompute_net->Forward(&recompute_loss);
+    EXPECT_FLOAT_EQ(stored_loss, recompute_loss);
+    // The recomputed tops are released once the forward pass is done.
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+        recompute_net->blob_by_name("pool1")->data()->head());
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+        recompute_net->blob_by_name("relu2")->data()->head());
+    EXPECT_NE(SyncedMemory::UNINITIALIZED,
+        recompute_net->blob_by_name("conv2")->data()->head());
+    stored_net->Backward();
+    recompute_net->Backward();
+    const vector<Blob<Dtype>*>& stored_params =
+        stored_net->learnable_params();
+    const vector<Blob<Dtype>*>& recompute_params =
+        recompute_net->learnable_params();
+    ASSERT_EQ(stored_params.size(), recompute_params.size());
+    for (int i = 0; i < stored_params.size(); ++i) {
+      for (int j = 0; j < stored_params[i]->count(); ++j) {
+        EXPECT_FLOAT_EQ(stored_params[i]->cpu_diff()[j],
+            recompute_params[i]->cpu_diff()[j]);
+      }
+    }
+    const Blob<Dtype>* stored_data = stored_net->blob_by_name("data").get();
+    const Blob<Dtype>* recompute_data =
+        recompute_net->blob_by_name("data").get();
+    for (int j = 0; j < data.count(); ++j) {
+      EXPECT_FLOAT_EQ(stored_data->cpu_diff()[j],
+          recompute_data->cpu_diff()[j]);
+    }
+    stored_net->Update();
+    recompute_net->Update();
+  }
+}
+
+TYPED_TEST(NetTest, TestForwardOnlyBlobs) {
+  typedef typename TypeParam::Dtype Dtype;
+  // An inference net never needs backward, so its blobs get no diffs.
+  this->InitBranchingNet("");
+  const vector<shared_ptr<Blob<Dtype> > >* blobs = &this->net_->blobs();
+  for (int i = 0; i < blobs->size(); ++i) {
+    EXPECT_TRUE((*blobs)[i]->forward_only());
+  }
+  this->net_->Forward();
+  EXPECT_GT(this->net_->blob_data_bytes(), 0);
+  EXPECT_EQ(0, this->net_->blob_diff_bytes());
+
+  // A training net keeps them.
+  this->InitRecomputeNet(false);
+  blobs = &this->net_->blobs();
+  for (int i = 0; i < blobs->size(); ++i) {
+    EXPECT_FALSE((*blobs)[i]->forward_only());
+  }
+  this->net_->Forward();
+  const size_t forward_diff_bytes = this->net_->blob_diff_bytes();
+  this->net_->Backward();
+  EXPECT_GT(this->net_->blob_diff_bytes(), forward_diff_bytes);
+}
+
+TYPED_TEST(NetTest, TestForwardThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run the same net, with the same weights, on one and on several threads,
+  // and check that the outputs match.
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(Caffe::CPU);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 4, 4);
+  filler.Fill(&input);
+
+  this->InitBranchingNet("");
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->blob_by_name("data")->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> serial_output;
+  serial_output.CopyFrom(*this->net_->blob_by_name("ip4"), false, true);
+
+  for (int share = 0; share < 2; ++share) {
+    this->InitBranchingNet(share ? "forward_threads: 4 share_activations: true"
+        : "forward_threads: 4");
+    this->net_->CopyTrainedLayersFrom(trained_param);
+    for (int pass = 0; pass < 10; ++pass) {
+      caffe_copy(input.count(), input.cpu_data(),
+          this->net_->blob_by_name("data")->mutable_cpu_data());
+      this->net_->Forward();
+      const Blob<Dtype>* output = this->net_->blob_by_name("ip4").get();
+      ASSERT_EQ(serial_output.shape(), output->shape());
+      for (int i = 0; i < serial_output.count(); ++i) {
+        EXPECT_FLOAT_EQ(serial_output.cpu_data()[i], output->cpu_data()[i]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShapeBuckets) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'BucketNet' "
+      "shape_bucket { shape { dim: 1 dim: 2 dim: 8 dim: 8 } } "
+      "shape_bucket { shape { dim: 2 dim: 2 dim: 16 dim: 12 } } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape { dim: 1 dim: 2 dim: 6 dim: 6 } } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "  convolution_param { "
+      "    num_output: 3 "
+      "    kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv' "
+      "  top: 'relu' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling' "
+      "  bottom: 'relu' "
+      "  top: 'pool' "
+      "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  ASSERT_EQ(2, this->net_->num_shape_buckets());
+  // The net keeps the shapes it was defined with.
+  Blob<Dtype>* data = this->net_->input_blobs()[0];
+  EXPECT_EQ(6, data->height());
+
+  vector<vector<int> > shapes(1, data->shape());
+  EXPECT_EQ(0, this->net_->FindShapeBucket(shapes));
+  shapes[0][2] = 10;
+  EXPECT_EQ(1, this->net_->FindShapeBucket(shapes));
+  shapes[0][3] = 13;
+  EXPECT_EQ(-1, this->net_->FindShapeBucket(shapes));
+  shapes[0].pop_back();
+  EXPECT_EQ(-1, this->net_->FindShapeBucket(shapes));
+
+  // Running any of the buckets, or a smaller shape, reuses the storage the
+  // net was given at Init.
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  vector<const SyncedMemory*> memories;
+  for (int i = 0; i < blobs.size(); ++i) {
+    memories.push_back(blobs[i]->data().get());
+  }
+  for (int pass = 0; pass < 3; ++pass) {
+    if (pass < 2) {
+      this->net_->ReshapeToBucket(1 - pass);
+    } else {
+      data->Reshape(2, 2, 9, 7);
+      this->net_->Reshape();
+    }
+    this->net_->Forward();
+    for (int i = 0; i < blobs.size(); ++i) {
+      EXPECT_EQ(memories[i], blobs[i]->data().get());
+    }
+  }
+  EXPECT_EQ(4, this->net_->blob_by_name("pool")->height());
+  EXPECT_EQ(3, this->net_->blob_by_name("pool")->width());
+}
+
+// Runs the forward pass of net on input num_passes times, on the CPU, and
+// copies the last output to output.
+template <typename Dtype>
+static void RunExecutor(Net<Dtype>* net, const Blob<Dtype>* input,
+    const int num_passes, Blob<Dtype>* output) {
+  Caffe::set_mode(Caffe::CPU);
+  for (int pass = 0; pass < num_passes; ++pass) {
+    net->input_blobs()[0]->CopyFrom(*input);
+    net->Forward();
+  }
+  output->CopyFrom(*net->output_blobs()[0], false, true);
+}
+
+TYPED_TEST(NetTest, TestExecutors) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 4, 4);
+  filler.Fill(&input);
+  this->InitBranchingNet("");
+  Blob<Dtype> expected_output;
+  RunExecutor(this->net_.get(), &input, 1, &expected_output);
+
+  const int kNumExecutors = 4;
+  vector<shared_ptr<Net<Dtype> > > executors;
+  for (int i = 0; i < kNumExecutors; ++i) {
+    executors.push_back(this->net_->CreateExecutor());
+    // The executors use the net's parameter blobs, and their own
+    // activations.
+    const vector<shared_ptr<Blob<Dtype> > >& params = executors[i]->params();
+    ASSERT_EQ(this->net_->params().size(), params.size());
+    for (int j = 0; j < params.size(); ++j) {
+      EXPECT_EQ(this->net_->params()[j].get(), params[j].get());
+    }
+    EXPECT_NE(this->net_->output_blobs()[0], executors[i]->output_blobs()[0]);
+  }
+  vector<shared_ptr<Blob<Dtype> > > outputs;
+  vector<shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < kNumExecutors; ++i) {
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+        boost::bind(&RunExecutor<Dtype>, executors[i].get(), &input, 20,
+                    outputs[i].get()))));
+  }
+  for (int i = 0; i < kNumExecutors; ++i) {
+    threads[i]->join();
+    ASSERT_EQ(expected_output.shape(), outputs[i]->shape());
+    for (int j = 0; j < expected_output.count(); ++j) {
+      EXPECT_FLOAT_EQ(expected_output.cpu_data()[j],
+                      outputs[i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestExecutorsShareDerivedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The folded convolution weights are built once, by the net, and shared by
+  // its executors instead of being rebuilt by each.
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(Caffe::CPU);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 7, 7);
+  filler.Fill(&input);
+  this->InitFusedLayersNet(true);
+  Blob<Dtype> expected_output;
+  RunExecutor(this->net_.get(), &input, 1, &expected_output);
+  const int num_entries = WeightCache::size();
+  EXPECT_GT(num_entries, 0);
+
+  const int kNumExecutors = 3;
+  vector<shared_ptr<Net<Dtype> > > executors;
+  vector<shared_ptr<Blob<Dtype> > > outputs;
+  vector<shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < kNumExecutors; ++i) {
+    executors.push_back(this->net_->CreateExecutor());
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+        boost::bind(&RunExecutor<Dtype>, executors[i].get(), &input, 5,
+                    outputs[i].get()))));
+  }
+  for (int i = 0; i < kNumExecutors; ++i) {
+    threads[i]->join();
+    ASSERT_EQ(expected_output.shape(), outputs[i]->shape());
+    for (int j = 0; j < expected_output.count(); ++j) {
+      EXPECT_FLOAT_EQ(expected_output.cpu_data()[j],
+                      outputs[i]->cpu_data()[j]);
+    }
+  }
+  EXPECT_EQ(num_entries, WeightCache::size());
+  // Changed weights are folded again, once for all the nets.
+  caffe_scal<Dtype>(4, Dtype(-0.5),
+      this->net_->layer_by_name("scale1")->blobs()[0]->mutable_cpu_data());
+  RunExecutor(this->net_.get(), &input, 1, &expected_output);
+  for (int i = 0; i < kNumExecutors; ++i) {
+    RunExecutor(executors[i].get(), &input, 1, outputs[i].get());
+    for (int j = 0; j < expected_output.count(); ++j) {
+      EXPECT_FLOAT_EQ(expected_output.cpu_data()[j],
+                      outputs[i]->cpu_data()[j]);
+    }
+  }
+  EXPECT_EQ(num_entries, WeightCache::size());
+}
+
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromMappedFile) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitBranchingNet("");
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  shared_ptr<Net<Dtype> > trained_net = this->net_;
+  for (int aligned = 0; aligned < 2; ++aligned) {
+    string filename;
+    MakeTempFilename(&filename);
+    if (aligned) {
+      WriteNetParamsToAlignedBinaryFile(trained_param, filename);
+    } else {
+      WriteProtoToBinaryFile(trained_param, filename);
+    }
+    this->InitBranchingNet("");
+    this->net_->CopyTrainedLayersFrom(filename);
+    const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+    ASSERT_EQ(trained_net->params().size(), params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      const Blob<Dtype>* trained_blob = trained_net->params()[i].get();
+      for (int j = 0; j < trained_blob->count(); ++j) {
+        EXPECT_EQ(trained_blob->cpu_data()[j], params[i]->cpu_data()[j]);
+      }
+      // Aligned float weights are used in place from the mapped file.
+      if (aligned && sizeof(Dtype) == sizeof(float)) {
+        EXPECT_EQ(0, reinterpret_cast<uintptr_t>(params[i]->cpu_data()) % 64);
+      }
+    }
+    // The mapping is private: the weights can be changed, without changing
+    // the file.
+    params[0]->mutable_cpu_data()[0] += 1;
+    shared_ptr<Net<Dtype> > reloaded_net = this->net_;
+    this->InitBranchingNet("");
+    this->net_->CopyTrainedLayersFrom(filename);
+    EXPECT_EQ(trained_net->params()[0]->cpu_data()[0],
+              this->net_->params()[0]->cpu_data()[0]);
+    EXPECT_EQ(trained_net->params()[0]->cpu_data()[0] + 1,
+              reloaded_net->params()[0]->cpu_data()[0]);
+  }
+}
+
+TYPED_TEST(NetTest, TestPruneToOutputs) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->InitBranchingNet("");
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  filler.Fill(this->net_->input_blobs()[0]);
+  this->net_->Forward();
+  shared_ptr<Net<Dtype> > full_net = this->net_;
+
+  this->InitBranchingNet("output_blob: 'ip3b' output_blob: 'ip1'");
+  // Only the layers the requested blobs depend on are left, and only those
+  // blobs are outputs, in the order requested.
+  const char* kLayerNames[] = {"data", "ip1", "relu1", "ip2", "ip3b"};
+  const vector<string>& layer_names = this->net_->layer_names();
+  ASSERT_EQ(5, layer_names.size());
+  for (int i = 0; i < layer_names.size(); ++i) {
+    EXPECT_EQ(kLayerNames[i], layer_names[i]);
+  }
+  const vector<Blob<Dtype>*>& outputs = this->net_->output_blobs();
+  ASSERT_EQ(2, outputs.size());
+  EXPECT_EQ(this->net_->blob_by_name("ip3b").get(), outputs[0]);
+  EXPECT_EQ(this->net_->blob_by_name("ip1").get(), outputs[1]);
+
+  // The outputs are computed as by the full net.
+  this->net_->CopyTrainedLayersFrom(trained_param);
+  this->net_->input_blobs()[0]->CopyFrom(*full_net->input_blobs()[0]);
+  this->net_->Forward();
+  const char* kOutputNames[] = {"ip3b", "ip1"};
+  for (int i = 0; i < outputs.size(); ++i) {
+    const Blob<Dtype>* expected = full_net->blob_by_name(kOutputNames[i]).get();
+    ASSERT_EQ(expected->shape(), outputs[i]->shape());
+    for (int j = 0; j < expected->count(); ++j) {
+      EXPECT_EQ(expected->cpu_data()[j], outputs[i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestOptimizeGraph) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->InitBranchingNet("");
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  filler.Fill(this->net_->input_blobs()[0]);
+  this->net_->Forward();
+  shared_ptr<Net<Dtype> > full_net = this->net_;
+
+  // ip2 is read twice, but the optimized net reads it without a Split layer.
+  this->InitBranchingNet("optimize_graph: true");
+  EXPECT_EQ(full_net->layers().size() - 1, this->net_->layers().size());
+  EXPECT_FALSE(this->net_->has_layer("ip2_ip2_0_split"));
+  this->net_->CopyTrainedLayersFrom(trained_param);
+  this->net_->input_blobs()[0]->CopyFrom(*full_net->input_blobs()[0]);
+  this->net_->Forward();
+  const Blob<Dtype>* expected = full_net->output_blobs()[0];
+  const Blob<Dtype>* output = this->net_->output_blobs()[0];
+  ASSERT_EQ(expected->shape(), output->shape());
+  for (int i = 0; i < expected->count(); ++i) {
+    EXPECT_EQ(expected->cpu_data()[i], output->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -225,6 +225,45 @@ TYPED_TEST(NeuronLayerTest, TestReLU) {
   }
 }
 
+// A ReLULayer counting the calls to its Reshape.
+template <typename Dtype>
+class ReshapeCountingReLULayer : public ReLULayer<Dtype> {
+ public:
+  explicit ReshapeCountingReLULayer(const LayerParameter& param)
+      : ReLULayer<Dtype>(param), num_reshapes_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    ++num_reshapes_;
+    ReLULayer<Dtype>::Reshape(bottom, top);
+  }
+  int num_reshapes_;
+};
+
+TYPED_TEST(NeuronLayerTest, TestReshapeOnlyOnShapeChange) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReshapeCountingReLULayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int setup_reshapes = layer.num_reshapes_;
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(setup_reshapes + 1, layer.num_reshapes_);
+  // Forward skips Reshape while the shapes stay the same...
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->blob_bottom_->Reshape(this->blob_bottom_->shape());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(setup_reshapes + 1, layer.num_reshapes_);
+  // ...and runs it when they change,
+  this->blob_bottom_->Reshape(3, 2, 4, 5);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(setup_reshapes + 2, layer.num_reshapes_);
+  EXPECT_EQ(this->blob_bottom_->shape(), this->blob_top_->shape());
+  // or when the storage of a blob is replaced.
+  Blob<Dtype> other(3, 2, 4, 5);
+  this->blob_bottom_->ShareData(other);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(setup_reshapes + 3, layer.num_reshapes_);
+}
+
 TYPED_TEST(NeuronLayerTest, TestReLUGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -0,0 +1,155 @@
+#include <map>
+#include <string>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/quantize.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class QuantizeNetTest : public ::testing::Test {
+ protected:
+  void RunQuantizeTest(const string& input_param_string,
+      const map<string, float>& bottom_ranges,
+      const string& output_param_string) {
+    // Test that QuantizeNet called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    QuantizeNet(input_param, bottom_ranges, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+  }
+};
+
+TEST_F(QuantizeNetTest, TestNoRanges) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'innerprod' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerprod' "
+      "  top: 'innerprod' "
+      "} ";
+  this->RunQuantizeTest(input_proto, map<string, float>(), input_proto);
+}
+
+TEST_F(QuantizeNetTest, TestFuseReLU) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'innerprod1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv' "
+      "  top: 'innerprod1' "
+      "} "
+      "layer { "
+      "  name: 'relu2' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerprod1' "
+      "  top: 'relu2' "
+      "} "
+      "layer { "
+      "  name: 'innerprod2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'relu2' "
+      "  top: 'innerprod2' "
+      "} "
+      "layer { "
+      "  name: 'relu3' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerprod2' "
+      "  top: 'innerprod2' "
+      "  relu_param { negative_slope: 0.1 } "
+      "} ";
+  // Only the in-place, unleaky ReLU is folded into its producer.
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 engine: CAFFE } "
+      "  quantization_param { bottom_range: 1.5 relu: true } "
+      "} "
+      "layer { "
+      "  name: 'innerprod1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv' "
+      "  top: 'innerprod1' "
+      "  quantization_param { bottom_range: 2 } "
+      "} "
+      "layer { "
+      "  name: 'relu2' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerprod1' "
+      "  top: 'relu2' "
+      "} "
+      "layer { "
+      "  name: 'innerprod2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'relu2' "
+      "  top: 'innerprod2' "
+      "  quantization_param { bottom_range: 3 } "
+      "} "
+      "layer { "
+      "  name: 'relu3' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerprod2' "
+      "  top: 'innerprod2' "
+      "  relu_param { negative_slope: 0.1 } "
+      "} ";
+  map<string, float> bottom_ranges;
+  bottom_ranges["conv"] = 1.5;
+  bottom_ranges["innerprod1"] = 2;
+  bottom_ranges["innerprod2"] = 3;
+  this->RunQuantizeTest(input_proto, bottom_ranges, expected_output_proto);
+}
+
+}  // namespace caffe
@@ -0,0 +1,113 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/reorder_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ReorderLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+ protected:
+  ReorderLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 5, 3, 4)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_planar_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    // fill the values
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_top_planar_vec_.push_back(blob_top_planar_);
+  }
+  virtual ~ReorderLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_planar_;
+  }
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_planar_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<Blob<Dtype>*> blob_top_planar_vec_;
+};
+
+TYPED_TEST_CASE(ReorderLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ReorderLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_blocked_layout_param()->set_block(4);
+  ReorderLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(this->blob_top_->num_axes(), 5);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 2);
+  EXPECT_EQ(this->blob_top_->shape(2), 3);
+  EXPECT_EQ(this->blob_top_->shape(3), 4);
+  EXPECT_EQ(this->blob_top_->shape(4), 4);
+}
+
+TYPED_TEST(ReorderLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_blocked_layout_param()->set_block(4);
+  ReorderLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 8; ++c) {
+      for (int h = 0; h < 3; ++h) {
+        for (int w = 0; w < 4; ++w) {
+          const Dtype expected = (c < 5) ?
+              this->blob_bottom_->data_at(n, c, h, w) : Dtype(0);
+          EXPECT_EQ(expected,
+              top_data[(((n * 2 + c / 4) * 3 + h) * 4 + w) * 4 + c % 4]);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ReorderLayerTest, TestRoundTrip) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  BlockedLayoutParameter* layout_param =
+      layer_param.mutable_blocked_layout_param();
+  layout_param->set_block(4);
+  ReorderLayer<Dtype> to_blocked(layer_param);
+  to_blocked.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  to_blocked.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layout_param->add_bottom_channels(5);
+  ReorderLayer<Dtype> to_planar(layer_param);
+  to_planar.SetUp(this->blob_top_vec_, this->blob_top_planar_vec_);
+  to_planar.Forward(this->blob_top_vec_, this->blob_top_planar_vec_);
+  ASSERT_EQ(this->blob_bottom_->shape(), this->blob_top_planar_->shape());
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i],
+        this->blob_top_planar_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(ReorderLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_blocked_layout_param()->set_block(4);
+  ReorderLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
@@ -122,6 +122,34 @@ TEST_F(SyncedMemoryTest, TestAllocationCPU) {
   EXPECT_TRUE(mem.mutable_cpu_data());
 }
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  const uint64_t initial_version = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), initial_version);
+  mem.mutable_cpu_data();
+  const uint64_t written_version = mem.version();
+  EXPECT_NE(written_version, initial_version);
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), written_version);
+  char data[10];
+  mem.set_cpu_data(data);
+  EXPECT_NE(mem.version(), written_version);
+}
+
+TEST_F(SyncedMemoryTest, TestVersionUnique) {
+  // Memory created where deleted memory was, after as many writes, still has
+  // a version of its own.
+  shared_ptr<SyncedMemory> mem(new SyncedMemory(10));
+  mem->mutable_cpu_data();
+  const uint64_t version = mem->version();
+  mem.reset(new SyncedMemory(10));
+  EXPECT_NE(mem->version(), version);
+  mem->mutable_cpu_data();
+  EXPECT_NE(mem->version(), version);
+  EXPECT_GT(mem->version(), version);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestAllocationGPU) {
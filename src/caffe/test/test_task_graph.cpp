@@ -0,0 +1,86 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/task_graph.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TaskGraphTest : public ::testing::Test {
+ protected:
+  TaskGraphTest() : graph_(8, 3), started_(8, -1), finished_(8, -1),
+      clock_(0) {
+    // Two chains, 0 -> 2 -> 4 -> 6 and 1 -> 3 -> 5, joined by 7, with a
+    // shortcut from 0 to 5.
+    AddDependency(0, 2);
+    AddDependency(2, 4);
+    AddDependency(4, 6);
+    AddDependency(1, 3);
+    AddDependency(3, 5);
+    AddDependency(0, 5);
+    AddDependency(5, 7);
+    AddDependency(6, 7);
+  }
+
+  void AddDependency(int from, int to) {
+    graph_.AddDependency(from, to);
+    dependencies_.push_back(std::make_pair(from, to));
+  }
+
+  void RunTask(int task) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      EXPECT_EQ(-1, started_[task]) << "task " << task << " ran twice";
+      started_[task] = clock_++;
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    boost::mutex::scoped_lock lock(mutex_);
+    finished_[task] = clock_++;
+  }
+
+  void Run(int first, int last) {
+    started_.assign(started_.size(), -1);
+    finished_.assign(finished_.size(), -1);
+    graph_.Run(first, last, boost::bind(&TaskGraphTest::RunTask, this, _1));
+    for (int i = 0; i < started_.size(); ++i) {
+      const bool in_range = i >= first && i <= last;
+      EXPECT_EQ(in_range, finished_[i] >= 0) << "task " << i;
+    }
+    for (int i = 0; i < dependencies_.size(); ++i) {
+      const int from = dependencies_[i].first;
+      const int to = dependencies_[i].second;
+      if (from >= first && to <= last) {
+        EXPECT_LT(finished_[from], started_[to])
+            << "task " << to << " started before task " << from;
+      }
+    }
+  }
+
+  TaskGraph graph_;
+  vector<std::pair<int, int> > dependencies_;
+  boost::mutex mutex_;
+  vector<int> started_;
+  vector<int> finished_;
+  int clock_;
+};
+
+TEST_F(TaskGraphTest, TestRun) {
+  EXPECT_EQ(8, graph_.num_tasks());
+  EXPECT_EQ(3, graph_.num_threads());
+  for (int i = 0; i < 5; ++i) {
+    Run(0, 7);
+  }
+}
+
+TEST_F(TaskGraphTest, TestRunRange) {
+  Run(2, 5);
+  Run(7, 7);
+  Run(0, 0);
+}
+
+}  // namespace caffe
@@ -0,0 +1,149 @@
+#include <cstring>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/tensor_record.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TensorRecordTest : public ::testing::Test {
+ protected:
+  TensorRecordTest() {
+    datum_.set_channels(2);
+    datum_.set_height(1);
+    datum_.set_width(3);
+    datum_.set_label(7);
+  }
+
+  // Checks that datum_ comes back from its tensor record, with or without
+  // aliasing, the way ParseDatumRecord returns it from its serialization.
+  void TestRoundTrip() {
+    string value;
+    DatumToTensorRecord(datum_, &value);
+    EXPECT_TRUE(IsTensorRecord(value.data(), value.size()));
+    string datum_value;
+    CHECK(datum_.SerializeToString(&datum_value));
+    EXPECT_FALSE(IsTensorRecord(datum_value.data(), datum_value.size()));
+    for (int alias = 0; alias < 2; ++alias) {
+      DatumRecord record;
+      EXPECT_TRUE(ParseDatumRecord(value.data(), value.size(), alias,
+          &record));
+      EXPECT_EQ(datum_.data(), string(record.data, record.size));
+      EXPECT_EQ(datum_.labels_size(), record.num_labels);
+      Datum parsed(record.datum);
+      if (alias) {
+        EXPECT_FALSE(record.datum.has_data());
+        EXPECT_EQ(0, record.datum.labels_size());
+        if (record.size) {
+          parsed.set_data(record.data, record.size);
+        }
+        for (int i = 0; i < record.num_labels; ++i) {
+          float label;
+          memcpy(&label, record.labels + i * sizeof(label), sizeof(label));
+          parsed.add_labels(label);
+        }
+      }
+      EXPECT_EQ(datum_.DebugString(), parsed.DebugString());
+    }
+  }
+
+  Datum datum_;
+};
+
+TEST_F(TensorRecordTest, TestUInt8) {
+  datum_.set_data("abcdef");
+  this->TestRoundTrip();
+}
+
+TEST_F(TensorRecordTest, TestFloat) {
+  for (int i = 0; i < 6; ++i) {
+    datum_.add_float_data(i * 0.5 - 1);
+  }
+  this->TestRoundTrip();
+}
+
+TEST_F(TensorRecordTest, TestEncoded) {
+  datum_.set_data("encoded image");
+  datum_.set_encoded(true);
+  this->TestRoundTrip();
+}
+
+TEST_F(TensorRecordTest, TestLabels) {
+  datum_.set_data("abcdef");
+  datum_.clear_label();
+  datum_.add_labels(0.5);
+  datum_.add_labels(-2);
+  datum_.add_labels(3);
+  this->TestRoundTrip();
+}
+
+TEST_F(TensorRecordTest, TestAliasedData) {
+  datum_.set_data("abcdef");
+  string value;
+  DatumToTensorRecord(datum_, &value);
+  DatumRecord record;
+  EXPECT_TRUE(ParseTensorRecord(value.data(), value.size(), true, &record));
+  // The data bytes are left in the value.
+  EXPECT_GE(record.data, value.data());
+  EXPECT_LE(record.data + record.size, value.data() + value.size());
+}
+
+TEST_F(TensorRecordTest, TestMalformed) {
+  datum_.set_data("abcdef");
+  string value;
+  DatumToTensorRecord(datum_, &value);
+  DatumRecord record;
+  // Truncated.
+  EXPECT_FALSE(ParseTensorRecord(value.data(), value.size() - 1, false,
+      &record));
+  // Not as many bytes as channels x height x width.
+  datum_.set_data("abc");
+  DatumToTensorRecord(datum_, &value);
+  EXPECT_FALSE(ParseTensorRecord(value.data(), value.size(), false,
+      &record));
+}
+
+TEST_F(TensorRecordTest, TestCorrupt) {
+  datum_.set_data("abcdef");
+  string value;
+  DatumToTensorRecord(datum_, &value);
+  TensorRecordHeader header;
+  memcpy(&header, value.data(), sizeof(header));
+  DatumRecord record;
+  string corrupt = value;
+  // Sizes that only add up to the value's size by overflowing.
+  TensorRecordHeader wrapped(header);
+  wrapped.num_float_labels = 1 << 30;
+  wrapped.payload_bytes -= static_cast<uint64_t>(wrapped.num_float_labels) *
+      sizeof(float);
+  memcpy(&corrupt[0], &wrapped, sizeof(wrapped));
+  EXPECT_FALSE(ParseTensorRecord(corrupt.data(), corrupt.size(), false,
+      &record));
+  wrapped = header;
+  wrapped.payload_bytes = ~static_cast<uint64_t>(0);
+  memcpy(&corrupt[0], &wrapped, sizeof(wrapped));
+  EXPECT_FALSE(ParseTensorRecord(corrupt.data(), corrupt.size(), true,
+      &record));
+  // Shapes whose product is right, but with negative or zero dimensions.
+  TensorRecordHeader negative(header);
+  negative.channels = -2;
+  negative.height = -1;
+  memcpy(&corrupt[0], &negative, sizeof(negative));
+  EXPECT_FALSE(ParseTensorRecord(corrupt.data(), corrupt.size(), true,
+      &record));
+  TensorRecordHeader empty(header);
+  empty.channels = 0;
+  memcpy(&corrupt[0], &empty, sizeof(empty));
+  EXPECT_FALSE(ParseTensorRecord(corrupt.data(), corrupt.size(), true,
+      &record));
+  // The record itself is still fine.
+  EXPECT_TRUE(ParseTensorRecord(value.data(), value.size(), true, &record));
+}
+
+}  // namespace caffe
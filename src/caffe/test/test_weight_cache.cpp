@@ -0,0 +1,90 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/weight_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class WeightCacheTest : public ::testing::Test {
+ public:
+  // Builds an entry holding twice the float in source_.
+  void Double(vector<float>* entry) {
+    ++builds_;
+    entry->assign(1, 2 * *static_cast<const float*>(source_->cpu_data()));
+  }
+
+ protected:
+  WeightCacheTest() : source_(new SyncedMemory(sizeof(float))), builds_(0) {
+    *static_cast<float*>(source_->mutable_cpu_data()) = 2;
+  }
+
+  WeightCache::Sources sources() const {
+    return WeightCache::Sources(1,
+        std::make_pair(source_.get(), source_->version()));
+  }
+
+  shared_ptr<SyncedMemory> source_;
+  int builds_;
+};
+
+TEST_F(WeightCacheTest, TestBuildOnce) {
+  const int size = WeightCache::size();
+  shared_ptr<vector<float> > first = WeightCache::Get("double", sources(),
+      this, &WeightCacheTest::Double);
+  shared_ptr<vector<float> > second = WeightCache::Get("double", sources(),
+      this, &WeightCacheTest::Double);
+  EXPECT_EQ(builds_, 1);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ((*first)[0], 4);
+  EXPECT_EQ(WeightCache::size(), size + 1);
+  // Another kind of entry from the same sources is built separately.
+  shared_ptr<vector<float> > other = WeightCache::Get("other", sources(),
+      this, &WeightCacheTest::Double);
+  EXPECT_EQ(builds_, 2);
+  EXPECT_NE(first, other);
+  EXPECT_EQ(WeightCache::size(), size + 2);
+}
+
+TEST_F(WeightCacheTest, TestRebuildOnChange) {
+  shared_ptr<vector<float> > first = WeightCache::Get("double", sources(),
+      this, &WeightCacheTest::Double);
+  *static_cast<float*>(source_->mutable_cpu_data()) = 3;
+  shared_ptr<vector<float> > second = WeightCache::Get("double", sources(),
+      this, &WeightCacheTest::Double);
+  EXPECT_EQ(builds_, 2);
+  EXPECT_EQ((*first)[0], 4);
+  EXPECT_EQ((*second)[0], 6);
+}
+
+TEST_F(WeightCacheTest, TestRelease) {
+  const int size = WeightCache::size();
+  shared_ptr<vector<float> > entry = WeightCache::Get("double", sources(),
+      this, &WeightCacheTest::Double);
+  EXPECT_EQ(WeightCache::size(), size + 1);
+  entry.reset();
+  EXPECT_EQ(WeightCache::size(), size);
+  entry = WeightCache::Get("double", sources(), this,
+      &WeightCacheTest::Double);
+  EXPECT_EQ(builds_, 2);
+}
+
+TEST_F(WeightCacheTest, TestAlias) {
+  shared_ptr<vector<float> > entry = WeightCache::Get("double", sources(),
+      this, &WeightCacheTest::Double);
+  SyncedMemory other(sizeof(float));
+  const WeightCache::Sources other_sources(1,
+      std::make_pair(&other, other.version()));
+  WeightCache::Alias("double", other_sources, entry);
+  EXPECT_EQ(WeightCache::Get("double", other_sources, this,
+      &WeightCacheTest::Double), entry);
+  EXPECT_EQ(builds_, 1);
+}
+
+}  // namespace caffe
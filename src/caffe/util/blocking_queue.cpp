@@ -3,6 +3,7 @@
 
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
@@ -88,8 +89,11 @@ size_t BlockingQueue<T>::size() const {
 
 template class BlockingQueue<Batch<float>*>;
 template class BlockingQueue<Batch<double>*>;
-template class BlockingQueue<Datum*>;
+template class BlockingQueue<HDF5Batch<float>*>;
+template class BlockingQueue<HDF5Batch<double>*>;
+template class BlockingQueue<DatumRecord*>;
 template class BlockingQueue<shared_ptr<DataReader::QueuePair> >;
+template class BlockingQueue<DataReader::Stream::Value*>;
 template class BlockingQueue<P2PSync<float>*>;
 template class BlockingQueue<P2PSync<double>*>;
 
@@ -2,7 +2,15 @@
 #include "caffe/util/db_leveldb.hpp"
 #include "caffe/util/db_lmdb.hpp"
 
+#include <unistd.h>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
 
 namespace caffe { namespace db {
 
@@ -37,5 +45,82 @@ DB* GetDB(const string& backend) {
   return NULL;
 }
 
+// The first line of an index of num_keys keys of a database with the given
+// fingerprint.
+static string KeyIndexHeader(int num_keys, const string& fingerprint) {
+  return "# " + format_int(num_keys) + " keys of " + fingerprint;
+}
+
+void GetKeyIndex(const string& source, DB* db, vector<string>* keys) {
+  keys->clear();
+  const string index_file = source + ".keys";
+  const string fingerprint = db->Fingerprint();
+  std::ifstream input(index_file.c_str());
+  string header;
+  if (std::getline(input, header)) {
+    string key;
+    while (std::getline(input, key)) {
+      keys->push_back(key);
+    }
+    if (header == KeyIndexHeader(keys->size(), fingerprint)) {
+      LOG(INFO) << "Read " << keys->size() << " keys from " << index_file;
+      return;
+    }
+    LOG(INFO) << index_file << " is not an index of " << source
+        << " as it is now, listing its keys again";
+    keys->clear();
+  }
+  boost::scoped_ptr<Cursor> cursor(db->NewCursor());
+  bool one_per_line = true;
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+    keys->push_back(cursor->key());
+    one_per_line = one_per_line && keys->back().find('\n') == string::npos;
+  }
+  LOG(INFO) << "Found " << keys->size() << " keys in " << source;
+  if (!one_per_line) {
+    LOG(WARNING) << "Not writing " << index_file << ": keys contain newlines";
+    return;
+  }
+  // Written aside, then renamed, so that no reader sees part of it.
+  const string temp_file = index_file + "." + format_int(getpid());
+  std::ofstream output(temp_file.c_str(), std::ios::out | std::ios::trunc);
+  output << KeyIndexHeader(keys->size(), fingerprint) << '\n';
+  for (int i = 0; i < keys->size(); ++i) {
+    output << (*keys)[i] << '\n';
+  }
+  output.close();
+  if (!output || std::rename(temp_file.c_str(), index_file.c_str()) != 0) {
+    LOG(WARNING) << "Cannot write " << index_file;
+    std::remove(temp_file.c_str());
+  }
+}
+
+vector<string> SplitKeys(Cursor* cursor, int num_ranges,
+    vector<int>* range_sizes) {
+  int num_keys = 0;
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+    ++num_keys;
+  }
+  num_ranges = std::max(std::min(num_ranges, num_keys), 1);
+  vector<string> begin_keys(1, "");
+  int index = 0;
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next(), ++index) {
+    const int range = begin_keys.size();
+    if (range < num_ranges &&
+        index == static_cast<int64_t>(range) * num_keys / num_ranges) {
+      begin_keys.push_back(cursor->key());
+    }
+  }
+  if (range_sizes) {
+    range_sizes->clear();
+    for (int range = 0; range < num_ranges; ++range) {
+      range_sizes->push_back(
+          static_cast<int64_t>(range + 1) * num_keys / num_ranges -
+          static_cast<int64_t>(range) * num_keys / num_ranges);
+    }
+  }
+  return begin_keys;
+}
+
 }  // namespace db
 }  // namespace caffe
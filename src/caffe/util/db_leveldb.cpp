@@ -1,6 +1,7 @@
 #ifdef USE_LEVELDB
 #include "caffe/util/db_leveldb.hpp"
 
+#include <boost/functional/hash.hpp>
 #include <string>
 
 namespace caffe { namespace db {
@@ -18,6 +19,14 @@ void LevelDB::Open(const string& source, Mode mode) {
   LOG(INFO) << "Opened leveldb " << source;
 }
 
+string LevelDB::Fingerprint() {
+  string tables;
+  CHECK(db_->GetProperty("leveldb.sstables", &tables));
+  ostringstream fingerprint;
+  fingerprint << "leveldb " << std::hex << boost::hash_value(tables);
+  return fingerprint.str();
+}
+
 }  // namespace db
 }  // namespace caffe
 #endif  // USE_LEVELDB
@@ -100,6 +100,16 @@ void LMDBTransaction::Commit() {
   values.clear();
 }
 
+string LMDB::Fingerprint() {
+  MDB_stat stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &stat));
+  MDB_envinfo info;
+  MDB_CHECK(mdb_env_info(mdb_env_, &info));
+  ostringstream fingerprint;
+  fingerprint << "lmdb " << stat.ms_entries << " " << info.me_last_txnid;
+  return fingerprint.str();
+}
+
 void LMDBTransaction::DoubleMapSize() {
   struct MDB_envinfo current_info;
   MDB_CHECK(mdb_env_info(mdb_env_, &current_info));
@@ -0,0 +1,75 @@
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fuse_layers.hpp"
+
+namespace caffe {
+
+namespace {
+
+bool CanFuseConvolution(const LayerParameter& layer_param) {
+  const ConvolutionParameter_Engine engine =
+      layer_param.convolution_param().engine();
+  return layer_param.type() == "Convolution" && layer_param.top_size() == 1 &&
+      (engine == ConvolutionParameter_Engine_DEFAULT ||
+       engine == ConvolutionParameter_Engine_CAFFE);
+}
+
+bool IsInPlace(const LayerParameter& layer_param, const string& blob_name) {
+  return layer_param.bottom_size() == 1 && layer_param.top_size() == 1 &&
+      layer_param.bottom(0) == blob_name && layer_param.top(0) == blob_name;
+}
+
+// Whether layer_param is a per-channel affine transform at inference.
+bool IsFoldable(const LayerParameter& layer_param) {
+  if (layer_param.type() == "BatchNorm") {
+    const BatchNormParameter& bn_param = layer_param.batch_norm_param();
+    return !bn_param.has_use_global_stats() || bn_param.use_global_stats();
+  }
+  if (layer_param.type() == "Scale") {
+    const ScaleParameter& scale_param = layer_param.scale_param();
+    return scale_param.axis() == 1 && scale_param.num_axes() == 1;
+  }
+  return false;
+}
+
+}  // namespace
+
+void FuseLayers(const NetParameter& param, NetParameter* param_fused) {
+  param_fused->CopyFrom(param);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (!CanFuseConvolution(param.layer(i))) {
+      continue;
+    }
+    const string& conv_name = param.layer(i).name();
+    const string& blob_name = param.layer(i).top(0);
+    FusionParameter* fusion_param =
+        param_fused->mutable_layer(i)->mutable_fusion_param();
+    int j = i + 1;
+    for (; j < param.layer_size() && IsInPlace(param.layer(j), blob_name);
+         ++j) {
+      const LayerParameter& layer_param = param.layer(j);
+      if (IsFoldable(layer_param)) {
+        fusion_param->add_folded_layer(layer_param.name());
+      } else if (layer_param.type() == "ReLU" &&
+                 layer_param.relu_param().negative_slope() == 0) {
+        // Nothing can be folded past the ReLU.
+        fusion_param->set_relu(true);
+      } else {
+        break;
+      }
+      param_fused->mutable_layer(j)->mutable_fusion_param()->set_fused_into(
+          conv_name);
+      if (fusion_param->relu()) {
+        ++j;
+        break;
+      }
+    }
+    if (j == i + 1) {
+      param_fused->mutable_layer(i)->clear_fusion_param();
+    }
+    i = j - 1;
+  }
+}
+
+}  // namespace caffe
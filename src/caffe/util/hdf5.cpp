@@ -5,11 +5,8 @@
 
 namespace caffe {
 
-// Verifies format of data stored in HDF5 file and reshapes blob accordingly.
-template <typename Dtype>
-void hdf5_load_nd_dataset_helper(
-    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
-    Blob<Dtype>* blob) {
+vector<int> hdf5_get_nd_dataset_shape(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim) {
   // Verify that the dataset exists.
   CHECK(H5LTfind_dataset(file_id, dataset_name_))
       << "Failed to find HDF5 dataset " << dataset_name_;
@@ -60,7 +57,16 @@ void hdf5_load_nd_dataset_helper(
   for (int i = 0; i < dims.size(); ++i) {
     blob_dims[i] = dims[i];
   }
-  blob->Reshape(blob_dims);
+  return blob_dims;
+}
+
+// Verifies format of data stored in HDF5 file and reshapes blob accordingly.
+template <typename Dtype>
+void hdf5_load_nd_dataset_helper(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    Blob<Dtype>* blob) {
+  blob->Reshape(hdf5_get_nd_dataset_shape(file_id, dataset_name_, min_dim,
+      max_dim));
 }
 
 template <>
@@ -81,6 +87,50 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+// Reads rows of a dataset as mem_type, selecting them as a hyperslab.
+static void hdf5_load_rows(hid_t file_id, const char* dataset_name_,
+    hsize_t first_row, hsize_t num_rows, hid_t mem_type, void* data) {
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open HDF5 dataset " << dataset_name_;
+  hid_t file_space = H5Dget_space(dataset_id);
+  CHECK_GE(file_space, 0) << "Failed to get dataspace of " << dataset_name_;
+  const int ndims = H5Sget_simple_extent_ndims(file_space);
+  CHECK_GE(ndims, 1) << "Dataset " << dataset_name_ << " has no rows";
+  std::vector<hsize_t> dims(ndims);
+  H5Sget_simple_extent_dims(file_space, dims.data(), NULL);
+  CHECK_LE(first_row + num_rows, dims[0])
+      << "Rows out of the range of dataset " << dataset_name_;
+  std::vector<hsize_t> offset(ndims, 0);
+  offset[0] = first_row;
+  dims[0] = num_rows;
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      offset.data(), NULL, dims.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name_;
+  hid_t mem_space = H5Screate_simple(ndims, dims.data(), NULL);
+  status = H5Dread(dataset_id, mem_type, mem_space, file_space, H5P_DEFAULT,
+      data);
+  CHECK_GE(status, 0) << "Failed to read rows of " << dataset_name_;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset_id);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(hid_t file_id,
+    const char* dataset_name_, hsize_t first_row, hsize_t num_rows,
+    float* data) {
+  hdf5_load_rows(file_id, dataset_name_, first_row, num_rows,
+      H5T_NATIVE_FLOAT, data);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(hid_t file_id,
+    const char* dataset_name_, hsize_t first_row, hsize_t num_rows,
+    double* data) {
+  hdf5_load_rows(file_id, dataset_name_, first_row, num_rows,
+      H5T_NATIVE_DOUBLE, data);
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
@@ -0,0 +1,70 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <boost/thread.hpp>
+#include <string>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+struct ImageCache::Entry {
+  cv::Mat image;
+  size_t bytes;
+  std::list<string>::iterator recent;
+};
+
+class ImageCache::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+ImageCache::ImageCache(size_t capacity)
+    : capacity_(capacity), bytes_(0), sync_(new sync()) {
+}
+
+bool ImageCache::Get(const string& key, cv::Mat* image) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  map<string, shared_ptr<Entry> >::iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    return false;
+  }
+  Entry* entry = it->second.get();
+  recent_.splice(recent_.begin(), recent_, entry->recent);
+  *image = entry->image;
+  return true;
+}
+
+void ImageCache::Put(const string& key, const cv::Mat& image) {
+  const size_t bytes = image.total() * image.elemSize();
+  if (bytes > capacity_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (entries_.count(key)) {
+    // Decoded by another thread meanwhile.
+    return;
+  }
+  while (bytes_ + bytes > capacity_) {
+    map<string, shared_ptr<Entry> >::iterator oldest =
+        entries_.find(recent_.back());
+    bytes_ -= oldest->second->bytes;
+    entries_.erase(oldest);
+    recent_.pop_back();
+  }
+  recent_.push_front(key);
+  shared_ptr<Entry> entry(new Entry());
+  entry->image = image;
+  entry->bytes = bytes;
+  entry->recent = recent_.begin();
+  entries_[key] = entry;
+  bytes_ += bytes;
+}
+
+size_t ImageCache::bytes() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return bytes_;
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
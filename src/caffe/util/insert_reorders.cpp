@@ -0,0 +1,182 @@
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/insert_reorders.hpp"
+
+namespace caffe {
+
+namespace {
+
+bool IsCaffeEngine(const int engine) {
+  // DEFAULT (0) and CAFFE (1) share their values across all engine enums.
+  return engine == 0 || engine == 1;
+}
+
+// Whether a convolution can be computed by BlockedConvolutionLayer.
+bool CanBlockConvolution(const LayerParameter& layer_param) {
+  const ConvolutionParameter& conv_param = layer_param.convolution_param();
+  return layer_param.bottom_size() == 1 && layer_param.top_size() == 1 &&
+      IsCaffeEngine(conv_param.engine()) && conv_param.group() == 1 &&
+      conv_param.axis() == 1 && !conv_param.force_nd_im2col() &&
+      conv_param.kernel_size_size() <= 2 && conv_param.pad_size() <= 2 &&
+      conv_param.stride_size() <= 2 && conv_param.dilation_size() <= 2;
+}
+
+}  // namespace
+
+void InsertReorders(const NetParameter& param, NetParameter* param_blocked) {
+  const int block = param.channel_block();
+  CHECK_GT(block, 0) << "InsertReorders requires a positive channel_block.";
+  param_blocked->CopyFrom(param);
+  param_blocked->clear_layer();
+  // Logical channel count of each blob currently held in the blocked layout.
+  map<string, int> blocked_channels;
+  // Blocked blobs whose NCHW version has already been produced by a Reorder.
+  set<string> reordered_blobs;
+  // Blocked blobs that have been read by a later layer.
+  set<string> consumed_blobs;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    const string& type = layer_param.type();
+    bool all_bottoms_blocked = layer_param.bottom_size() > 0;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      if (!blocked_channels.count(layer_param.bottom(j))) {
+        all_bottoms_blocked = false;
+      }
+    }
+    // Decide whether this layer runs blocked, and if so, whether it needs a
+    // BlockedLayoutParameter to select its blocked implementation.
+    bool blocked = false;
+    bool needs_layout_param = false;
+    if (type == "Convolution") {
+      blocked = needs_layout_param = CanBlockConvolution(layer_param);
+    } else if (type == "Pooling") {
+      const PoolingParameter& pool_param = layer_param.pooling_param();
+      blocked = needs_layout_param = all_bottoms_blocked &&
+          layer_param.top_size() == 1 && IsCaffeEngine(pool_param.engine()) &&
+          (pool_param.pool() == PoolingParameter_PoolMethod_MAX ||
+           pool_param.pool() == PoolingParameter_PoolMethod_AVE);
+    } else if (type == "LRN") {
+      const LRNParameter& lrn_param = layer_param.lrn_param();
+      blocked = needs_layout_param = all_bottoms_blocked &&
+          IsCaffeEngine(lrn_param.engine()) && lrn_param.norm_region() ==
+          LRNParameter_NormRegion_ACROSS_CHANNELS;
+    } else if (type == "ReLU" || type == "Split") {
+      // Elementwise (or copying) layers are layout agnostic, and keep the
+      // zero padding channels at zero.
+      blocked = all_bottoms_blocked;
+    } else if (type == "Concat") {
+      const ConcatParameter& concat_param = layer_param.concat_param();
+      const int axis = concat_param.has_concat_dim() ?
+          static_cast<int>(concat_param.concat_dim()) : concat_param.axis();
+      blocked = all_bottoms_blocked && axis == 1;
+      // Concatenating along the block axis is only exact when no padding
+      // ends up in the middle of the result.
+      for (int j = 0; blocked && j < layer_param.bottom_size() - 1; ++j) {
+        blocked = blocked_channels[layer_param.bottom(j)] % block == 0;
+      }
+    }
+    if (!blocked) {
+      // Bring any blocked inputs back to NCHW first.
+      for (int j = 0; j < layer_param.bottom_size(); ++j) {
+        const string& blob_name = layer_param.bottom(j);
+        if (blocked_channels.count(blob_name) &&
+            !reordered_blobs.count(blob_name)) {
+          ConfigureReorderLayer(blob_name, blocked_channels[blob_name], block,
+              param_blocked->add_layer());
+          reordered_blobs.insert(blob_name);
+        }
+        consumed_blobs.insert(blob_name);
+      }
+      param_blocked->add_layer()->CopyFrom(layer_param);
+      for (int j = 0; j < layer_param.top_size(); ++j) {
+        blocked_channels.erase(layer_param.top(j));
+      }
+      continue;
+    }
+    LayerParameter* blocked_layer_param = param_blocked->add_layer();
+    blocked_layer_param->CopyFrom(layer_param);
+    BlockedLayoutParameter* layout_param =
+        blocked_layer_param->mutable_blocked_layout_param();
+    layout_param->set_block(block);
+    int channels = 0;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      const int bottom_channels = blocked_channels.count(blob_name) ?
+          blocked_channels[blob_name] : 0;
+      if (bottom_channels > 0) {
+        blocked_layer_param->set_bottom(j, BlockedBlobName(blob_name));
+      }
+      layout_param->add_bottom_channels(bottom_channels);
+      channels += bottom_channels;
+      consumed_blobs.insert(blob_name);
+    }
+    if (!needs_layout_param) {
+      blocked_layer_param->clear_blocked_layout_param();
+    }
+    if (type == "Convolution") {
+      blocked_layer_param->mutable_convolution_param()->set_engine(
+          ConvolutionParameter_Engine_CAFFE);
+      channels = layer_param.convolution_param().num_output();
+    } else if (type == "Pooling") {
+      blocked_layer_param->mutable_pooling_param()->set_engine(
+          PoolingParameter_Engine_CAFFE);
+    } else if (type == "LRN") {
+      blocked_layer_param->mutable_lrn_param()->set_engine(
+          LRNParameter_Engine_CAFFE);
+    } else if (type != "Concat") {
+      // ReLU and Split keep the channel count of their single bottom.
+      channels = blocked_channels[layer_param.bottom(0)];
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      const string& blob_name = layer_param.top(j);
+      blocked_layer_param->set_top(j, BlockedBlobName(blob_name));
+      blocked_channels[blob_name] = channels;
+      reordered_blobs.erase(blob_name);
+      consumed_blobs.erase(blob_name);
+    }
+  }
+  // Blocked blobs nobody reads are net outputs, as are those requested in
+  // output_blob; give them back their NCHW shape under their original names.
+  const set<string> requested_outputs(param.output_blob().begin(),
+                                      param.output_blob().end());
+  for (map<string, int>::const_iterator it = blocked_channels.begin();
+       it != blocked_channels.end(); ++it) {
+    if (!consumed_blobs.count(it->first) ||
+        (requested_outputs.count(it->first) &&
+         !reordered_blobs.count(it->first))) {
+      ConfigureReorderLayer(it->first, it->second, block,
+          param_blocked->add_layer());
+    }
+  }
+}
+
+void ConfigureReorderLayer(const string& blob_name, const int channels,
+    const int block, LayerParameter* reorder_layer_param) {
+  reorder_layer_param->Clear();
+  reorder_layer_param->set_name(ReorderLayerName(blob_name));
+  reorder_layer_param->set_type("Reorder");
+  reorder_layer_param->add_bottom(BlockedBlobName(blob_name));
+  reorder_layer_param->add_top(blob_name);
+  BlockedLayoutParameter* layout_param =
+      reorder_layer_param->mutable_blocked_layout_param();
+  layout_param->set_block(block);
+  layout_param->add_bottom_channels(channels);
+}
+
+string ReorderLayerName(const string& blob_name) {
+  ostringstream reorder_layer_name;
+  reorder_layer_name << blob_name << "_reorder";
+  return reorder_layer_name.str();
+}
+
+string BlockedBlobName(const string& blob_name) {
+  ostringstream blocked_blob_name;
+  blocked_blob_name << blob_name << "_blocked";
+  return blocked_blob_name.str();
+}
+
+}  // namespace caffe
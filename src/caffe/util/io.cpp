@@ -2,6 +2,7 @@
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
+#include <google/protobuf/wire_format_lite.h>
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -18,6 +19,7 @@
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/tensor_record.hpp"
 
 const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
 
@@ -162,26 +164,95 @@ bool ReadFileToDatum(const string& filename, const int label,
   }
 }
 
+bool ParseDatumRecord(const char* value, size_t size, bool alias,
+    DatumRecord* record) {
+  if (IsTensorRecord(value, size)) {
+    return ParseTensorRecord(value, size, alias, record);
+  }
+  using google::protobuf::internal::WireFormatLite;
+  Datum* datum = &record->datum;
+  if (alias) {
+    // Find the data field, to parse the fields before and after it only.
+    CodedInputStream input(reinterpret_cast<const uint8_t*>(value), size);
+    int num_data_fields = 0;
+    int field_begin, field_end, data_begin;
+    uint32_t data_size;
+    while (true) {
+      const int begin = input.CurrentPosition();
+      const uint32_t tag = input.ReadTag();
+      if (tag == 0) {
+        break;
+      }
+      if (WireFormatLite::GetTagFieldNumber(tag) == Datum::kDataFieldNumber &&
+          WireFormatLite::GetTagWireType(tag) ==
+          WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+        if (!input.ReadVarint32(&data_size)) {
+          return false;
+        }
+        data_begin = input.CurrentPosition();
+        if (!input.Skip(data_size)) {
+          return false;
+        }
+        field_begin = begin;
+        field_end = input.CurrentPosition();
+        ++num_data_fields;
+      } else if (!WireFormatLite::SkipField(&input, tag)) {
+        return false;
+      }
+    }
+    // A repeated data field, which the parser would concatenate, is left to
+    // the parser.
+    if (num_data_fields == 1) {
+      if (!datum->ParseFromArray(value, field_begin)) {
+        return false;
+      }
+      CodedInputStream rest(reinterpret_cast<const uint8_t*>(value) +
+          field_end, size - field_end);
+      if (!datum->MergeFromCodedStream(&rest)) {
+        return false;
+      }
+      record->data = value + data_begin;
+      record->size = data_size;
+      record->labels = reinterpret_cast<const char*>(datum->labels().data());
+      record->num_labels = datum->labels_size();
+      return true;
+    }
+  }
+  if (!datum->ParseFromArray(value, size)) {
+    return false;
+  }
+  record->data = datum->data().data();
+  record->size = datum->data().size();
+  record->labels = reinterpret_cast<const char*>(datum->labels().data());
+  record->num_labels = datum->labels_size();
+  return true;
+}
+
 #ifdef USE_OPENCV
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
-  cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
-  const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  cv_img = cv::imdecode(vec_data, -1);
+  return DecodeBytesToCVMatNative(datum.data().data(), datum.data().size());
+}
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
+  CHECK(datum.encoded()) << "Datum not encoded";
+  return DecodeBytesToCVMat(datum.data().data(), datum.data().size(),
+      is_color);
+}
+
+// The bytes are decoded where they are, without a copy.
+cv::Mat DecodeBytesToCVMatNative(const char* data, size_t size) {
+  const cv::Mat encoded(1, size, CV_8UC1, const_cast<char*>(data));
+  cv::Mat cv_img = cv::imdecode(encoded, -1);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
   return cv_img;
 }
-cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
-  cv::Mat cv_img;
-  CHECK(datum.encoded()) << "Datum not encoded";
-  const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
+cv::Mat DecodeBytesToCVMat(const char* data, size_t size, bool is_color) {
+  const cv::Mat encoded(1, size, CV_8UC1, const_cast<char*>(data));
   int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
     CV_LOAD_IMAGE_GRAYSCALE);
-  cv_img = cv::imdecode(vec_data, cv_read_flag);
+  cv::Mat cv_img = cv::imdecode(encoded, cv_read_flag);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
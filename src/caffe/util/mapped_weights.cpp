@@ -0,0 +1,290 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
+#include "caffe/util/mapped_weights.hpp"
+
+namespace caffe {
+
+MappedFile::MappedFile(const string& filename) : data_(NULL), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Cannot stat " << filename;
+  size_ = file_stat.st_size;
+  if (size_ > 0) {
+    void* data = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    CHECK(data != MAP_FAILED) << "Cannot map " << filename;
+    data_ = static_cast<char*>(data);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+// The protocol buffer wire format, as far as needed to find the blobs in a
+// NetParameter and to write one with aligned blob data.
+enum WireType {
+  WIRETYPE_VARINT = 0,
+  WIRETYPE_FIXED64 = 1,
+  WIRETYPE_LENGTH_DELIMITED = 2,
+  WIRETYPE_FIXED32 = 5
+};
+
+// The alignment of the blob data written by WriteNetParamsToAlignedBinaryFile.
+static const int kDataAlignment = 64;
+// A field number BlobProto does not use, for the padding.
+static const int kPaddingFieldNumber = 1000;
+
+// Reads the varint at *p and moves *p past it. Returns false if the buffer
+// ends first.
+static bool ReadVarint(const char** p, const char* end, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const uint8_t byte = static_cast<uint8_t>(*(*p)++);
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A field of a serialized message: it spans [begin, end), and its value,
+// after the tag and any length, starts at payload.
+struct WireField {
+  int number;
+  int wire_type;
+  const char* begin;
+  const char* payload;
+  const char* end;
+};
+
+// Reads the field at *p and moves *p past it. Returns false if the field is
+// malformed, runs past end, or is a (deprecated) group.
+static bool ReadField(const char** p, const char* end, WireField* field) {
+  field->begin = *p;
+  uint64_t tag, length = 0;
+  if (!ReadVarint(p, end, &tag)) {
+    return false;
+  }
+  field->number = tag >> 3;
+  field->wire_type = tag & 7;
+  field->payload = *p;
+  switch (field->wire_type) {
+  case WIRETYPE_VARINT:
+    if (!ReadVarint(p, end, &length)) {
+      return false;
+    }
+    length = 0;
+    break;
+  case WIRETYPE_FIXED64:
+    length = 8;
+    break;
+  case WIRETYPE_LENGTH_DELIMITED:
+    if (!ReadVarint(p, end, &length)) {
+      return false;
+    }
+    field->payload = *p;
+    break;
+  case WIRETYPE_FIXED32:
+    length = 4;
+    break;
+  default:
+    return false;
+  }
+  if (length > static_cast<uint64_t>(end - *p)) {
+    return false;
+  }
+  *p += length;
+  field->end = *p;
+  return true;
+}
+
+static bool IndexBlob(const char* file_begin, const char* begin,
+    const char* end, IndexedBlob* blob) {
+  string header;
+  bool has_data = false;
+  blob->data_offset = 0;
+  blob->data_bytes = 0;
+  for (const char* p = begin; p < end; ) {
+    WireField field;
+    if (!ReadField(&p, end, &field)) {
+      return false;
+    }
+    if (field.number == BlobProto::kDataFieldNumber) {
+      // Only packed data is contiguous.
+      if (field.wire_type != WIRETYPE_LENGTH_DELIMITED || has_data) {
+        return false;
+      }
+      has_data = true;
+      blob->data_offset = field.payload - file_begin;
+      blob->data_bytes = field.end - field.payload;
+    } else if (field.number != kPaddingFieldNumber) {
+      header.append(field.begin, field.end - field.begin);
+    }
+  }
+  return blob->header.ParseFromString(header);
+}
+
+static bool IndexLayer(const char* file_begin, const char* begin,
+    const char* end, IndexedLayer* layer) {
+  for (const char* p = begin; p < end; ) {
+    WireField field;
+    if (!ReadField(&p, end, &field)) {
+      return false;
+    }
+    if (field.wire_type != WIRETYPE_LENGTH_DELIMITED) {
+      continue;
+    }
+    if (field.number == LayerParameter::kNameFieldNumber) {
+      layer->name.assign(field.payload, field.end - field.payload);
+    } else if (field.number == LayerParameter::kBlobsFieldNumber) {
+      layer->blobs.push_back(IndexedBlob());
+      if (!IndexBlob(file_begin, field.payload, field.end,
+                     &layer->blobs.back())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool IndexBinaryNetParams(const char* data, size_t size,
+    vector<IndexedLayer>* layers) {
+  layers->clear();
+  const char* end = data + size;
+  for (const char* p = data; p < end; ) {
+    WireField field;
+    if (!ReadField(&p, end, &field) ||
+        field.number == NetParameter::kLayersFieldNumber) {
+      return false;
+    }
+    if (field.number == NetParameter::kLayerFieldNumber &&
+        field.wire_type == WIRETYPE_LENGTH_DELIMITED) {
+      layers->push_back(IndexedLayer());
+      if (!IndexLayer(data, field.payload, field.end, &layers->back())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Message lengths are written as varints of this many bytes, however small
+// the length, so that they can be written before the layout of the message
+// (and its padding) is known. Parsers accept such redundant encodings.
+static const int kLengthBytes = 5;
+
+static void AppendVarint(uint64_t value, string* output) {
+  while (value >= 0x80) {
+    output->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  output->push_back(static_cast<char>(value));
+}
+
+static void AppendTag(int number, WireType wire_type, string* output) {
+  AppendVarint((static_cast<uint64_t>(number) << 3) | wire_type, output);
+}
+
+static void AppendLength(size_t length, string* output) {
+  CHECK_LT(length, 1ULL << (7 * kLengthBytes)) << "Message too large.";
+  for (int i = 0; i < kLengthBytes; ++i) {
+    uint8_t byte = (length >> (7 * i)) & 0x7f;
+    if (i + 1 < kLengthBytes) {
+      byte |= 0x80;
+    }
+    output->push_back(static_cast<char>(byte));
+  }
+}
+
+// Appends blob to output, which will start at offset in the file.
+static void AppendAlignedBlob(const BlobProto& blob, size_t offset,
+    string* output) {
+  BlobProto header(blob);
+  header.clear_data();
+  string blob_bytes = header.SerializeAsString();
+  if (blob.data_size() > 0) {
+    // The padding field takes a tag and a one byte length at least, and the
+    // data a tag and its length.
+    string padding_tag, data_tag;
+    AppendTag(kPaddingFieldNumber, WIRETYPE_LENGTH_DELIMITED, &padding_tag);
+    AppendTag(BlobProto::kDataFieldNumber, WIRETYPE_LENGTH_DELIMITED,
+              &data_tag);
+    const size_t data_offset = offset + blob_bytes.size() + padding_tag.size()
+        + 1 + data_tag.size() + kLengthBytes;
+    const size_t padding =
+        (kDataAlignment - data_offset % kDataAlignment) % kDataAlignment;
+    blob_bytes += padding_tag;
+    AppendVarint(padding, &blob_bytes);
+    blob_bytes.append(padding, '\0');
+    blob_bytes += data_tag;
+    const size_t data_bytes = blob.data_size() * sizeof(float);
+    AppendLength(data_bytes, &blob_bytes);
+    // Like the wire format, this assumes a little-endian host.
+    blob_bytes.append(reinterpret_cast<const char*>(blob.data().data()),
+                      data_bytes);
+  }
+  output->append(blob_bytes);
+}
+
+void WriteNetParamsToAlignedBinaryFile(const NetParameter& param,
+    const string& filename) {
+  // Written aside, then renamed over filename, so that nets mapping an older
+  // file of that name keep it whole.
+  const string temp_file = filename + "." + format_int(getpid());
+  std::ofstream output(temp_file.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output) << "Cannot create " << temp_file;
+  NetParameter net_header(param);
+  net_header.clear_layer();
+  string bytes = net_header.SerializeAsString();
+  size_t offset = bytes.size();
+  output.write(bytes.data(), bytes.size());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    LayerParameter layer_header(layer);
+    layer_header.clear_blobs();
+    string layer_bytes = layer_header.SerializeAsString();
+    string layer_tag;
+    AppendTag(NetParameter::kLayerFieldNumber, WIRETYPE_LENGTH_DELIMITED,
+              &layer_tag);
+    const size_t layer_offset = offset + layer_tag.size() + kLengthBytes;
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      string blob_prefix;
+      AppendTag(LayerParameter::kBlobsFieldNumber, WIRETYPE_LENGTH_DELIMITED,
+                &blob_prefix);
+      const size_t blob_offset = layer_offset + layer_bytes.size() +
+          blob_prefix.size() + kLengthBytes;
+      string blob_bytes;
+      AppendAlignedBlob(layer.blobs(j), blob_offset, &blob_bytes);
+      AppendLength(blob_bytes.size(), &blob_prefix);
+      layer_bytes += blob_prefix;
+      layer_bytes += blob_bytes;
+    }
+    bytes = layer_tag;
+    AppendLength(layer_bytes.size(), &bytes);
+    bytes += layer_bytes;
+    offset += bytes.size();
+    output.write(bytes.data(), bytes.size());
+  }
+  output.close();
+  CHECK(output) << "Failed to write " << temp_file;
+  CHECK_EQ(std::rename(temp_file.c_str(), filename.c_str()), 0)
+      << "Cannot rename " << temp_file << " to " << filename;
+}
+
+}  // namespace caffe
@@ -1,6 +1,12 @@
+#include <boost/bind.hpp>
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
+#include <boost/thread.hpp>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -45,6 +51,394 @@ void caffe_cpu_gemv<double>(const CBLAS_TRANSPOSE TransA, const int M,
   cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
 }
 
+#ifdef USE_MKL
+
+template <>
+int caffe_cpu_gemm_pack_size<float>(const int M, const int N, const int K) {
+  const size_t bytes = cblas_sgemm_pack_get_size(CblasAMatrix, M, N, K);
+  return (bytes + sizeof(float) - 1) / sizeof(float);
+}
+
+template <>
+int caffe_cpu_gemm_pack_size<double>(const int M, const int N, const int K) {
+  const size_t bytes = cblas_dgemm_pack_get_size(CblasAMatrix, M, N, K);
+  return (bytes + sizeof(double) - 1) / sizeof(double);
+}
+
+template <>
+void caffe_cpu_gemm_pack<float>(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const int K, const float alpha, const float* A,
+    float* packed_A) {
+  int lda = (TransA == CblasNoTrans) ? K : M;
+  cblas_sgemm_pack(CblasRowMajor, CblasAMatrix, TransA, M, N, K, alpha, A,
+      lda, packed_A);
+}
+
+template <>
+void caffe_cpu_gemm_pack<double>(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const int K, const double alpha, const double* A,
+    double* packed_A) {
+  int lda = (TransA == CblasNoTrans) ? K : M;
+  cblas_dgemm_pack(CblasRowMajor, CblasAMatrix, TransA, M, N, K, alpha, A,
+      lda, packed_A);
+}
+
+template <>
+void caffe_cpu_packed_gemm<float>(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const float* packed_A, const float* B,
+    const float beta, float* C) {
+  int ldb = (TransB == CblasNoTrans) ? N : K;
+  cblas_sgemm_compute(CblasRowMajor, CblasPacked, TransB, M, N, K, packed_A,
+      K, B, ldb, beta, C, N);
+}
+
+template <>
+void caffe_cpu_packed_gemm<double>(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const double* packed_A, const double* B,
+    const double beta, double* C) {
+  int ldb = (TransB == CblasNoTrans) ? N : K;
+  cblas_dgemm_compute(CblasRowMajor, CblasPacked, TransB, M, N, K, packed_A,
+      K, B, ldb, beta, C, N);
+}
+
+#else  // USE_MKL
+
+// The portable packed layout stores op(A) as panels of kPackedGemmRows rows,
+// each panel K x kPackedGemmRows with the rows of one column adjacent, so the
+// kernel updates a strip of C rows with one contiguous load per step of K.
+// Rows past M are zero.
+static const int kPackedGemmRows = 8;
+// Columns of C accumulated at once when B is not transposed.
+static const int kPackedGemmCols = 64;
+
+template <typename Dtype>
+int caffe_cpu_gemm_pack_size(const int M, const int N, const int K) {
+  const int panels = (M + kPackedGemmRows - 1) / kPackedGemmRows;
+  return panels * kPackedGemmRows * K;
+}
+
+template int caffe_cpu_gemm_pack_size<float>(const int M, const int N,
+    const int K);
+template int caffe_cpu_gemm_pack_size<double>(const int M, const int N,
+    const int K);
+
+template <typename Dtype>
+void caffe_cpu_gemm_pack(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const int K, const Dtype alpha, const Dtype* A,
+    Dtype* packed_A) {
+  caffe_set(caffe_cpu_gemm_pack_size<Dtype>(M, N, K), Dtype(0), packed_A);
+  for (int m = 0; m < M; ++m) {
+    Dtype* panel = packed_A + (m / kPackedGemmRows) * K * kPackedGemmRows +
+        m % kPackedGemmRows;
+    for (int k = 0; k < K; ++k) {
+      const Dtype a = (TransA == CblasNoTrans) ? A[m * K + k] : A[k * M + m];
+      panel[k * kPackedGemmRows] = alpha * a;
+    }
+  }
+}
+
+template void caffe_cpu_gemm_pack<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const int K, const float alpha, const float* A,
+    float* packed_A);
+template void caffe_cpu_gemm_pack<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const int K, const double alpha,
+    const double* A, double* packed_A);
+
+template <typename Dtype>
+void caffe_cpu_packed_gemm(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype* packed_A, const Dtype* B,
+    const Dtype beta, Dtype* C) {
+  Dtype acc[kPackedGemmRows * kPackedGemmCols];
+  for (int m0 = 0; m0 < M; m0 += kPackedGemmRows) {
+    const Dtype* panel = packed_A + m0 * K;
+    const int rows = std::min(kPackedGemmRows, M - m0);
+    if (TransB == CblasNoTrans) {
+      // Stream rows of B: each step of K scales one contiguous strip of B by
+      // the panel's column of A.
+      for (int n0 = 0; n0 < N; n0 += kPackedGemmCols) {
+        const int cols = std::min(kPackedGemmCols, N - n0);
+        std::fill(acc, acc + kPackedGemmRows * kPackedGemmCols, Dtype(0));
+        for (int k = 0; k < K; ++k) {
+          const Dtype* a = panel + k * kPackedGemmRows;
+          const Dtype* b = B + k * N + n0;
+          for (int r = 0; r < kPackedGemmRows; ++r) {
+            const Dtype a_r = a[r];
+            Dtype* acc_r = acc + r * kPackedGemmCols;
+            for (int n = 0; n < cols; ++n) {
+              acc_r[n] += a_r * b[n];
+            }
+          }
+        }
+        for (int r = 0; r < rows; ++r) {
+          Dtype* c = C + (m0 + r) * N + n0;
+          for (int n = 0; n < cols; ++n) {
+            c[n] = acc[r * kPackedGemmCols + n] + (beta ? beta * c[n] : 0);
+          }
+        }
+      }
+    } else {
+      // B is N x K: each column of C is a set of dot products of one
+      // contiguous row of B with the panel.
+      for (int n = 0; n < N; ++n) {
+        const Dtype* b = B + n * K;
+        std::fill(acc, acc + kPackedGemmRows, Dtype(0));
+        for (int k = 0; k < K; ++k) {
+          const Dtype* a = panel + k * kPackedGemmRows;
+          const Dtype b_k = b[k];
+          for (int r = 0; r < kPackedGemmRows; ++r) {
+            acc[r] += a[r] * b_k;
+          }
+        }
+        for (int r = 0; r < rows; ++r) {
+          Dtype* c = C + (m0 + r) * N + n;
+          *c = acc[r] + (beta ? beta * *c : 0);
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_packed_gemm<float>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const float* packed_A,
+    const float* B, const float beta, float* C);
+template void caffe_cpu_packed_gemm<double>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const double* packed_A,
+    const double* B, const double beta, double* C);
+
+#endif  // USE_MKL
+
+namespace {
+
+// Rows of C computed together, so that each load of B serves all of them.
+const int kGemmS8Rows = 4;
+// Multiply-adds below which caffe_cpu_gemm_s8s32 does not start a thread.
+const int64_t kGemmS8ThreadWork = 1 << 21;
+
+// Threads caffe_cpu_gemm_s8s32 may use from the calling thread; unset or 0
+// for one per core.
+boost::thread_specific_ptr<int> gemm_s8s32_threads;
+
+// Dot product of K int8 values of a and of b, the latter b_stride apart.
+inline int32_t dot_s8s32(const int K, const int8_t* a, const int8_t* b,
+    const int b_stride) {
+  int32_t sum = 0;
+  for (int k = 0; k < K; ++k) {
+    sum += static_cast<int32_t>(a[k]) * b[k * b_stride];
+  }
+  return sum;
+}
+
+#ifdef __SSE2__
+// Sign-extends the low or the high eight int8 of x to int16.
+inline __m128i s8_lo_to_s16(const __m128i x) {
+  return _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+}
+
+inline __m128i s8_hi_to_s16(const __m128i x) {
+  return _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+}
+
+inline int32_t sum_epi32(const __m128i x) {
+  __m128i sum = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+
+// Columns [n, n + 8) of kRows rows of C = A B. Rows k and k + 1 of B are
+// interleaved so that one madd forms a[k] b[k][j] + a[k + 1] b[k + 1][j] in
+// each int32 lane, and the kRows x 8 outputs stay in registers throughout.
+template <int kRows>
+void gemm_s8s32_tile_nn(const int N, const int K, const int8_t* A,
+    const int8_t* B, const int n, int32_t* C) {
+  __m128i acc[kRows][2];
+  for (int i = 0; i < kRows; ++i) {
+    acc[i][0] = acc[i][1] = _mm_setzero_si128();
+  }
+  for (int k = 0; k < K; k += 2) {
+    const __m128i b0 =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(B + k * N + n));
+    const __m128i b1 = k + 1 < K ?
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(B + (k + 1) * N + n)) :
+        _mm_setzero_si128();
+    const __m128i b01 = _mm_unpacklo_epi8(b0, b1);
+    const __m128i b_lo = s8_lo_to_s16(b01);
+    const __m128i b_hi = s8_hi_to_s16(b01);
+    for (int i = 0; i < kRows; ++i) {
+      const int8_t* a = A + i * K + k;
+      const int16_t a0 = a[0], a1 = k + 1 < K ? a[1] : 0;
+      const __m128i a01 = _mm_set_epi16(a1, a0, a1, a0, a1, a0, a1, a0);
+      acc[i][0] = _mm_add_epi32(acc[i][0], _mm_madd_epi16(a01, b_lo));
+      acc[i][1] = _mm_add_epi32(acc[i][1], _mm_madd_epi16(a01, b_hi));
+    }
+  }
+  for (int i = 0; i < kRows; ++i) {
+    __m128i* c = reinterpret_cast<__m128i*>(C + i * N + n);
+    _mm_storeu_si128(c, acc[i][0]);
+    _mm_storeu_si128(c + 1, acc[i][1]);
+  }
+}
+
+// Column n of kRows rows of C = A B^T: dot products of rows of A with row n
+// of B, sixteen int8 at a time, each load of B serving all kRows rows.
+template <int kRows>
+void gemm_s8s32_tile_nt(const int N, const int K, const int8_t* A,
+    const int8_t* B, const int n, int32_t* C) {
+  const int8_t* b = B + n * K;
+  __m128i acc[kRows];
+  for (int i = 0; i < kRows; ++i) {
+    acc[i] = _mm_setzero_si128();
+  }
+  int k = 0;
+  for (; k + 16 <= K; k += 16) {
+    const __m128i b16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k));
+    const __m128i b_lo = s8_lo_to_s16(b16);
+    const __m128i b_hi = s8_hi_to_s16(b16);
+    for (int i = 0; i < kRows; ++i) {
+      const __m128i a16 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(A + i * K + k));
+      acc[i] = _mm_add_epi32(acc[i], _mm_add_epi32(
+          _mm_madd_epi16(s8_lo_to_s16(a16), b_lo),
+          _mm_madd_epi16(s8_hi_to_s16(a16), b_hi)));
+    }
+  }
+  for (int i = 0; i < kRows; ++i) {
+    C[i * N + n] = sum_epi32(acc[i]) + dot_s8s32(K - k, A + i * K + k, b + k, 1);
+  }
+}
+
+// kRows rows of C = A op(B), starting at the rows A and C point to.
+template <int kRows>
+void gemm_s8s32_panel(const CBLAS_TRANSPOSE TransB, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C) {
+  if (TransB == CblasNoTrans) {
+    int n = 0;
+    for (; n + 8 <= N; n += 8) {
+      gemm_s8s32_tile_nn<kRows>(N, K, A, B, n, C);
+    }
+    for (; n < N; ++n) {
+      for (int i = 0; i < kRows; ++i) {
+        C[i * N + n] = dot_s8s32(K, A + i * K, B + n, N);
+      }
+    }
+  } else {
+    for (int n = 0; n < N; ++n) {
+      gemm_s8s32_tile_nt<kRows>(N, K, A, B, n, C);
+    }
+  }
+}
+#endif  // __SSE2__
+
+// Rows [m_begin, m_end) of C = A op(B).
+void gemm_s8s32_rows(const CBLAS_TRANSPOSE TransB, const int m_begin,
+    const int m_end, const int N, const int K, const int8_t* A,
+    const int8_t* B, int32_t* C) {
+  int m = m_begin;
+#ifdef __SSE2__
+  for (; m + kGemmS8Rows <= m_end; m += kGemmS8Rows) {
+    gemm_s8s32_panel<kGemmS8Rows>(TransB, N, K, A + m * K, B, C + m * N);
+  }
+  for (; m < m_end; ++m) {
+    gemm_s8s32_panel<1>(TransB, N, K, A + m * K, B, C + m * N);
+  }
+#else
+  for (; m < m_end; ++m) {
+    const int8_t* a = A + m * K;
+    int32_t* c = C + m * N;
+    if (TransB == CblasNoTrans) {
+      // Accumulate rows of B scaled by a[k], widening to int32 as we go.
+      std::fill(c, c + N, 0);
+      for (int k = 0; k < K; ++k) {
+        const int32_t a_k = a[k];
+        if (a_k == 0) {
+          continue;
+        }
+        const int8_t* b = B + k * N;
+        for (int n = 0; n < N; ++n) {
+          c[n] += a_k * b[n];
+        }
+      }
+    } else {
+      for (int n = 0; n < N; ++n) {
+        c[n] = dot_s8s32(K, a, B + n * K, 1);
+      }
+    }
+  }
+#endif  // __SSE2__
+}
+
+}  // namespace
+
+void caffe_set_gemm_s8s32_threads(const int num_threads) {
+  CHECK_GE(num_threads, 0);
+  gemm_s8s32_threads.reset(new int(num_threads));
+}
+
+void caffe_cpu_gemm_s8s32(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const int8_t* A, const int8_t* B, int32_t* C) {
+  // Split the rows of C between threads if there is enough work for each to
+  // pay for starting it.
+  int64_t num_threads = gemm_s8s32_threads.get() && *gemm_s8s32_threads > 0 ?
+      *gemm_s8s32_threads : boost::thread::hardware_concurrency();
+  num_threads = std::min(num_threads,
+      static_cast<int64_t>(M) * N * K / kGemmS8ThreadWork);
+  num_threads = std::min<int64_t>(num_threads,
+      (M + kGemmS8Rows - 1) / kGemmS8Rows);
+  if (num_threads <= 1) {
+    gemm_s8s32_rows(TransB, 0, M, N, K, A, B, C);
+    return;
+  }
+  const int rows_per_thread = ((M + kGemmS8Rows - 1) / kGemmS8Rows +
+      num_threads - 1) / num_threads * kGemmS8Rows;
+  boost::thread_group threads;
+  for (int m = rows_per_thread; m < M; m += rows_per_thread) {
+    threads.create_thread(boost::bind(&gemm_s8s32_rows, TransB, m,
+        std::min(M, m + rows_per_thread), N, K, A, B, C));
+  }
+  gemm_s8s32_rows(TransB, 0, rows_per_thread, N, K, A, B, C);
+  threads.join_all();
+}
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int N, const Dtype scale, const Dtype* x,
+    int8_t* y) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype v = std::floor(scale * x[i] + Dtype(0.5));
+    y[i] = static_cast<int8_t>(std::max(Dtype(-127), std::min(Dtype(127), v)));
+  }
+}
+
+template void caffe_cpu_quantize<float>(const int N, const float scale,
+    const float* x, int8_t* y);
+template void caffe_cpu_quantize<double>(const int N, const double scale,
+    const double* x, int8_t* y);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const CBLAS_TRANSPOSE TransA, const int M,
+    const int K, const Dtype* A, int8_t* A_quantized, Dtype* scales) {
+  const int row_stride = (TransA == CblasNoTrans) ? K : 1;
+  const int col_stride = (TransA == CblasNoTrans) ? 1 : M;
+  for (int m = 0; m < M; ++m) {
+    const Dtype* a = A + m * row_stride;
+    Dtype range = 0;
+    for (int k = 0; k < K; ++k) {
+      range = std::max(range, std::abs(a[k * col_stride]));
+    }
+    const Dtype scale = range > 0 ? Dtype(127) / range : Dtype(1);
+    scales[m] = scale;
+    int8_t* a_quantized = A_quantized + m * K;
+    for (int k = 0; k < K; ++k) {
+      caffe_cpu_quantize(1, scale, a + k * col_stride, a_quantized + k);
+    }
+  }
+}
+
+template void caffe_cpu_quantize_rows<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int K, const float* A, int8_t* A_quantized,
+    float* scales);
+template void caffe_cpu_quantize_rows<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int K, const double* A, int8_t* A_quantized,
+    double* scales);
+
 template <>
 void caffe_axpy<float>(const int N, const float alpha, const float* X,
     float* Y) { cblas_saxpy(N, alpha, X, 1, Y, 1); }
@@ -358,6 +752,18 @@ double caffe_cpu_asum<double>(const int n, const double* x) {
   return cblas_dasum(n, x, 1);
 }
 
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x) {
+  Dtype amax = 0;
+  for (int i = 0; i < n; ++i) {
+    amax = std::max(amax, std::abs(x[i]));
+  }
+  return amax;
+}
+
+template float caffe_cpu_amax<float>(const int n, const float* x);
+template double caffe_cpu_amax<double>(const int n, const double* x);
+
 template <>
 void caffe_cpu_scale<float>(const int n, const float alpha, const float *x,
                             float* y) {
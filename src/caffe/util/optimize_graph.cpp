@@ -0,0 +1,187 @@
+#include <set>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/optimize_graph.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Whether layer_param, at inference, sets its only top to its only bottom.
+bool IsIdentity(const LayerParameter& layer_param) {
+  if (layer_param.bottom_size() != 1) {
+    return false;
+  }
+  if (layer_param.type() == "Split") {
+    return true;
+  }
+  if (layer_param.top_size() != 1) {
+    return false;
+  }
+  if (layer_param.type() == "Dropout") {
+    return !layer_param.has_phase() || layer_param.phase() == TEST;
+  }
+  if (layer_param.type() == "Power") {
+    const PowerParameter& power_param = layer_param.power_param();
+    return power_param.power() == 1 && power_param.scale() == 1 &&
+        power_param.shift() == 0;
+  }
+  return false;
+}
+
+// Whether layer_param computes each element of its top from the same element
+// (or channel) of its bottom alone, so that it can overwrite the bottom.
+bool CanRunInPlace(const LayerParameter& layer_param) {
+  static const char* kTypes[] = { "ReLU", "Sigmoid", "TanH", "ELU", "BNLL",
+      "Power", "Scale", "Bias", "BatchNorm" };
+  if (layer_param.bottom_size() != 1 || layer_param.top_size() != 1 ||
+      layer_param.bottom(0) == layer_param.top(0)) {
+    return false;
+  }
+  for (int i = 0; i < sizeof(kTypes) / sizeof(kTypes[0]); ++i) {
+    if (layer_param.type() == kTypes[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Contains(const google::protobuf::RepeatedPtrField<string>& names,
+    const string& name) {
+  for (int i = 0; i < names.size(); ++i) {
+    if (names.Get(i) == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether a layer after layer_id reads blob_name.
+bool ReadAfter(const NetParameter& param, int layer_id,
+    const string& blob_name) {
+  for (int i = layer_id + 1; i < param.layer_size(); ++i) {
+    if (Contains(param.layer(i).bottom(), blob_name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether a layer after layer_id writes blob_name, in place or not.
+bool WrittenAfter(const NetParameter& param, int layer_id,
+    const string& blob_name) {
+  for (int i = layer_id + 1; i < param.layer_size(); ++i) {
+    if (Contains(param.layer(i).top(), blob_name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the data of blob_name, as layer_id reads it, is filled outside the
+// forward pass or shared with another blob, so it must not be overwritten.
+bool IsExternalOrShared(const NetParameter& param, int layer_id,
+    const string& blob_name) {
+  for (int i = 0; i < param.input_size(); ++i) {
+    if (param.input(i) == blob_name) {
+      return true;
+    }
+  }
+  for (int i = layer_id - 1; i >= 0; --i) {
+    const LayerParameter& layer_param = param.layer(i);
+    if (!Contains(layer_param.top(), blob_name)) {
+      continue;
+    }
+    if (Contains(layer_param.bottom(), blob_name)) {
+      // Written in place; look for the layer creating it.
+      continue;
+    }
+    const string& type = layer_param.type();
+    return layer_param.bottom_size() == 0 || type == "Input" ||
+        type == "Split" || type == "Flatten" || type == "Reshape";
+  }
+  return true;
+}
+
+// Renames the bottoms named from to to in the layers after layer_id.
+void RenameBottomsAfter(int layer_id, const string& from, const string& to,
+    NetParameter* param) {
+  for (int i = layer_id + 1; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    for (int j = 0; j < layer_param->bottom_size(); ++j) {
+      if (layer_param->bottom(j) == from) {
+        layer_param->set_bottom(j, to);
+      }
+    }
+  }
+}
+
+// Whether the layers after layer_id can read bottom_name for blob_name, which
+// then goes away.
+bool CanReplace(const NetParameter& param, int layer_id,
+    const string& blob_name, const string& bottom_name) {
+  return blob_name == bottom_name ||
+      (ReadAfter(param, layer_id, blob_name) &&
+       !Contains(param.output_blob(), blob_name) &&
+       !WrittenAfter(param, layer_id, blob_name) &&
+       !WrittenAfter(param, layer_id, bottom_name));
+}
+
+bool RemoveIdentity(int layer_id, NetParameter* param) {
+  const LayerParameter& layer_param = param->layer(layer_id);
+  if (!IsIdentity(layer_param)) {
+    return false;
+  }
+  const string bottom_name = layer_param.bottom(0);
+  for (int i = 0; i < layer_param.top_size(); ++i) {
+    if (!CanReplace(*param, layer_id, layer_param.top(i), bottom_name)) {
+      return false;
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Removing " << layer_param.type() << " layer " << layer_param.name()
+      << ", whose readers read " << bottom_name << " instead";
+  for (int i = 0; i < layer_param.top_size(); ++i) {
+    RenameBottomsAfter(layer_id, layer_param.top(i), bottom_name, param);
+  }
+  param->mutable_layer()->DeleteSubrange(layer_id, 1);
+  return true;
+}
+
+bool MakeInPlace(int layer_id, NetParameter* param) {
+  const LayerParameter& layer_param = param->layer(layer_id);
+  if (!CanRunInPlace(layer_param)) {
+    return false;
+  }
+  const string bottom_name = layer_param.bottom(0);
+  const string top_name = layer_param.top(0);
+  if (ReadAfter(*param, layer_id, bottom_name) ||
+      Contains(param->output_blob(), bottom_name) ||
+      IsExternalOrShared(*param, layer_id, bottom_name) ||
+      !CanReplace(*param, layer_id, top_name, bottom_name)) {
+    return false;
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Computing " << layer_param.type() << " layer " << layer_param.name()
+      << " in place, in " << bottom_name << " for " << top_name;
+  RenameBottomsAfter(layer_id, top_name, bottom_name, param);
+  param->mutable_layer(layer_id)->set_top(0, bottom_name);
+  return true;
+}
+
+}  // namespace
+
+void OptimizeGraph(const NetParameter& param, NetParameter* param_optimized) {
+  param_optimized->CopyFrom(param);
+  for (int i = 0; i < param_optimized->layer_size(); ) {
+    if (RemoveIdentity(i, param_optimized)) {
+      // The layer now at i has not been looked at yet.
+      continue;
+    }
+    MakeInPlace(i, param_optimized);
+    ++i;
+  }
+}
+
+}  // namespace caffe
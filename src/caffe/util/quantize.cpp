@@ -0,0 +1,61 @@
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Whether layer_param is a plain ReLU computed in place on blob_name.
+bool IsFusableReLU(const LayerParameter& layer_param, const string& blob_name) {
+  return layer_param.type() == "ReLU" && layer_param.bottom_size() == 1 &&
+      layer_param.top_size() == 1 && layer_param.bottom(0) == blob_name &&
+      layer_param.top(0) == blob_name &&
+      layer_param.relu_param().negative_slope() == 0 &&
+      layer_param.include_size() == 0 && layer_param.exclude_size() == 0;
+}
+
+}  // namespace
+
+bool CanQuantizeLayer(const LayerParameter& layer_param) {
+  if (layer_param.type() == "Convolution") {
+    // The int8 path stands in for the CAFFE engine.
+    const ConvolutionParameter_Engine engine =
+        layer_param.convolution_param().engine();
+    return engine == ConvolutionParameter_Engine_DEFAULT ||
+        engine == ConvolutionParameter_Engine_CAFFE;
+  }
+  return layer_param.type() == "InnerProduct";
+}
+
+void QuantizeNet(const NetParameter& param,
+    const map<string, float>& bottom_ranges, NetParameter* param_quantized) {
+  param_quantized->CopyFrom(param);
+  param_quantized->clear_layer();
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    LayerParameter* quantized_layer_param = param_quantized->add_layer();
+    quantized_layer_param->CopyFrom(layer_param);
+    map<string, float>::const_iterator range =
+        bottom_ranges.find(layer_param.name());
+    if (range == bottom_ranges.end() || !CanQuantizeLayer(layer_param)) {
+      continue;
+    }
+    QuantizationParameter* quant_param =
+        quantized_layer_param->mutable_quantization_param();
+    quant_param->set_bottom_range(range->second);
+    if (layer_param.type() == "Convolution") {
+      quantized_layer_param->mutable_convolution_param()->set_engine(
+          ConvolutionParameter_Engine_CAFFE);
+    }
+    if (layer_param.top_size() == 1 && i + 1 < param.layer_size() &&
+        IsFusableReLU(param.layer(i + 1), layer_param.top(0))) {
+      quant_param->set_relu(true);
+      ++i;
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,121 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <exception>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/task_graph.hpp"
+
+namespace caffe {
+
+class TaskGraph::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable work_condition_;
+  boost::condition_variable done_condition_;
+};
+
+TaskGraph::TaskGraph(int num_tasks, int num_threads)
+    : dependents_(num_tasks), sync_(new sync()), last_(-1),
+      pending_(num_tasks, 0), remaining_(0), stopping_(false) {
+  CHECK_GT(num_threads, 0);
+  // Give each worker its share of the cores for multithreaded BLAS and int8
+  // gemm, so that concurrent tasks do not oversubscribe them.
+  const int blas_threads = std::max<int>(1,
+      boost::thread::hardware_concurrency() / num_threads);
+  try {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &TaskGraph::WorkerEntry, this, Caffe::mode(), caffe_rng_rand(),
+          Caffe::solver_count(), Caffe::root_solver(), blas_threads)));
+    }
+  } catch (std::exception& e) {
+    LOG(FATAL) << "Thread exception: " << e.what();
+  }
+}
+
+TaskGraph::~TaskGraph() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stopping_ = true;
+  }
+  sync_->work_condition_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void TaskGraph::AddDependency(int from, int to) {
+  CHECK_GE(from, 0);
+  CHECK_LT(from, to) << "Tasks may only depend on lower numbered tasks.";
+  CHECK_LT(to, num_tasks());
+  dependents_[from].push_back(to);
+}
+
+void TaskGraph::Run(int first, int last,
+    const boost::function<void(int)>& task) {
+  CHECK_GE(first, 0);
+  CHECK_LT(last, num_tasks());
+  if (first > last) { return; }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  CHECK_EQ(remaining_, 0) << "TaskGraph::Run is not reentrant.";
+  task_ = task;
+  last_ = last;
+  for (int i = first; i <= last; ++i) {
+    pending_[i] = 0;
+  }
+  for (int i = first; i <= last; ++i) {
+    for (int j = 0; j < dependents_[i].size(); ++j) {
+      if (dependents_[i][j] <= last) {
+        ++pending_[dependents_[i][j]];
+      }
+    }
+  }
+  for (int i = first; i <= last; ++i) {
+    if (pending_[i] == 0) {
+      ready_.push_back(i);
+    }
+  }
+  remaining_ = last - first + 1;
+  sync_->work_condition_.notify_all();
+  while (remaining_ > 0) {
+    sync_->done_condition_.wait(lock);
+  }
+  task_.clear();
+}
+
+void TaskGraph::WorkerEntry(Caffe::Brew mode, int rand_seed,
+    int solver_count, bool root_solver, int blas_threads) {
+  Caffe::set_mode(mode);
+  Caffe::set_random_seed(rand_seed);
+  Caffe::set_solver_count(solver_count);
+  Caffe::set_root_solver(root_solver);
+#ifdef USE_MKL
+  mkl_set_num_threads_local(blas_threads);
+#endif
+  caffe_set_gemm_s8s32_threads(blas_threads);
+
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!stopping_ && ready_.empty()) {
+      sync_->work_condition_.wait(lock);
+    }
+    if (stopping_) { return; }
+    const int task = ready_.front();
+    ready_.pop_front();
+    lock.unlock();
+    task_(task);
+    lock.lock();
+    for (int j = 0; j < dependents_[task].size(); ++j) {
+      const int dependent = dependents_[task][j];
+      if (dependent <= last_ && --pending_[dependent] == 0) {
+        ready_.push_back(dependent);
+        sync_->work_condition_.notify_one();
+      }
+    }
+    if (--remaining_ == 0) {
+      sync_->done_condition_.notify_all();
+    }
+  }
+}
+
+}  // namespace caffe
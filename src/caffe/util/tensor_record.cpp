@@ -0,0 +1,145 @@
+#include <stdint.h>
+#include <cstring>
+#include <string>
+
+#include "caffe/util/io.hpp"
+#include "caffe/util/tensor_record.hpp"
+
+namespace caffe {
+
+// 'C' (0x43), as the first byte of a protobuf message, would start a group,
+// a wire type Datum never uses.
+static const char kTensorRecordMagic[4] = { 'C', 'T', 'R', 'C' };
+static const uint8_t kTensorRecordVersion = 1;
+
+bool IsTensorRecord(const char* value, size_t size) {
+  return size >= sizeof(TensorRecordHeader) &&
+      memcmp(value, kTensorRecordMagic, sizeof(kTensorRecordMagic)) == 0;
+}
+
+void DatumToTensorRecord(const Datum& datum, string* value) {
+  TensorRecordHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kTensorRecordMagic, sizeof(kTensorRecordMagic));
+  header.version = kTensorRecordVersion;
+  header.num_labels = datum.has_label() ? 1 : 0;
+  header.num_float_labels = datum.labels_size();
+  header.channels = datum.channels();
+  header.height = datum.height();
+  header.width = datum.width();
+  const char* payload;
+  if (datum.encoded()) {
+    header.type = TENSOR_RECORD_ENCODED;
+    payload = datum.data().data();
+    header.payload_bytes = datum.data().size();
+  } else if (datum.data().size() > 0) {
+    header.type = TENSOR_RECORD_UINT8;
+    payload = datum.data().data();
+    header.payload_bytes = datum.data().size();
+  } else {
+    header.type = TENSOR_RECORD_FLOAT;
+    payload = reinterpret_cast<const char*>(datum.float_data().data());
+    header.payload_bytes = datum.float_data_size() * sizeof(float);
+  }
+  value->assign(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (header.num_labels) {
+    const int32_t label = datum.label();
+    value->append(reinterpret_cast<const char*>(&label), sizeof(label));
+  }
+  value->append(reinterpret_cast<const char*>(datum.labels().data()),
+      header.num_float_labels * sizeof(float));
+  value->append(payload, header.payload_bytes);
+}
+
+// Whether bytes are exactly channels x height x width values of value_size
+// bytes each, which height and width must not be 0 for.
+static bool HoldsValues(const TensorRecordHeader& header, uint64_t bytes,
+    size_t value_size) {
+  const uint64_t area = static_cast<uint64_t>(header.height) * header.width;
+  return bytes % area == 0 &&
+      bytes / area == static_cast<uint64_t>(header.channels) * value_size;
+}
+
+bool ParseTensorRecord(const char* value, size_t size, bool alias,
+    DatumRecord* record) {
+  if (!IsTensorRecord(value, size)) {
+    return false;
+  }
+  TensorRecordHeader header;
+  memcpy(&header, value, sizeof(header));
+  if (header.version != kTensorRecordVersion) {
+    return false;
+  }
+  // Check the sizes against what is left of the value one at a time, for
+  // no sum of them to overflow.
+  const uint64_t rest = size - sizeof(header);
+  const uint64_t labels_bytes =
+      static_cast<uint64_t>(header.num_labels) * sizeof(int32_t);
+  const uint64_t float_labels_bytes =
+      static_cast<uint64_t>(header.num_float_labels) * sizeof(float);
+  if (labels_bytes > rest || float_labels_bytes > rest - labels_bytes ||
+      header.payload_bytes != rest - labels_bytes - float_labels_bytes) {
+    return false;
+  }
+  // Encoded images may leave their shape unset, 0.
+  if (header.channels < 0 || header.height < 0 || header.width < 0 ||
+      (header.type != TENSOR_RECORD_ENCODED && (header.channels == 0 ||
+      header.height == 0 || header.width == 0))) {
+    return false;
+  }
+  const char* labels = value + sizeof(header);
+  const char* float_labels = labels + labels_bytes;
+  const char* payload = float_labels + float_labels_bytes;
+  Datum* datum = &record->datum;
+  datum->Clear();
+  datum->set_channels(header.channels);
+  datum->set_height(header.height);
+  datum->set_width(header.width);
+  if (header.num_labels) {
+    int32_t label;
+    memcpy(&label, labels, sizeof(label));
+    datum->set_label(label);
+  }
+  if (alias) {
+    record->labels = float_labels;
+  } else {
+    datum->mutable_labels()->Resize(header.num_float_labels, 0);
+    memcpy(datum->mutable_labels()->mutable_data(), float_labels,
+        float_labels_bytes);
+    record->labels = reinterpret_cast<const char*>(datum->labels().data());
+  }
+  record->num_labels = header.num_float_labels;
+  switch (header.type) {
+  case TENSOR_RECORD_ENCODED:
+    datum->set_encoded(true);
+    break;
+  case TENSOR_RECORD_UINT8:
+    if (!HoldsValues(header, header.payload_bytes, 1)) {
+      return false;
+    }
+    break;
+  case TENSOR_RECORD_FLOAT:
+    if (!HoldsValues(header, header.payload_bytes, sizeof(float))) {
+      return false;
+    }
+    datum->mutable_float_data()->Resize(header.payload_bytes / sizeof(float),
+        0);
+    memcpy(datum->mutable_float_data()->mutable_data(), payload,
+        header.payload_bytes);
+    record->data = NULL;
+    record->size = 0;
+    return true;
+  default:
+    return false;
+  }
+  if (alias) {
+    record->data = payload;
+  } else {
+    datum->set_data(payload, header.payload_bytes);
+    record->data = datum->data().data();
+  }
+  record->size = header.payload_bytes;
+  return true;
+}
+
+}  // namespace caffe
@@ -0,0 +1,70 @@
+#include <boost/thread.hpp>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "caffe/util/weight_cache.hpp"
+
+namespace caffe {
+
+namespace {
+
+typedef std::pair<string, WeightCache::Sources> Key;
+typedef std::map<Key, boost::weak_ptr<void> > EntryMap;
+
+boost::recursive_mutex& mutex() {
+  static boost::recursive_mutex mutex;
+  return mutex;
+}
+
+// The entries by key, including expired ones until the next Add.
+EntryMap& entries() {
+  static EntryMap entries;
+  return entries;
+}
+
+}  // namespace
+
+WeightCache::Lock::Lock() {
+  mutex().lock();
+}
+
+WeightCache::Lock::~Lock() {
+  mutex().unlock();
+}
+
+shared_ptr<void> WeightCache::Find(const string& kind,
+    const Sources& sources) {
+  EntryMap::const_iterator it = entries().find(Key(kind, sources));
+  return it == entries().end() ? shared_ptr<void>() : it->second.lock();
+}
+
+void WeightCache::Add(const string& kind, const Sources& sources,
+    const shared_ptr<void>& entry) {
+  for (EntryMap::iterator it = entries().begin(); it != entries().end();) {
+    if (it->second.expired()) {
+      entries().erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  entries()[Key(kind, sources)] = entry;
+}
+
+void WeightCache::Alias(const string& kind, const Sources& sources,
+    const shared_ptr<void>& entry) {
+  Lock lock;
+  Add(kind, sources, entry);
+}
+
+int WeightCache::size() {
+  Lock lock;
+  int size = 0;
+  for (EntryMap::const_iterator it = entries().begin();
+       it != entries().end(); ++it) {
+    size += !it->second.expired();
+  }
+  return size;
+}
+
+}  // namespace caffe
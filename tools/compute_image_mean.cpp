@@ -1,5 +1,8 @@
 #include <stdint.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
@@ -20,6 +23,78 @@ using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
         "The backend {leveldb, lmdb} containing the images");
+DEFINE_int32(threads, 1,
+    "The number of threads reading and decoding the images, each summing "
+    "those of a range of keys");
+
+#ifdef USE_OPENCV
+// The sums of a range of images: by element, and of the squares by channel.
+struct ImageSums {
+  std::vector<double> sum;
+  std::vector<double> channel_sum_sq;
+  int count;
+};
+
+// Sums the images from begin_key up to end_key, or the last if empty.
+static void SumImages(db::Cursor* cursor, const string& begin_key,
+    const string& end_key, int channels, int data_size, ImageSums* sums) {
+  const int dim = data_size / channels;
+  sums->sum.assign(data_size, 0.);
+  sums->channel_sum_sq.assign(channels, 0.);
+  sums->count = 0;
+  if (begin_key.empty()) {
+    cursor->SeekToFirst();
+  } else {
+    cursor->Seek(begin_key);
+  }
+  double* sum = &sums->sum[0];
+  DatumRecord record;
+  Datum& datum = record.datum;
+  for (; cursor->valid() && (end_key.empty() || cursor->key() < end_key);
+       cursor->Next()) {
+    const string value = cursor->value();
+    CHECK(ParseDatumRecord(value.data(), value.size(), false, &record));
+    DecodeDatumNative(&datum);
+
+    const std::string& data = datum.data();
+    const int size_in_datum = std::max<int>(datum.data().size(),
+        datum.float_data_size());
+    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
+        size_in_datum;
+    // Plain loops over contiguous arrays, for the compiler to vectorize.
+    if (data.size() != 0) {
+      const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data.data());
+      for (int i = 0; i < data_size; ++i) {
+        sum[i] += pixels[i];
+      }
+      for (int c = 0; c < channels; ++c) {
+        // Exact: at most 255^2 per pixel.
+        uint64_t sum_sq = 0;
+        for (int i = c * dim; i < (c + 1) * dim; ++i) {
+          sum_sq += pixels[i] * pixels[i];
+        }
+        sums->channel_sum_sq[c] += sum_sq;
+      }
+    } else {
+      const float* values = datum.float_data().data();
+      for (int i = 0; i < data_size; ++i) {
+        sum[i] += values[i];
+      }
+      for (int c = 0; c < channels; ++c) {
+        double sum_sq = 0;
+        for (int i = c * dim; i < (c + 1) * dim; ++i) {
+          sum_sq += static_cast<double>(values[i]) * values[i];
+        }
+        sums->channel_sum_sq[c] += sum_sq;
+      }
+    }
+    if (++sums->count % 10000 == 0) {
+      LOG(INFO) << "Processed " << sums->count << " files from key '"
+          << begin_key << "'.";
+    }
+  }
+}
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -45,11 +120,13 @@ int main(int argc, char** argv) {
   db->Open(argv[1], db::READ);
   scoped_ptr<db::Cursor> cursor(db->NewCursor());
 
+  CHECK_GT(FLAGS_threads, 0) << "Read on at least one thread.";
   BlobProto sum_blob;
-  int count = 0;
   // load first datum
-  Datum datum;
-  datum.ParseFromString(cursor->value());
+  DatumRecord record;
+  Datum& datum = record.datum;
+  const string value = cursor->value();
+  CHECK(ParseDatumRecord(value.data(), value.size(), false, &record));
 
   if (DecodeDatumNative(&datum)) {
     LOG(INFO) << "Decoding Datum";
@@ -59,62 +136,60 @@ int main(int argc, char** argv) {
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
+  const int channels = datum.channels();
   const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
+
+  // Sum ranges of keys in parallel, each with its own cursor, then add up
+  // the sums of the ranges.
+  const std::vector<string> begin_keys = FLAGS_threads > 1 ?
+      db::SplitKeys(cursor.get(), FLAGS_threads) :
+      std::vector<string>(1, "");
+  const int num_ranges = begin_keys.size();
+  std::vector<shared_ptr<db::Cursor> > cursors;
+  std::vector<ImageSums> range_sums(num_ranges);
+  boost::thread_group threads;
+  LOG(INFO) << "Starting Iteration on " << num_ranges << " threads";
+  for (int j = 0; j < num_ranges; ++j) {
+    cursors.push_back(shared_ptr<db::Cursor>(db->NewCursor()));
+    const string end_key = j + 1 < num_ranges ? begin_keys[j + 1] : "";
+    threads.create_thread(boost::bind(&SumImages, cursors[j].get(),
+        begin_keys[j], end_key, channels, data_size, &range_sums[j]));
   }
-  LOG(INFO) << "Starting Iteration";
-  while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
+  threads.join_all();
 
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
-      }
+  int count = 0;
+  std::vector<double> sum(data_size, 0.);
+  std::vector<double> channel_sum_sq(channels, 0.);
+  for (int j = 0; j < num_ranges; ++j) {
+    count += range_sums[j].count;
+    for (int i = 0; i < data_size; ++i) {
+      sum[i] += range_sums[j].sum[i];
     }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(INFO) << "Processed " << count << " files.";
+    for (int c = 0; c < channels; ++c) {
+      channel_sum_sq[c] += range_sums[j].channel_sum_sq[c];
     }
-    cursor->Next();
-  }
-
-  if (count % 10000 != 0) {
-    LOG(INFO) << "Processed " << count << " files.";
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  LOG(INFO) << "Processed " << count << " files.";
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(sum[i] / count);
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
   const int dim = sum_blob.height() * sum_blob.width();
-  std::vector<float> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
   for (int c = 0; c < channels; ++c) {
+    double channel_sum = 0;
     for (int i = 0; i < dim; ++i) {
-      mean_values[c] += sum_blob.data(dim * c + i);
+      channel_sum += sum[dim * c + i];
     }
-    LOG(INFO) << "mean_value channel [" << c << "]:" << mean_values[c] / dim;
+    const double mean = channel_sum / count / dim;
+    const double variance = channel_sum_sq[c] / count / dim - mean * mean;
+    LOG(INFO) << "mean_value channel [" << c << "]:" << mean;
+    LOG(INFO) << "std_value channel [" << c << "]:"
+        << std::sqrt(std::max(variance, 0.));
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
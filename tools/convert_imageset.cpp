@@ -7,8 +7,15 @@
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
+//
+// Images are read, resized and encoded on -threads threads and written in
+// order, -commit_every at a time. After each commit, DB_NAME.checkpoint
+// records how far the conversion went, for -resume to continue from there.
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <algorithm>
+#include <cstdio>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <utility>
@@ -22,7 +29,9 @@
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/task_graph.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
@@ -42,6 +51,103 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 1,
+    "The number of threads reading, resizing and encoding images");
+DEFINE_int32(commit_every, 1000,
+    "The number of images written per database transaction");
+DEFINE_int32(shards, 1,
+    "If more than 1, the images are written in turn to this many databases "
+    "DB_NAME_000, DB_NAME_001..., to be read as DataParameter shards");
+DEFINE_bool(resume, false,
+    "Continue an interrupted conversion from DB_NAME.checkpoint");
+
+#ifdef USE_OPENCV
+// An image converted by a worker; value is empty if it could not be read.
+struct ConvertedImage {
+  string key;
+  string value;
+  int data_size;
+};
+
+// Converts the images of lines [begin, end) that worker worker_id of
+// num_workers is in charge of, every num_workers-th.
+static void ConvertImages(const vector<pair<string, int> >& lines,
+    const string& root_folder, int begin, int end,
+    vector<ConvertedImage>* images, int worker_id, int num_workers) {
+  const bool is_color = !FLAGS_gray;
+  const int resize_height = std::max<int>(0, FLAGS_resize_height);
+  const int resize_width = std::max<int>(0, FLAGS_resize_width);
+  Datum datum;
+  for (int line_id = begin + worker_id; line_id < end;
+       line_id += num_workers) {
+    ConvertedImage* image = &(*images)[line_id - begin];
+    image->value.clear();
+    std::string enc = FLAGS_encode_type;
+    if (FLAGS_encoded && !enc.size()) {
+      // Guess the encoding type from the file name
+      string fn = lines[line_id].first;
+      size_t p = fn.rfind('.');
+      if ( p == fn.npos )
+        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+      enc = fn.substr(p);
+      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    }
+    if (!ReadImageToDatum(root_folder + lines[line_id].first,
+        lines[line_id].second, resize_height, resize_width, is_color,
+        enc, &datum)) {
+      continue;
+    }
+    image->data_size = datum.data().size();
+    // sequential
+    image->key = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
+    CHECK(datum.SerializeToString(&image->value));
+  }
+}
+
+// The conversion state saved after each commit: the next line to convert,
+// and the seed the lines were shuffled with.
+static void WriteCheckpoint(const string& filename, int next_line,
+    unsigned int seed) {
+  const string temp_filename = filename + ".tmp";
+  std::ofstream output(temp_filename.c_str());
+  output << next_line << " " << seed << std::endl;
+  output.close();
+  CHECK(output) << "Failed to write " << temp_filename;
+  CHECK_EQ(std::rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Failed to write " << filename;
+}
+
+// Writes the images of lines [begin, end) to the databases, in turn by line,
+// commits them, and saves the checkpoint.
+static void WriteImages(const vector<ConvertedImage>* images, int begin,
+    int end, const vector<shared_ptr<db::DB> >* dbs,
+    const string& checkpoint, unsigned int seed, int* count,
+    int* data_size) {
+  vector<shared_ptr<db::Transaction> > txns;
+  for (int i = 0; i < dbs->size(); ++i) {
+    txns.push_back(shared_ptr<db::Transaction>((*dbs)[i]->NewTransaction()));
+  }
+  for (int line_id = begin; line_id < end; ++line_id) {
+    const ConvertedImage& image = (*images)[line_id - begin];
+    if (image.value.empty()) continue;
+    if (FLAGS_check_size) {
+      if (*data_size < 0) {
+        *data_size = image.data_size;
+      } else {
+        CHECK_EQ(image.data_size, *data_size) << "Incorrect data field size "
+            << image.data_size;
+      }
+    }
+    txns[line_id % txns.size()]->Put(image.key, image.value);
+    ++*count;
+  }
+  for (int i = 0; i < txns.size(); ++i) {
+    txns[i]->Commit();
+  }
+  WriteCheckpoint(checkpoint, end, seed);
+  LOG(INFO) << "Processed " << *count << " files.";
+}
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -66,10 +172,22 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  const bool is_color = !FLAGS_gray;
-  const bool check_size = FLAGS_check_size;
   const bool encoded = FLAGS_encoded;
   const string encode_type = FLAGS_encode_type;
+  const string db_name(argv[3]);
+  const string checkpoint = db_name + ".checkpoint";
+  CHECK_GT(FLAGS_threads, 0) << "Convert on at least one thread.";
+  CHECK_GT(FLAGS_commit_every, 0) << "Commit at least one image at a time.";
+  CHECK_GT(FLAGS_shards, 0) << "Write at least one database.";
+
+  // Where to start from, and the seed to shuffle the lines the same way.
+  int first_line = 0;
+  unsigned int seed = caffe_rng_rand();
+  if (FLAGS_resume) {
+    std::ifstream input(checkpoint.c_str());
+    CHECK(input >> first_line >> seed) << "Failed to read " << checkpoint;
+    LOG(INFO) << "Resuming from image " << first_line;
+  }
 
   std::ifstream infile(argv[2]);
   std::vector<std::pair<std::string, int> > lines;
@@ -84,6 +202,7 @@ int main(int argc, char** argv) {
   if (FLAGS_shuffle) {
     // randomly shuffle data
     LOG(INFO) << "Shuffling data";
+    Caffe::set_random_seed(seed);
     shuffle(lines.begin(), lines.end());
   }
   LOG(INFO) << "A total of " << lines.size() << " images.";
@@ -91,67 +210,40 @@ int main(int argc, char** argv) {
   if (encode_type.size() && !encoded)
     LOG(INFO) << "encode_type specified, assuming encoded=true.";
 
-  int resize_height = std::max<int>(0, FLAGS_resize_height);
-  int resize_width = std::max<int>(0, FLAGS_resize_width);
-
-  // Create new DB
-  scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
-  db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  // Create new DBs, or open those of the interrupted conversion
+  vector<shared_ptr<db::DB> > dbs;
+  for (int i = 0; i < FLAGS_shards; ++i) {
+    const string name = FLAGS_shards == 1 ? db_name
+        : db_name + "_" + caffe::format_int(i, 3);
+    dbs.push_back(shared_ptr<db::DB>(db::GetDB(FLAGS_backend)));
+    dbs.back()->Open(name, FLAGS_resume ? db::WRITE : db::NEW);
+  }
 
-  // Storing to db
+  // Storing to db, converting the images of a transaction while those of
+  // the previous one are written.
   std::string root_folder(argv[1]);
-  Datum datum;
+  TaskGraph workers(FLAGS_threads, FLAGS_threads);
+  vector<ConvertedImage> images[2];
+  boost::thread writer;
   int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
-    if (status == false) continue;
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
-      }
-    }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
+  int data_size = -1;
+  for (int begin = first_line, i = 0; begin < lines.size();
+       begin += FLAGS_commit_every, i = 1 - i) {
+    const int end = std::min<int>(begin + FLAGS_commit_every, lines.size());
+    images[i].resize(end - begin);
+    workers.Run(0, FLAGS_threads - 1, boost::bind(&ConvertImages,
+        boost::cref(lines), boost::cref(root_folder), begin, end, &images[i],
+        _1, FLAGS_threads));
+    if (writer.joinable()) {
+      writer.join();
     }
+    writer = boost::thread(&WriteImages, &images[i], begin, end, &dbs,
+        checkpoint, seed, &count, &data_size);
   }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
+  if (writer.joinable()) {
+    writer.join();
   }
+  std::remove(checkpoint.c_str());
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -0,0 +1,87 @@
+// This program rewrites a lmdb/leveldb of Datum protocol buffers as tensor
+// records (see caffe/util/tensor_record.hpp), under the same keys, for data
+// layers to read without parsing protocol buffers.
+// Usage:
+//   convert_to_tensor_records [FLAGS] INPUT_DB OUTPUT_DB
+
+#include <string>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/tensor_record.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using boost::scoped_ptr;
+
+DEFINE_string(backend, "lmdb",
+    "The backend {lmdb, leveldb} of the input and output databases");
+DEFINE_bool(decode, false,
+    "When this option is on, encoded images are stored decoded, trading "
+    "space for decoding time");
+DEFINE_int32(commit_every, 1000,
+    "The number of records written per database transaction");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Rewrite a leveldb/lmdb of Datums as tensor\n"
+        "records, which data layers read without parsing protocol buffers.\n"
+        "Usage:\n"
+        "    convert_to_tensor_records [FLAGS] INPUT_DB OUTPUT_DB\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/convert_to_tensor_records");
+    return 1;
+  }
+  CHECK_GT(FLAGS_commit_every, 0) << "Commit at least one record at a time.";
+#ifndef USE_OPENCV
+  CHECK(!FLAGS_decode) << "-decode requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+
+  scoped_ptr<db::DB> input(db::GetDB(FLAGS_backend));
+  input->Open(argv[1], db::READ);
+  scoped_ptr<db::Cursor> cursor(input->NewCursor());
+  scoped_ptr<db::DB> output(db::GetDB(FLAGS_backend));
+  output->Open(argv[2], db::NEW);
+  scoped_ptr<db::Transaction> txn(output->NewTransaction());
+
+  int count = 0;
+  DatumRecord record;
+  string value;
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+    const string input_value = cursor->value();
+    CHECK(ParseDatumRecord(input_value.data(), input_value.size(), false,
+        &record)) << "Failed to parse the value of " << cursor->key();
+#ifdef USE_OPENCV
+    if (FLAGS_decode) {
+      DecodeDatumNative(&record.datum);
+    }
+#endif  // USE_OPENCV
+    DatumToTensorRecord(record.datum, &value);
+    txn->Put(cursor->key(), value);
+    if (++count % FLAGS_commit_every == 0) {
+      txn->Commit();
+      txn.reset(output->NewTransaction());
+      LOG(INFO) << "Processed " << count << " records.";
+    }
+  }
+  // write the last batch
+  if (count % FLAGS_commit_every != 0) {
+    txn->Commit();
+    LOG(INFO) << "Processed " << count << " records.";
+  }
+  return 0;
+}
@@ -11,11 +11,13 @@
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
 using caffe::Datum;
 using caffe::Net;
+using caffe::NetParameter;
 using std::string;
 namespace db = caffe::db;
 
@@ -94,14 +96,23 @@ int feature_extraction_pipeline(int argc, char** argv) {
    }
    */
   std::string feature_extraction_proto(argv[++arg_pos]);
-  boost::shared_ptr<Net<Dtype> > feature_extraction_net(
-      new Net<Dtype>(feature_extraction_proto, caffe::TEST));
-  feature_extraction_net->CopyTrainedLayersFrom(pretrained_binary_proto);
-
   std::string extract_feature_blob_names(argv[++arg_pos]);
   std::vector<std::string> blob_names;
   boost::split(blob_names, extract_feature_blob_names, boost::is_any_of(","));
 
+  // Build only the part of the net the features depend on, so the layers
+  // after them are neither loaded nor run.
+  NetParameter feature_extraction_param;
+  caffe::ReadNetParamsFromTextFileOrDie(feature_extraction_proto,
+                                        &feature_extraction_param);
+  feature_extraction_param.mutable_state()->set_phase(caffe::TEST);
+  for (size_t i = 0; i < blob_names.size(); ++i) {
+    feature_extraction_param.add_output_blob(blob_names[i]);
+  }
+  boost::shared_ptr<Net<Dtype> > feature_extraction_net(
+      new Net<Dtype>(feature_extraction_param));
+  feature_extraction_net->CopyTrainedLayersFrom(pretrained_binary_proto);
+
   std::string save_feature_dataset_names(argv[++arg_pos]);
   std::vector<std::string> dataset_names;
   boost::split(dataset_names, save_feature_dataset_names,
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::Layer;
+using caffe::LayerParameter;
+using caffe::Net;
+using caffe::NetParameter;
+using caffe::shared_ptr;
+using caffe::string;
+using caffe::vector;
+using std::map;
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "The trained weights of the model.");
+DEFINE_int32(iterations, 50,
+    "The number of calibration batches to run.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Calibrate a trained net for int8 inference by "
+        "recording the input range of its Convolution and InnerProduct\n"
+        "layers over the TEST phase data, and write the model definition\n"
+        "with quantization_param set. The weights are used unchanged.\n"
+        "Usage:\n"
+        "    quantize_net [FLAGS] OUTPUT_MODEL\n");
+
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 2 || FLAGS_model.empty() || FLAGS_weights.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/quantize_net");
+    return 1;
+  }
+
+  Caffe::set_mode(Caffe::CPU);
+  NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  Net<float> net(param);
+  net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  // Run the net a layer at a time so that every input is measured before a
+  // later in-place layer can overwrite it.
+  const vector<shared_ptr<Layer<float> > >& layers = net.layers();
+  map<string, float> bottom_ranges;
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    for (int i = 0; i < layers.size(); ++i) {
+      if (caffe::CanQuantizeLayer(layers[i]->layer_param())) {
+        float& range = bottom_ranges[net.layer_names()[i]];
+        const vector<Blob<float>*>& bottom = net.bottom_vecs()[i];
+        for (int j = 0; j < bottom.size(); ++j) {
+          range = std::max(range,
+              caffe::caffe_cpu_amax(bottom[j]->count(), bottom[j]->cpu_data()));
+        }
+      }
+      net.ForwardFromTo(i, i);
+    }
+  }
+  for (map<string, float>::const_iterator it = bottom_ranges.begin();
+       it != bottom_ranges.end(); ++it) {
+    LOG(INFO) << "Layer " << it->first << " input range " << it->second;
+  }
+
+  NetParameter model_param, quantized_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &model_param);
+  caffe::QuantizeNet(model_param, bottom_ranges, &quantized_param);
+  LOG(INFO) << "Writing quantized model definition to " << argv[1];
+  caffe::WriteProtoToTextFile(quantized_param, argv[1]);
+  return 0;
+}
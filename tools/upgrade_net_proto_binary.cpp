@@ -1,4 +1,6 @@
 // This is a script to upgrade "V0" network prototxts to the new format.
+// The output has its weights aligned so that nets can use them in place
+// from a mapping of the file (see WriteNetParamsToAlignedBinaryFile).
 // Usage:
 //    upgrade_net_proto_binary v0_net_proto_file_in net_proto_file_out
 
@@ -9,6 +11,7 @@
 
 #include "caffe/caffe.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 using std::ofstream;
@@ -43,7 +46,7 @@ int main(int argc, char** argv) {
     LOG(ERROR) << "File already in latest proto format: " << input_filename;
   }
 
-  WriteProtoToBinaryFile(net_param, argv[2]);
+  WriteNetParamsToAlignedBinaryFile(net_param, argv[2]);
 
   LOG(INFO) << "Wrote upgraded NetParameter binary proto to " << argv[2];
   return !success;